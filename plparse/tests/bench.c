@@ -0,0 +1,759 @@
+#include "config.h"
+
+#include <locale.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef G_OS_UNIX
+#include <sys/resource.h>
+#endif /* G_OS_UNIX */
+
+#include "totem-pl-parser.h"
+
+/* Synthetic playlists of every format, parsed with totem_pl_parser_parse()
+ * to measure throughput, and saved as XSPF with the current and the old
+ * saver. Results are printed as a table, and optionally written out as
+ * JSON, to compare them across commits.
+ *
+ * "meson test --benchmark" runs the default sizes, larger ones are
+ * run by hand, for example with "bench --sizes 1000000". */
+
+static char *option_sizes = NULL;
+static char *option_formats = NULL;
+static char *option_output = NULL;
+static char *option_corpus_dir = NULL;
+static char *option_label = NULL;
+static gboolean option_debug = FALSE;
+
+#ifdef HAVE___LIBC_MALLOC
+/* Count the allocations going through the C library, GLib's included */
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+static volatile gsize num_allocs = 0;
+
+void *
+malloc (size_t size)
+{
+	g_atomic_pointer_add (&num_allocs, 1);
+	return __libc_malloc (size);
+}
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+	g_atomic_pointer_add (&num_allocs, 1);
+	return __libc_calloc (nmemb, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+	if (ptr == NULL)
+		g_atomic_pointer_add (&num_allocs, 1);
+	return __libc_realloc (ptr, size);
+}
+#endif /* HAVE___LIBC_MALLOC */
+
+typedef enum {
+	VARIANT_ABSOLUTE,
+	VARIANT_RELATIVE,
+	VARIANT_LATIN1
+} BenchVariant;
+
+static const char *variant_names[] = {
+	"absolute",
+	"relative",
+	"latin1"
+};
+
+typedef struct {
+	const char *name;
+	const char *extension;
+	gboolean xml;
+	const char *header;
+	/* Gets the index, URI, title and length in seconds */
+	void (* write_entry) (FILE *out, guint i, const char *uri, const char *title, guint length);
+	void (* write_footer) (FILE *out, guint num_entries);
+	const char *footer;
+} BenchFormat;
+
+static void
+write_m3u_entry (FILE *out, guint i, const char *uri, const char *title, guint length)
+{
+	fprintf (out, "#EXTINF:%u,%s\n%s\n", length, title, uri);
+}
+
+static void
+write_pls_entry (FILE *out, guint i, const char *uri, const char *title, guint length)
+{
+	fprintf (out, "File%u=%s\nTitle%u=%s\nLength%u=%u\n", i + 1, uri, i + 1, title, i + 1, length);
+}
+
+static void
+write_pls_footer (FILE *out, guint num_entries)
+{
+	fprintf (out, "NumberOfEntries=%u\nVersion=2\n", num_entries);
+}
+
+static void
+write_xspf_entry (FILE *out, guint i, const char *uri, const char *title, guint length)
+{
+	fprintf (out, "<track><location>%s</location><title>%s</title><duration>%u</duration></track>\n",
+		 uri, title, length * 1000);
+}
+
+static void
+write_asx_entry (FILE *out, guint i, const char *uri, const char *title, guint length)
+{
+	fprintf (out, "<entry><title>%s</title><ref href=\"%s\"/><duration value=\"00:00:%02u\"/></entry>\n",
+		 title, uri, length % 60);
+}
+
+static void
+write_smil_entry (FILE *out, guint i, const char *uri, const char *title, guint length)
+{
+	fprintf (out, "<audio src=\"%s\" title=\"%s\" dur=\"%us\"/>\n", uri, title, length);
+}
+
+static void
+write_rss_entry (FILE *out, guint i, const char *uri, const char *title, guint length)
+{
+	fprintf (out, "<item><title>%s</title><enclosure url=\"%s\" length=\"%u\" type=\"audio/mpeg\"/>"
+		 "<guid>bench-%u</guid></item>\n", title, uri, length * 16000, i);
+}
+
+static void
+write_atom_entry (FILE *out, guint i, const char *uri, const char *title, guint length)
+{
+	fprintf (out, "<entry><title>%s</title><id>bench-%u</id><link rel=\"enclosure\" href=\"%s\" "
+		 "type=\"audio/mpeg\" length=\"%u\"/></entry>\n", title, i, uri, length * 16000);
+}
+
+static void
+write_opml_entry (FILE *out, guint i, const char *uri, const char *title, guint length)
+{
+	fprintf (out, "<outline text=\"%s\" type=\"rss\" xmlUrl=\"%s\"/>\n", title, uri);
+}
+
+static const BenchFormat formats[] = {
+	{ "m3u", "m3u", FALSE, "#EXTM3U\n", write_m3u_entry, NULL, NULL },
+	{ "pls", "pls", FALSE, "[playlist]\n", write_pls_entry, write_pls_footer, NULL },
+	{ "xspf", "xspf", TRUE, "<playlist version=\"1\" xmlns=\"http://xspf.org/ns/0/\">\n<trackList>\n",
+	  write_xspf_entry, NULL, "</trackList>\n</playlist>\n" },
+	{ "asx", "asx", TRUE, "<asx version=\"3.0\">\n<title>Benchmark</title>\n",
+	  write_asx_entry, NULL, "</asx>\n" },
+	{ "smil", "smil", TRUE, "<smil>\n<head><meta name=\"title\" content=\"Benchmark\"/></head>\n<body>\n<seq>\n",
+	  write_smil_entry, NULL, "</seq>\n</body>\n</smil>\n" },
+	{ "rss", "rss", TRUE, "<rss version=\"2.0\">\n<channel>\n<title>Benchmark</title>\n",
+	  write_rss_entry, NULL, "</channel>\n</rss>\n" },
+	{ "atom", "atom", TRUE, "<feed xmlns=\"http://www.w3.org/2005/Atom\">\n<title>Benchmark</title>\n",
+	  write_atom_entry, NULL, "</feed>\n" },
+	{ "opml", "opml", TRUE, "<opml version=\"1.1\">\n<body>\n<outline text=\"Benchmark\">\n",
+	  write_opml_entry, NULL, "</outline>\n</body>\n</opml>\n" },
+};
+
+/* Writes a playlist of @num_entries entries to @path, and returns its size */
+static goffset
+bench_write_playlist (const BenchFormat *format,
+		      BenchVariant variant,
+		      guint num_entries,
+		      const char *path)
+{
+	FILE *out;
+	char *uri, *title;
+	const char *encoding;
+	goffset size;
+	guint i;
+
+	out = g_fopen (path, "wb");
+	if (out == NULL)
+		g_error ("Couldn't create '%s': %s", path, g_strerror (errno));
+
+	encoding = (variant == VARIANT_LATIN1) ? "ISO-8859-1" : "UTF-8";
+	if (format->xml)
+		fprintf (out, "<?xml version=\"1.0\" encoding=\"%s\"?>\n", encoding);
+	fputs (format->header, out);
+
+	for (i = 0; i < num_entries; i++) {
+		if (variant == VARIANT_ABSOLUTE) {
+			uri = g_strdup_printf ("http://media.example.com/artist%u/album%u/track%u.mp3",
+					       i / 1000, i / 10, i);
+			title = g_strdup_printf ("Track %u", i);
+		} else if (variant == VARIANT_RELATIVE) {
+			uri = g_strdup_printf ("artist%u/album%u/track%u.mp3", i / 1000, i / 10, i);
+			title = g_strdup_printf ("Track %u", i);
+		} else {
+			/* With an e-acute, as ISO-8859-1 */
+			uri = g_strdup_printf ("artist%u/album%u/chanson\xe9%u.mp3", i / 1000, i / 10, i);
+			title = g_strdup_printf ("Titr\xe9 %u", i);
+		}
+		format->write_entry (out, i, uri, title, 60 + i % 240);
+		g_free (uri);
+		g_free (title);
+	}
+
+	if (format->write_footer != NULL)
+		format->write_footer (out, num_entries);
+	else
+		fputs (format->footer, out);
+
+	size = ftell (out);
+	if (fclose (out) != 0)
+		g_error ("Couldn't write '%s': %s", path, g_strerror (errno));
+
+	return size;
+}
+
+typedef struct {
+	const char *format;
+	const char *variant;
+	guint num_entries;
+	guint num_parsed;
+	goffset size;
+	TotemPlParserResult result;
+	gint64 duration; /* in microseconds */
+	gint64 max_rss; /* in kilobytes, or -1 */
+	gint64 num_allocs; /* or -1 */
+} BenchResult;
+
+static void
+entry_parsed_cb (TotemPlParser *parser,
+		 const char *uri,
+		 GHashTable *metadata,
+		 guint *num_parsed)
+{
+	(*num_parsed)++;
+}
+
+/* Resets the peak resident set size, where the kernel allows it */
+static void
+bench_reset_max_rss (void)
+{
+#ifdef G_OS_UNIX
+	FILE *clear_refs;
+
+	clear_refs = g_fopen ("/proc/self/clear_refs", "w");
+	if (clear_refs != NULL) {
+		fputs ("5", clear_refs);
+		fclose (clear_refs);
+	}
+#endif /* G_OS_UNIX */
+}
+
+static gint64
+bench_get_max_rss (void)
+{
+	char *status, *hwm;
+	gint64 ret = -1;
+
+	if (g_file_get_contents ("/proc/self/status", &status, NULL, NULL) != FALSE) {
+		hwm = strstr (status, "VmHWM:");
+		if (hwm != NULL)
+			ret = g_ascii_strtoll (hwm + strlen ("VmHWM:"), NULL, 10);
+		g_free (status);
+	}
+#ifdef G_OS_UNIX
+	if (ret < 0) {
+		struct rusage usage;
+
+		if (getrusage (RUSAGE_SELF, &usage) == 0)
+			ret = usage.ru_maxrss;
+	}
+#endif /* G_OS_UNIX */
+
+	return ret;
+}
+
+static void
+bench_run (const BenchFormat *format,
+	   BenchVariant variant,
+	   guint num_entries,
+	   const char *dir,
+	   BenchResult *result)
+{
+	TotemPlParser *parser;
+	char *name, *path, *uri;
+	gint64 start;
+#ifdef HAVE___LIBC_MALLOC
+	gsize allocs_start;
+#endif
+
+	name = g_strdup_printf ("bench-%u-%s.%s", num_entries, variant_names[variant], format->extension);
+	path = g_build_filename (dir, name, NULL);
+	uri = g_filename_to_uri (path, NULL, NULL);
+	g_free (name);
+
+	result->format = format->name;
+	result->variant = variant_names[variant];
+	result->num_entries = num_entries;
+	result->num_parsed = 0;
+	result->size = bench_write_playlist (format, variant, num_entries, path);
+
+	parser = totem_pl_parser_new ();
+	g_object_set (parser, "debug", option_debug, NULL);
+	g_signal_connect (parser, "entry-parsed",
+			  G_CALLBACK (entry_parsed_cb), &result->num_parsed);
+
+	bench_reset_max_rss ();
+#ifdef HAVE___LIBC_MALLOC
+	allocs_start = (gsize) g_atomic_pointer_get (&num_allocs);
+#endif
+	start = g_get_monotonic_time ();
+
+	result->result = totem_pl_parser_parse (parser, uri, FALSE);
+
+	result->duration = g_get_monotonic_time () - start;
+#ifdef HAVE___LIBC_MALLOC
+	result->num_allocs = (gsize) g_atomic_pointer_get (&num_allocs) - allocs_start;
+#else
+	result->num_allocs = -1;
+#endif
+	result->max_rss = bench_get_max_rss ();
+
+	g_object_unref (parser);
+	/* The biggest ones take a lot of space */
+	g_unlink (path);
+	g_free (path);
+	g_free (uri);
+}
+
+/* A playlist with every field the XSPF saver knows about set */
+static TotemPlPlaylist *
+bench_build_playlist (guint num_entries)
+{
+	TotemPlPlaylist *playlist;
+	guint i;
+
+	playlist = totem_pl_playlist_new ();
+	for (i = 0; i < num_entries; i++) {
+		TotemPlPlaylistIter iter;
+		char *uri, *title, *duration;
+
+		uri = g_strdup_printf ("http://media.example.com/artist%u/album%u/track%u.mp3?a=1&b=%u",
+				       i / 1000, i / 10, i, i);
+		title = g_strdup_printf ("Track <%u> & \"friends\"", i);
+		duration = g_strdup_printf ("%u", (60 + i % 240) * 1000);
+
+		totem_pl_playlist_append (playlist, &iter);
+		totem_pl_playlist_set (playlist, &iter,
+				       TOTEM_PL_PARSER_FIELD_URI, uri,
+				       TOTEM_PL_PARSER_FIELD_TITLE, title,
+				       TOTEM_PL_PARSER_FIELD_AUTHOR, "Artist",
+				       TOTEM_PL_PARSER_FIELD_IMAGE_URI, "http://media.example.com/cover.jpg",
+				       TOTEM_PL_PARSER_FIELD_ALBUM, "Album",
+				       TOTEM_PL_PARSER_FIELD_DURATION_MS, duration,
+				       TOTEM_PL_PARSER_FIELD_GENRE, "Drum & Bass",
+				       TOTEM_PL_PARSER_FIELD_STARTTIME, "10",
+				       TOTEM_PL_PARSER_FIELD_SUBTITLE_URI, "http://media.example.com/track.srt",
+				       TOTEM_PL_PARSER_FIELD_PLAYING, i == 0 ? "true" : "",
+				       TOTEM_PL_PARSER_FIELD_CONTENT_TYPE, "audio/mpeg",
+				       NULL);
+		g_free (uri);
+		g_free (title);
+		g_free (duration);
+	}
+
+	return playlist;
+}
+
+static gboolean
+bench_write_string (GOutputStream *stream, const char *str, GError **error)
+{
+	return g_output_stream_write_all (stream, str, strlen (str), NULL, NULL, error);
+}
+
+/* The XSPF saver as it was before it went through a single escaping
+ * buffer, with a write for every element, to compare against. All the
+ * URIs are absolute, so it doesn't try to make them relative */
+static gboolean
+bench_save_xspf_reference (TotemPlPlaylist *playlist, GFile *output, GError **error)
+{
+	static const struct {
+		const char *field;
+		const char *element;
+	} fields[] = {
+		{ TOTEM_PL_PARSER_FIELD_TITLE, "title" },
+		{ TOTEM_PL_PARSER_FIELD_AUTHOR, "creator" },
+		{ TOTEM_PL_PARSER_FIELD_IMAGE_URI, "image" },
+		{ TOTEM_PL_PARSER_FIELD_ALBUM, "album" },
+		{ TOTEM_PL_PARSER_FIELD_DURATION_MS, "duration" },
+		{ TOTEM_PL_PARSER_FIELD_GENRE, NULL },
+		{ TOTEM_PL_PARSER_FIELD_STARTTIME, NULL },
+		{ TOTEM_PL_PARSER_FIELD_SUBTITLE_URI, NULL },
+		{ TOTEM_PL_PARSER_FIELD_PLAYING, NULL },
+		{ TOTEM_PL_PARSER_FIELD_CONTENT_TYPE, NULL }
+	};
+	TotemPlPlaylistIter iter;
+	GFileOutputStream *file_stream;
+	GOutputStream *stream;
+	gboolean valid, success;
+
+	file_stream = g_file_replace (output, NULL, FALSE, G_FILE_CREATE_NONE, NULL, error);
+	if (file_stream == NULL)
+		return FALSE;
+	stream = G_OUTPUT_STREAM (file_stream);
+
+	success = bench_write_string (stream,
+				      "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+				      "<playlist version=\"1\" xmlns=\"http://xspf.org/ns/0/\">\n"
+				      " <trackList>\n", error);
+
+	valid = totem_pl_playlist_iter_first (playlist, &iter);
+	while (valid && success) {
+		char *uri, *escaped, *buf;
+		gboolean wrote_ext;
+		guint i;
+
+		totem_pl_playlist_get (playlist, &iter,
+				       TOTEM_PL_PARSER_FIELD_URI, &uri,
+				       NULL);
+		if (uri == NULL) {
+			valid = totem_pl_playlist_iter_next (playlist, &iter);
+			continue;
+		}
+
+		escaped = g_markup_escape_text (uri, -1);
+		buf = g_strdup_printf ("  <track>\n"
+				       "   <location>%s</location>\n", escaped);
+		success = bench_write_string (stream, buf, error);
+		g_free (buf);
+		g_free (escaped);
+		g_free (uri);
+
+		wrote_ext = FALSE;
+		for (i = 0; i < G_N_ELEMENTS (fields) && success; i++) {
+			char *str;
+
+			totem_pl_playlist_get (playlist, &iter,
+					       fields[i].field, &str,
+					       NULL);
+			if (str == NULL || *str == '\0') {
+				g_free (str);
+				continue;
+			}
+			escaped = g_markup_escape_text (str, -1);
+			g_free (str);
+
+			if (g_str_equal (fields[i].field, TOTEM_PL_PARSER_FIELD_GENRE)) {
+				buf = g_strdup_printf ("   <extension application=\"http://www.rhythmbox.org\">\n"
+						       "     <genre>%s</genre>\n"
+						       "   </extension>\n", escaped);
+			} else if (fields[i].element == NULL) {
+				buf = g_strdup_printf ("%s     <%s>%s</%s>\n",
+						       wrote_ext ? "" : "   <extension application=\"http://www.gnome.org\">\n",
+						       fields[i].field, escaped, fields[i].field);
+				wrote_ext = TRUE;
+			} else {
+				buf = g_strdup_printf ("   <%s>%s</%s>\n",
+						       fields[i].element, escaped, fields[i].element);
+			}
+
+			success = bench_write_string (stream, buf, error);
+			g_free (buf);
+			g_free (escaped);
+		}
+
+		if (success && wrote_ext)
+			success = bench_write_string (stream, "   </extension>\n", error);
+		if (success)
+			success = bench_write_string (stream, "  </track>\n", error);
+
+		valid = totem_pl_playlist_iter_next (playlist, &iter);
+	}
+
+	if (success)
+		success = bench_write_string (stream,
+					      " </trackList>\n"
+					      "</playlist>", error);
+	g_object_unref (stream);
+
+	return success;
+}
+
+/* Saves @playlist as XSPF to @path, with the current saver or,
+ * if @reference is %TRUE, with bench_save_xspf_reference() */
+static void
+bench_run_save (TotemPlPlaylist *playlist,
+		gboolean reference,
+		guint num_entries,
+		const char *path,
+		BenchResult *result)
+{
+	TotemPlParser *parser;
+	GFile *file;
+	GError *error = NULL;
+	GStatBuf buf;
+	gboolean success;
+	gint64 start;
+#ifdef HAVE___LIBC_MALLOC
+	gsize allocs_start;
+#endif
+
+	result->format = "xspf";
+	result->variant = reference ? "save-old" : "save";
+	result->num_entries = num_entries;
+
+	parser = totem_pl_parser_new ();
+	g_object_set (parser, "debug", option_debug, NULL);
+	file = g_file_new_for_path (path);
+
+	bench_reset_max_rss ();
+#ifdef HAVE___LIBC_MALLOC
+	allocs_start = (gsize) g_atomic_pointer_get (&num_allocs);
+#endif
+	start = g_get_monotonic_time ();
+
+	if (reference)
+		success = bench_save_xspf_reference (playlist, file, &error);
+	else
+		success = totem_pl_parser_save (parser, playlist, file, "Benchmark", TOTEM_PL_PARSER_XSPF, &error);
+
+	result->duration = g_get_monotonic_time () - start;
+#ifdef HAVE___LIBC_MALLOC
+	result->num_allocs = (gsize) g_atomic_pointer_get (&num_allocs) - allocs_start;
+#else
+	result->num_allocs = -1;
+#endif
+	result->max_rss = bench_get_max_rss ();
+
+	if (success == FALSE) {
+		g_print ("Couldn't save '%s': %s\n", path, error->message);
+		g_error_free (error);
+	}
+	result->result = success ? TOTEM_PL_PARSER_RESULT_SUCCESS : TOTEM_PL_PARSER_RESULT_ERROR;
+	result->num_parsed = success ? num_entries : 0;
+	result->size = (g_stat (path, &buf) == 0) ? buf.st_size : 0;
+
+	g_object_unref (file);
+	g_object_unref (parser);
+}
+
+/* Times the current XSPF saver against the old one, checking that
+ * they still write the same thing */
+static void
+bench_run_savers (guint num_entries,
+		  const char *dir,
+		  BenchResult *result,
+		  BenchResult *reference_result)
+{
+	TotemPlPlaylist *playlist;
+	char *name, *path, *reference_path;
+	char *contents, *reference_contents;
+
+	name = g_strdup_printf ("bench-%u-save.xspf", num_entries);
+	path = g_build_filename (dir, name, NULL);
+	g_free (name);
+	name = g_strdup_printf ("bench-%u-save-old.xspf", num_entries);
+	reference_path = g_build_filename (dir, name, NULL);
+	g_free (name);
+
+	playlist = bench_build_playlist (num_entries);
+	bench_run_save (playlist, FALSE, num_entries, path, result);
+	bench_run_save (playlist, TRUE, num_entries, reference_path, reference_result);
+	g_object_unref (playlist);
+
+	if (result->result == TOTEM_PL_PARSER_RESULT_SUCCESS &&
+	    reference_result->result == TOTEM_PL_PARSER_RESULT_SUCCESS &&
+	    g_file_get_contents (path, &contents, NULL, NULL) != FALSE) {
+		if (g_file_get_contents (reference_path, &reference_contents, NULL, NULL) != FALSE) {
+			if (g_strcmp0 (contents, reference_contents) != 0) {
+				g_print ("The old and new XSPF savers wrote different playlists\n");
+				result->result = TOTEM_PL_PARSER_RESULT_ERROR;
+			}
+			g_free (reference_contents);
+		}
+		g_free (contents);
+	}
+
+	g_unlink (path);
+	g_unlink (reference_path);
+	g_free (path);
+	g_free (reference_path);
+}
+
+static const char *
+bench_result_to_string (TotemPlParserResult result)
+{
+	switch (result) {
+	case TOTEM_PL_PARSER_RESULT_UNHANDLED:
+		return "unhandled";
+	case TOTEM_PL_PARSER_RESULT_ERROR:
+		return "error";
+	case TOTEM_PL_PARSER_RESULT_SUCCESS:
+		return "success";
+	case TOTEM_PL_PARSER_RESULT_IGNORED:
+		return "ignored";
+	case TOTEM_PL_PARSER_RESULT_CANCELLED:
+		return "cancelled";
+	default:
+		return "unknown";
+	}
+}
+
+static double
+bench_per_second (double value, gint64 duration)
+{
+	return value * G_USEC_PER_SEC / MAX (duration, 1);
+}
+
+static void
+bench_print_result (const BenchResult *result)
+{
+	g_print ("%-5s %-8s %8u %8u %10.0f %12.0f %9.1f %9" G_GINT64_FORMAT " %8.1f  %s\n",
+		 result->format, result->variant,
+		 result->num_entries, result->num_parsed,
+		 result->duration / 1000.0,
+		 bench_per_second (result->num_parsed, result->duration),
+		 bench_per_second (result->size, result->duration) / (1024 * 1024),
+		 result->max_rss,
+		 result->num_allocs >= 0 && result->num_entries > 0 ?
+		 (double) result->num_allocs / result->num_entries : -1.0,
+		 bench_result_to_string (result->result));
+}
+
+static gboolean
+bench_write_json (GArray *results, const char *path, GError **error)
+{
+	GString *json;
+	gboolean ret;
+	guint i;
+
+	json = g_string_new (NULL);
+	g_string_append_printf (json, "{\n  \"version\": \"%d.%d.%d\",\n  \"label\": \"%s\",\n  \"results\": [\n",
+				TOTEM_PL_PARSER_VERSION_MAJOR, TOTEM_PL_PARSER_VERSION_MINOR,
+				TOTEM_PL_PARSER_VERSION_MICRO, option_label ? option_label : "");
+	for (i = 0; i < results->len; i++) {
+		const BenchResult *result = &g_array_index (results, BenchResult, i);
+
+		g_string_append_printf (json,
+					"    { \"format\": \"%s\", \"variant\": \"%s\", \"entries\": %u, "
+					"\"parsed\": %u, \"bytes\": %" G_GINT64_FORMAT ", \"result\": \"%s\", "
+					"\"seconds\": %.6f, \"entries_per_second\": %.1f, \"bytes_per_second\": %.1f, "
+					"\"max_rss_kb\": %" G_GINT64_FORMAT ", \"allocations\": %" G_GINT64_FORMAT " }%s\n",
+					result->format, result->variant, result->num_entries,
+					result->num_parsed, (gint64) result->size,
+					bench_result_to_string (result->result),
+					(double) result->duration / G_USEC_PER_SEC,
+					bench_per_second (result->num_parsed, result->duration),
+					bench_per_second (result->size, result->duration),
+					result->max_rss, result->num_allocs,
+					i + 1 < results->len ? "," : "");
+	}
+	g_string_append (json, "  ]\n}\n");
+
+	ret = g_file_set_contents (path, json->str, json->len, error);
+	g_string_free (json, TRUE);
+
+	return ret;
+}
+
+static gboolean
+bench_format_is_selected (char **format_names, const char *name)
+{
+	guint i;
+
+	if (format_names == NULL)
+		return TRUE;
+	for (i = 0; format_names[i] != NULL; i++) {
+		if (g_strcmp0 (format_names[i], name) == 0)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+int
+main (int argc, char *argv[])
+{
+	GError *error = NULL;
+	GOptionContext *context;
+	GArray *results;
+	char **sizes, **format_names;
+	char *dir;
+	guint i, j, k;
+	const GOptionEntry entries[] = {
+		{ "sizes", 's', 0, G_OPTION_ARG_STRING, &option_sizes, "Comma-separated numbers of entries (default: 1000,100000)", "SIZES" },
+		{ "formats", 'f', 0, G_OPTION_ARG_STRING, &option_formats, "Comma-separated formats to run (default: all)", "FORMATS" },
+		{ "output", 'o', 0, G_OPTION_ARG_FILENAME, &option_output, "Write the results as JSON to FILE", "FILE" },
+		{ "corpus-dir", 'c', 0, G_OPTION_ARG_FILENAME, &option_corpus_dir, "Where to generate the playlists (default: a temporary directory)", "DIR" },
+		{ "label", 'l', 0, G_OPTION_ARG_STRING, &option_label, "Label for the results, such as a commit ID", "LABEL" },
+		{ "debug", 'd', 0, G_OPTION_ARG_NONE, &option_debug, "Enable debug", NULL },
+		{ NULL }
+	};
+
+	setlocale (LC_ALL, "");
+
+	context = g_option_context_new ("- benchmark playlist parsing");
+	g_option_context_add_main_entries (context, entries, GETTEXT_PACKAGE);
+	if (g_option_context_parse (context, &argc, &argv, &error) == FALSE) {
+		g_print ("Option parsing failed: %s\n", error->message);
+		return 1;
+	}
+	g_option_context_free (context);
+
+	sizes = g_strsplit (option_sizes ? option_sizes : "1000,100000", ",", -1);
+	format_names = option_formats ? g_strsplit (option_formats, ",", -1) : NULL;
+
+	if (option_corpus_dir != NULL) {
+		dir = g_strdup (option_corpus_dir);
+		g_mkdir_with_parents (dir, 0700);
+	} else {
+		dir = g_dir_make_tmp ("totem-pl-parser-bench-XXXXXX", &error);
+		if (dir == NULL) {
+			g_print ("Couldn't create the corpus directory: %s\n", error->message);
+			return 1;
+		}
+	}
+
+	results = g_array_new (FALSE, FALSE, sizeof (BenchResult));
+
+	g_print ("%-5s %-8s %8s %8s %10s %12s %9s %9s %8s  %s\n",
+		 "fmt", "variant", "entries", "parsed", "ms", "entries/s", "MiB/s", "rss (kB)", "allocs/e", "result");
+	for (i = 0; sizes[i] != NULL; i++) {
+		guint num_entries;
+
+		num_entries = g_ascii_strtoull (sizes[i], NULL, 10);
+		for (j = 0; j < G_N_ELEMENTS (formats); j++) {
+			if (bench_format_is_selected (format_names, formats[j].name) == FALSE)
+				continue;
+			for (k = VARIANT_ABSOLUTE; k <= VARIANT_LATIN1; k++) {
+				BenchResult result;
+
+				bench_run (&formats[j], k, num_entries, dir, &result);
+				bench_print_result (&result);
+				g_array_append_val (results, result);
+			}
+		}
+		if (bench_format_is_selected (format_names, "xspf")) {
+			BenchResult result, reference_result;
+
+			bench_run_savers (num_entries, dir, &result, &reference_result);
+			bench_print_result (&result);
+			bench_print_result (&reference_result);
+			g_array_append_val (results, result);
+			g_array_append_val (results, reference_result);
+		}
+	}
+
+	if (option_output != NULL &&
+	    bench_write_json (results, option_output, &error) == FALSE) {
+		g_print ("Couldn't write the results: %s\n", error->message);
+		return 1;
+	}
+
+	if (option_corpus_dir == NULL)
+		g_rmdir (dir);
+	g_free (dir);
+	g_array_free (results, TRUE);
+	g_strfreev (sizes);
+	g_strfreev (format_names);
+
+	return 0;
+}
@@ -21,6 +21,7 @@
 
 #include <locale.h>
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <gio/gio.h>
 
 #include "totem-disc.h"
@@ -88,6 +89,154 @@ test_disc (gconstpointer data)
 	return;
 }
 
+static void
+test_disc_dir (void)
+{
+	TotemDiscMediaType type;
+	char *dir, *video_ts, *ifo, *uri, *mrl, *expected;
+
+	dir = g_dir_make_tmp ("totem-disc-XXXXXX", NULL);
+	g_assert_nonnull (dir);
+
+	/* Not a disc */
+	g_assert_cmpint (totem_cd_detect_type_from_dir (dir, NULL, NULL), ==, MEDIA_TYPE_DATA);
+
+	video_ts = g_build_filename (dir, "VIDEO_TS", NULL);
+	g_assert_cmpint (g_mkdir (video_ts, 0755), ==, 0);
+	ifo = g_build_filename (video_ts, "VIDEO_TS.IFO", NULL);
+	g_assert_true (g_file_set_contents (ifo, "", 0, NULL));
+	expected = totem_cd_mrl_from_type ("dvd", dir);
+
+	mrl = NULL;
+	type = totem_cd_detect_type_from_dir (dir, &mrl, NULL);
+	g_assert_cmpint (type, ==, MEDIA_TYPE_DVD);
+	g_assert_cmpstr (mrl, ==, expected);
+	g_free (mrl);
+
+	/* From inside the disc, as a URI */
+	uri = g_filename_to_uri (video_ts, NULL, NULL);
+	mrl = NULL;
+	type = totem_cd_detect_type_from_dir (uri, &mrl, NULL);
+	g_assert_cmpint (type, ==, MEDIA_TYPE_DVD);
+	g_assert_cmpstr (mrl, ==, expected);
+	g_free (mrl);
+	g_free (uri);
+
+	g_unlink (ifo);
+	g_rmdir (video_ts);
+	g_free (ifo);
+	g_free (video_ts);
+	g_free (expected);
+
+	/* Lower-case markers, which need to have something in them */
+	video_ts = g_build_filename (dir, "bdmv", NULL);
+	g_assert_cmpint (g_mkdir (video_ts, 0755), ==, 0);
+	g_assert_cmpint (totem_cd_detect_type_from_dir (dir, NULL, NULL), ==, MEDIA_TYPE_DATA);
+	ifo = g_build_filename (video_ts, "index.bdmv", NULL);
+	g_assert_true (g_file_set_contents (ifo, "", 0, NULL));
+	g_assert_cmpint (totem_cd_detect_type_from_dir (dir, NULL, NULL), ==, MEDIA_TYPE_BD);
+	g_unlink (ifo);
+	g_rmdir (video_ts);
+	g_free (ifo);
+	g_free (video_ts);
+
+	/* An empty MPEG2 directory isn't a SVCD */
+	video_ts = g_build_filename (dir, "mpeg2", NULL);
+	g_assert_cmpint (g_mkdir (video_ts, 0755), ==, 0);
+	g_assert_cmpint (totem_cd_detect_type_from_dir (dir, NULL, NULL), ==, MEDIA_TYPE_DATA);
+	g_rmdir (video_ts);
+	g_free (video_ts);
+
+	/* A DVD folder renamed with a different case */
+	video_ts = g_build_filename (dir, "Video_TS", NULL);
+	g_assert_cmpint (g_mkdir (video_ts, 0755), ==, 0);
+	ifo = g_build_filename (video_ts, "video_ts.ifo", NULL);
+	g_assert_true (g_file_set_contents (ifo, "", 0, NULL));
+	g_assert_cmpint (totem_cd_detect_type_from_dir (dir, NULL, NULL), ==, MEDIA_TYPE_DVD);
+	g_unlink (ifo);
+	g_rmdir (video_ts);
+	g_free (ifo);
+	g_free (video_ts);
+
+	/* The DVD files right in the root, with their ISO9660 version */
+	ifo = g_build_filename (dir, "VIDEO_TS.IFO;1", NULL);
+	g_assert_true (g_file_set_contents (ifo, "", 0, NULL));
+	g_assert_cmpint (totem_cd_detect_type_from_dir (dir, NULL, NULL), ==, MEDIA_TYPE_DVD);
+	g_unlink (ifo);
+	g_free (ifo);
+
+	g_rmdir (dir);
+	g_free (dir);
+}
+
+static void
+test_disc_iso (void)
+{
+	TotemDiscMediaType type;
+	char *mrl, *expected;
+
+	mrl = NULL;
+	type = totem_cd_detect_type_with_url (TEST_SRCDIR "video-dvd.iso", &mrl, NULL);
+	g_assert_cmpint (type, ==, MEDIA_TYPE_DVD);
+	expected = totem_cd_mrl_from_type ("dvd", TEST_SRCDIR "video-dvd.iso");
+	g_assert_cmpstr (mrl, ==, expected);
+	g_free (expected);
+	g_free (mrl);
+
+	/* Not an ISO image */
+	type = totem_cd_detect_type_with_url (TEST_SRCDIR "3gpp-file.mp4", NULL, NULL);
+	g_assert_cmpint (type, ==, MEDIA_TYPE_ERROR);
+}
+
+static void
+test_disc_detect_types (void)
+{
+	const char *devices[] = {
+		TEST_SRCDIR "video-dvd.iso",
+		NULL,
+		TEST_SRCDIR "3gpp-file.mp4",
+		NULL
+	};
+	GPtrArray *infos;
+	TotemDiscInfo *info;
+	char *dir, *video_ts, *expected;
+
+	dir = g_dir_make_tmp ("totem-disc-XXXXXX", NULL);
+	g_assert_nonnull (dir);
+	video_ts = g_build_filename (dir, "VIDEO_TS", NULL);
+	g_assert_cmpint (g_mkdir (video_ts, 0755), ==, 0);
+	devices[1] = dir;
+
+	infos = totem_cd_detect_types (devices, 2);
+	g_assert_cmpuint (infos->len, ==, 3);
+
+	info = g_ptr_array_index (infos, 0);
+	g_assert_cmpstr (info->device, ==, devices[0]);
+	g_assert_cmpint (info->type, ==, MEDIA_TYPE_DVD);
+	expected = totem_cd_mrl_from_type ("dvd", devices[0]);
+	g_assert_cmpstr (info->mrl, ==, expected);
+	g_free (expected);
+	g_assert_cmpstr (info->label, ==, "TEST_DVD");
+	g_assert_no_error (info->error);
+	g_assert_cmpint (info->probe_time, >=, 0);
+
+	/* No VIDEO_TS.IFO, so just a data directory */
+	info = g_ptr_array_index (infos, 1);
+	g_assert_cmpint (info->type, ==, MEDIA_TYPE_DATA);
+	g_assert_null (info->label);
+
+	info = g_ptr_array_index (infos, 2);
+	g_assert_cmpint (info->type, ==, MEDIA_TYPE_ERROR);
+	g_assert_null (info->mrl);
+
+	g_ptr_array_unref (infos);
+
+	g_rmdir (video_ts);
+	g_free (video_ts);
+	g_rmdir (dir);
+	g_free (dir);
+}
+
 static void
 log_handler (const char *log_domain, GLogLevelFlags log_level, const char *message, gpointer user_data)
 {
@@ -121,9 +270,13 @@ main (int argc, char *argv[])
 	}
 
 	if (device_paths == NULL) {
+		g_test_add_func ("/disc/dir", test_disc_dir);
+		g_test_add_func ("/disc/iso", test_disc_iso);
+		g_test_add_func ("/disc/detect_types", test_disc_detect_types);
+
 		/* Don't want to error during check on some other machines */
 		if (g_strcmp0 (g_get_user_name (), "hadess") != 0)
-			return 0;
+			return g_test_run ();
 
 		/* We need to handle log messages produced by g_message so they're interpreted correctly by the GTester framework */
 		g_log_set_handler (NULL, G_LOG_LEVEL_MESSAGE | G_LOG_LEVEL_INFO | G_LOG_LEVEL_DEBUG, log_handler, NULL);
@@ -3,6 +3,7 @@
 #include <locale.h>
 
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <gio/gio.h>
 
 #include <string.h>
@@ -11,8 +12,12 @@
 #endif /* HAVE_UNISTD_H */
 #include <stdlib.h>
 #include <time.h>
+#ifndef G_OS_WIN32
+#include <sys/stat.h>
+#endif /* !G_OS_WIN32 */
 
 #include "totem-pl-parser.h"
+#include "totem-pl-dir-watch.h"
 #include "totem-pl-parser-mini.h"
 #include "totem-pl-parser-private.h"
 
@@ -109,6 +114,102 @@ test_resolution (void)
 	g_assert_cmpstr (test_resolution_real ("/foobar/test/", "anim.png"), ==, "file:///foobar/test/anim.png");
 }
 
+/* The GFile-based resolution that totem_pl_parser_resolve_uri() used
+ * to do, kept to check the string-based resolver against */
+static char *
+test_resolution_gfile (const char *base_uri,
+		       const char *relative_uri)
+{
+	GFile *base_gfile, *base_parent_gfile, *resolved_gfile;
+	char *base_path, *content_type, *short_name, *query, *uri, *qmark;
+	gboolean is_dir;
+
+	base_gfile = g_file_new_for_commandline_arg (base_uri);
+
+	base_path = g_file_get_path (base_gfile);
+	if (base_path == NULL)
+		base_path = g_file_get_uri (base_gfile);
+	qmark = strrchr (base_path, '?');
+	short_name = qmark ? g_strndup (base_path, qmark - base_path) : g_strdup (base_path);
+	content_type = g_content_type_guess (short_name, NULL, 0, NULL);
+	is_dir = g_content_type_is_unknown (content_type) &&
+		!g_str_has_suffix (short_name, ".jsp") &&
+		!g_str_has_suffix (short_name, ".php") &&
+		!g_str_has_suffix (short_name, ".asp");
+	g_free (content_type);
+	g_free (short_name);
+	g_free (base_path);
+
+	base_parent_gfile = is_dir ? g_object_ref (base_gfile) : g_file_get_parent (base_gfile);
+	if (base_parent_gfile == NULL)
+		base_parent_gfile = g_object_ref (base_gfile);
+	g_object_unref (base_gfile);
+
+	query = NULL;
+	qmark = strrchr (relative_uri, '?');
+	if (qmark != NULL) {
+		char *path;
+
+		query = g_strdup (qmark);
+		path = g_strndup (relative_uri, qmark - relative_uri);
+		resolved_gfile = g_file_resolve_relative_path (base_parent_gfile, path);
+		g_free (path);
+	} else {
+		resolved_gfile = g_file_resolve_relative_path (base_parent_gfile, relative_uri);
+	}
+	g_object_unref (base_parent_gfile);
+
+	uri = g_file_get_uri (resolved_gfile);
+	g_object_unref (resolved_gfile);
+	if (query != NULL) {
+		char *tmp;
+
+		tmp = g_strconcat (uri, query, NULL);
+		g_free (uri);
+		g_free (query);
+		uri = tmp;
+	}
+
+	return uri;
+}
+
+static void
+test_resolution_differential (void)
+{
+	struct {
+		const char *base;
+		const char *relative;
+		gboolean needs_http;
+	} cases[] = {
+		{ "http://www.yle.fi/player/player.jsp", "288629.asx?s=1000", TRUE },
+		{ "http://www.yle.fi/player/player.jsp?actionpage=3&id=288629&locale", "288629.asx?s=1000", TRUE },
+		{ "http://localhost:12345/8.html", "anim.png", TRUE },
+		{ "http://foobar.com/", "/anim.png", TRUE },
+		{ "http://foobar.com/", "anim.png", TRUE },
+		{ "http://foobar.com", "anim.png", TRUE },
+		{ "/foobar/test/", "anim.png", FALSE },
+		{ "/foobar/test/playlist.xspf", "anim.png", FALSE },
+		{ "/foobar/test/playlist.xspf", "../anim.png", FALSE },
+		{ "/foobar/test/playlist.xspf", "./sub/anim.png", FALSE },
+		{ "/foobar/test/playlist.xspf", "/anim.png", FALSE },
+		{ "/foobar/test/playlist.xspf", "some file.ogg", FALSE },
+	};
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (cases); i++) {
+		char *expected, *ret;
+
+		if (cases[i].needs_http && http_supported == FALSE)
+			continue;
+
+		expected = test_resolution_gfile (cases[i].base, cases[i].relative);
+		ret = test_resolution_real (cases[i].base, cases[i].relative);
+		g_assert_cmpstr (ret, ==, expected);
+		g_free (expected);
+		g_free (ret);
+	}
+}
+
 static void
 test_duration (void)
 {
@@ -204,6 +305,35 @@ test_videosite (void)
 }
 #endif
 
+static void
+test_parsability_magic (void)
+{
+	guint i;
+	struct {
+		const char *data;
+		gssize len; /* -1 if nul-terminated */
+		gboolean parsable;
+	} const buffers[] = {
+		{ "#EXTM3U\n#EXTINF:10,Title\nfoo.ogg\n", -1, TRUE },
+		{ "#EXTM3U\n#EXT-X-TARGETDURATION:10\nfoo.ts\n", -1, FALSE },
+		{ "[playlist]\nFile1=foo.ogg\nNumberOfEntries=1\n", -1, TRUE },
+		{ "<ASX version=\"3.0\"><Entry><Ref href=\"foo.wmv\"/></Entry></ASX>", -1, TRUE },
+		{ "\xef\xbb\xbf<?xml version=\"1.0\"?>\n<!-- <feed> -->\n<rss version=\"2.0\"><channel/></rss>", -1, TRUE },
+		{ "<?xml version=\"1.0\"?><playlist version=\"1\" xmlns=\"http://xspf.org/ns/0/\"><trackList/></playlist>", -1, TRUE },
+		{ "<?xml version=\"1.0\"?><feed xmlns=\"http://www.w3.org/2005/Atom\"><title>t</title></feed>", -1, TRUE },
+		{ "OggS\0\2\0\0\0\0\0\0\0\0", 14, FALSE },
+	};
+
+	/* Playlists are recognised from their signatures, media still go through GIO */
+	for (i = 0; i < G_N_ELEMENTS (buffers); i++) {
+		gsize len;
+
+		g_test_message ("Testing data parsing of buffer %u", i);
+		len = buffers[i].len < 0 ? strlen (buffers[i].data) : (gsize) buffers[i].len;
+		g_assert_cmpint (totem_pl_parser_can_parse_from_data (buffers[i].data, len, option_debug), ==, buffers[i].parsable);
+	}
+}
+
 static void
 test_parsability (void)
 {
@@ -610,6 +740,12 @@ test_parsing_xspf_genre (void)
 	uri = get_relative_uri (TEST_SRCDIR "decrypted-amazon-track.xspf");
 	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_GENRE), ==, "Dance & DJ/House");
 	g_free (uri);
+
+	/* Split up text needs to come out the same as a single text node */
+	uri = get_relative_uri (TEST_SRCDIR "mixed-content.xspf");
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_GENRE), ==, "Drum & Bass");
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_CONTENT_TYPE), ==, "audio/ogg");
+	g_free (uri);
 }
 
 static void
@@ -621,6 +757,56 @@ test_parsing_xspf_escaping (void)
 	g_free (uri);
 }
 
+static void
+test_parsing_xspf_recovery (void)
+{
+	char *uri;
+
+	uri = get_relative_uri (TEST_SRCDIR "broken.xspf");
+	g_assert_cmpuint (parser_test_get_num_entries (uri), ==, 3);
+	g_assert_cmpstr (parser_test_get_playlist_field (uri, TOTEM_PL_PARSER_FIELD_TITLE), ==, "Broken Playlist");
+	g_free (uri);
+}
+
+static void
+test_saving_xspf (void)
+{
+	TotemPlParser *pl;
+	TotemPlPlaylist *playlist;
+	TotemPlPlaylistIter iter;
+	GFile *file;
+	GFileIOStream *iostream;
+	GError *error = NULL;
+	char *uri;
+
+	file = g_file_new_tmp ("parser-XXXXXX.xspf", &iostream, &error);
+	g_assert_no_error (error);
+	g_object_unref (iostream);
+
+	playlist = totem_pl_playlist_new ();
+	totem_pl_playlist_append (playlist, &iter);
+	totem_pl_playlist_set (playlist, &iter,
+			       TOTEM_PL_PARSER_FIELD_URI, "http://www.example.com/a&b.ogg",
+			       TOTEM_PL_PARSER_FIELD_TITLE, "<Rhythm & \"Blues\">",
+			       TOTEM_PL_PARSER_FIELD_GENRE, "R&B",
+			       NULL);
+
+	pl = totem_pl_parser_new ();
+	g_assert_true (totem_pl_parser_save (pl, playlist, file, NULL, TOTEM_PL_PARSER_XSPF, &error));
+	g_assert_no_error (error);
+	g_object_unref (pl);
+	g_object_unref (playlist);
+
+	uri = g_file_get_uri (file);
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_URI), ==, "http://www.example.com/a&b.ogg");
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_TITLE), ==, "<Rhythm & \"Blues\">");
+	g_assert_cmpstr (parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_GENRE), ==, "R&B");
+	g_free (uri);
+
+	g_file_delete (file, NULL, NULL);
+	g_object_unref (file);
+}
+
 static void
 test_parsing_xspf_xml_base (void)
 {
@@ -645,6 +831,23 @@ test_smi_starttime (void)
 	g_free (uri);
 }
 
+static void
+test_smil_timing (void)
+{
+	char *uri, *ret;
+
+	uri = get_relative_uri (TEST_SRCDIR "timing.smil");
+	/* Only one of the <switch> alternatives */
+	g_assert_cmpuint (parser_test_get_num_entries (uri), ==, 4);
+	ret = parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_OFFSET_MS);
+	g_assert_cmpstr (ret, ==, "3500");
+	g_free (ret);
+	ret = parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_DURATION_MS);
+	g_assert_cmpstr (ret, ==, "30000");
+	g_free (ret);
+	g_free (uri);
+}
+
 static void
 test_m3u_leading_tabs (void)
 {
@@ -672,6 +875,421 @@ test_directory_recurse (void)
 	g_free (uri);
 }
 
+static void
+entry_parsed_uris_cb (TotemPlParser *parser,
+		      const char *uri,
+		      GHashTable *metadata,
+		      GPtrArray *uris)
+{
+	g_ptr_array_add (uris, g_strdup (uri));
+}
+
+static void
+make_test_file (const char *dir, const char *name)
+{
+	char *path, *parent;
+
+	path = g_build_filename (dir, name, NULL);
+	parent = g_path_get_dirname (path);
+	g_assert_cmpint (g_mkdir_with_parents (parent, 0700), ==, 0);
+	g_assert_true (g_file_set_contents (path, "OggS\0\2\0\0", 8, NULL));
+	g_free (parent);
+	g_free (path);
+}
+
+static void
+remove_test_dir (const char *path)
+{
+	GDir *dir;
+	const char *name;
+
+	dir = g_dir_open (path, 0, NULL);
+	if (dir != NULL) {
+		while ((name = g_dir_read_name (dir)) != NULL) {
+			char *child;
+
+			child = g_build_filename (path, name, NULL);
+			if (g_file_test (child, G_FILE_TEST_IS_DIR))
+				remove_test_dir (child);
+			else
+				g_unlink (child);
+			g_free (child);
+		}
+		g_dir_close (dir);
+	}
+	g_rmdir (path);
+}
+
+static char *
+test_dir_uri (const char *dir, const char *name)
+{
+	char *path, *uri;
+
+	path = g_build_filename (dir, name, NULL);
+	uri = g_filename_to_uri (path, NULL, NULL);
+	g_free (path);
+
+	return uri;
+}
+
+static void
+test_directory_order (void)
+{
+	const char *files[] = { "b.ogg", "a10.ogg", "#x.ogg", "a2.ogg", "c/d.ogg" };
+	const char *expected[] = { "a2.ogg", "a10.ogg", "b.ogg", "c/d.ogg", "#x.ogg" };
+	TotemPlParser *pl;
+	GPtrArray *uris;
+	char *dir, *uri;
+	guint i;
+
+	dir = g_dir_make_tmp ("totem-pl-parser-XXXXXX", NULL);
+	g_assert_nonnull (dir);
+	for (i = 0; i < G_N_ELEMENTS (files); i++)
+		make_test_file (dir, files[i]);
+
+	pl = totem_pl_parser_new ();
+	g_object_set (pl, "recurse", TRUE,
+		      "debug", option_debug,
+		      NULL);
+	uris = g_ptr_array_new_with_free_func (g_free);
+	g_signal_connect (G_OBJECT (pl), "entry-parsed",
+			  G_CALLBACK (entry_parsed_uris_cb), uris);
+
+	uri = g_filename_to_uri (dir, NULL, NULL);
+	g_assert_cmpint (totem_pl_parser_parse (pl, uri, FALSE), ==, TOTEM_PL_PARSER_RESULT_SUCCESS);
+	g_free (uri);
+	g_object_unref (pl);
+
+	/* Sub-directories are sorted along with the files, and
+	 * names starting with '#' go last */
+	g_assert_cmpuint (uris->len, ==, G_N_ELEMENTS (expected));
+	for (i = 0; i < G_N_ELEMENTS (expected); i++) {
+		uri = test_dir_uri (dir, expected[i]);
+		g_assert_cmpstr (g_ptr_array_index (uris, i), ==, uri);
+		g_free (uri);
+	}
+	g_ptr_array_free (uris, TRUE);
+
+	remove_test_dir (dir);
+	g_free (dir);
+}
+
+static void
+test_directory_sniff_order (void)
+{
+	TotemPlParser *pl;
+	GPtrArray *uris;
+	char *dir, *uri;
+	guint i;
+
+	/* More files than get read ahead, all without an
+	 * extension, so that they need sniffing */
+	dir = g_dir_make_tmp ("totem-pl-parser-XXXXXX", NULL);
+	g_assert_nonnull (dir);
+	for (i = 0; i < 50; i++) {
+		char *name, *path;
+
+		name = g_strdup_printf ("f%02u", i);
+		if (i % 2 == 0) {
+			char *contents;
+
+			path = g_build_filename (dir, name, NULL);
+			contents = g_strdup_printf ("#EXTM3U\ne%02u.ogg\n", i);
+			g_assert_true (g_file_set_contents (path, contents, -1, NULL));
+			g_free (contents);
+			g_free (path);
+		} else {
+			make_test_file (dir, name);
+		}
+		g_free (name);
+	}
+
+	pl = totem_pl_parser_new ();
+	g_object_set (pl, "recurse", TRUE,
+		      "debug", option_debug,
+		      NULL);
+	uris = g_ptr_array_new_with_free_func (g_free);
+	g_signal_connect (G_OBJECT (pl), "entry-parsed",
+			  G_CALLBACK (entry_parsed_uris_cb), uris);
+
+	uri = g_filename_to_uri (dir, NULL, NULL);
+	g_assert_cmpint (totem_pl_parser_parse (pl, uri, FALSE), ==, TOTEM_PL_PARSER_RESULT_SUCCESS);
+	g_free (uri);
+	g_object_unref (pl);
+
+	/* Playlists get expanded, the others added as is, in order */
+	g_assert_cmpuint (uris->len, ==, 50);
+	for (i = 0; i < 50; i++) {
+		char *name;
+
+		if (i % 2 == 0)
+			name = g_strdup_printf ("e%02u.ogg", i);
+		else
+			name = g_strdup_printf ("f%02u", i);
+		uri = test_dir_uri (dir, name);
+		g_assert_cmpstr (g_ptr_array_index (uris, i), ==, uri);
+		g_free (uri);
+		g_free (name);
+	}
+	g_ptr_array_free (uris, TRUE);
+
+	remove_test_dir (dir);
+	g_free (dir);
+}
+
+static void
+test_pls_sniff_order (void)
+{
+	TotemPlParser *pl;
+	GPtrArray *uris;
+	GString *pls;
+	char *dir, *path, *uri;
+	guint i;
+
+	/* More relative entries than get read ahead, all without an
+	 * extension, numbered with gaps */
+	dir = g_dir_make_tmp ("totem-pl-parser-XXXXXX", NULL);
+	g_assert_nonnull (dir);
+	pls = g_string_new ("[playlist]\n");
+	for (i = 0; i < 40; i++) {
+		char *name;
+
+		name = g_strdup_printf ("f%02u", i);
+		if (i % 2 == 0) {
+			char *contents;
+
+			path = g_build_filename (dir, name, NULL);
+			contents = g_strdup_printf ("#EXTM3U\ne%02u.ogg\n", i);
+			g_assert_true (g_file_set_contents (path, contents, -1, NULL));
+			g_free (contents);
+			g_free (path);
+		} else {
+			make_test_file (dir, name);
+		}
+		g_string_append_printf (pls, "File%u=%s\n", 2 * i + 1, name);
+		g_free (name);
+	}
+	path = g_build_filename (dir, "list.pls", NULL);
+	g_assert_true (g_file_set_contents (path, pls->str, -1, NULL));
+	g_string_free (pls, TRUE);
+
+	pl = totem_pl_parser_new ();
+	g_object_set (pl, "recurse", TRUE,
+		      "debug", option_debug,
+		      NULL);
+	uris = g_ptr_array_new_with_free_func (g_free);
+	g_signal_connect (G_OBJECT (pl), "entry-parsed",
+			  G_CALLBACK (entry_parsed_uris_cb), uris);
+
+	uri = g_filename_to_uri (path, NULL, NULL);
+	g_assert_cmpint (totem_pl_parser_parse (pl, uri, FALSE), ==, TOTEM_PL_PARSER_RESULT_SUCCESS);
+	g_free (uri);
+	g_free (path);
+	g_object_unref (pl);
+
+	g_assert_cmpuint (uris->len, ==, 40);
+	for (i = 0; i < 40; i++) {
+		char *name;
+
+		if (i % 2 == 0)
+			name = g_strdup_printf ("e%02u.ogg", i);
+		else
+			name = g_strdup_printf ("f%02u", i);
+		uri = test_dir_uri (dir, name);
+		g_assert_cmpstr (g_ptr_array_index (uris, i), ==, uri);
+		g_free (uri);
+		g_free (name);
+	}
+	g_ptr_array_free (uris, TRUE);
+
+	remove_test_dir (dir);
+	g_free (dir);
+}
+
+static void
+test_parsing_fifo (void)
+{
+#ifndef G_OS_WIN32
+	char *dir, *path, *uri;
+
+	dir = g_dir_make_tmp ("totem-pl-parser-XXXXXX", NULL);
+	g_assert_nonnull (dir);
+	path = g_build_filename (dir, "fifo", NULL);
+	g_assert_cmpint (mkfifo (path, 0600), ==, 0);
+
+	/* Nothing to sniff, and nobody writing to it */
+	uri = g_filename_to_uri (path, NULL, NULL);
+	g_assert_cmpint (simple_parser_test (uri), ==, TOTEM_PL_PARSER_RESULT_UNHANDLED);
+	g_free (uri);
+	g_free (path);
+
+	remove_test_dir (dir);
+	g_free (dir);
+#endif /* !G_OS_WIN32 */
+}
+
+typedef struct {
+	/* The playlist, as rebuilt from the signals */
+	GList *uris;
+	guint num_renamed;
+} DirWatchData;
+
+static void
+dir_watch_added_cb (TotemPlDirWatch *watch,
+		    guint position,
+		    const char *uri,
+		    GHashTable *metadata,
+		    DirWatchData *data)
+{
+	g_assert_cmpuint (position, <=, g_list_length (data->uris));
+	data->uris = g_list_insert (data->uris, g_strdup (uri), position);
+}
+
+static void
+dir_watch_removed_cb (TotemPlDirWatch *watch,
+		      guint position,
+		      const char *uri,
+		      DirWatchData *data)
+{
+	GList *l;
+
+	l = g_list_nth (data->uris, position);
+	g_assert_nonnull (l);
+	g_assert_cmpstr (l->data, ==, uri);
+	g_free (l->data);
+	data->uris = g_list_delete_link (data->uris, l);
+}
+
+static void
+dir_watch_renamed_cb (TotemPlDirWatch *watch,
+		      guint old_position,
+		      guint new_position,
+		      const char *old_uri,
+		      const char *new_uri,
+		      DirWatchData *data)
+{
+	dir_watch_removed_cb (watch, old_position, old_uri, data);
+	dir_watch_added_cb (watch, new_position, new_uri, NULL, data);
+	data->num_renamed++;
+}
+
+static gboolean
+dir_watch_matches (DirWatchData *data, const char *dir, const char **expected, guint num_expected)
+{
+	GList *l;
+	guint i;
+
+	if (g_list_length (data->uris) != num_expected)
+		return FALSE;
+
+	for (i = 0, l = data->uris; i < num_expected; i++, l = l->next) {
+		char *uri;
+		gboolean equal;
+
+		uri = test_dir_uri (dir, expected[i]);
+		equal = g_str_equal (uri, l->data);
+		g_free (uri);
+		if (equal == FALSE)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+dir_watch_timeout_cb (gpointer user_data)
+{
+	gboolean *timed_out = user_data;
+
+	*timed_out = TRUE;
+	return G_SOURCE_REMOVE;
+}
+
+static void
+dir_watch_wait (DirWatchData *data, const char *dir, const char **expected, guint num_expected)
+{
+	gboolean timed_out = FALSE;
+	guint id;
+
+	id = g_timeout_add_seconds (10, dir_watch_timeout_cb, &timed_out);
+	while (dir_watch_matches (data, dir, expected, num_expected) == FALSE &&
+	       timed_out == FALSE)
+		g_main_context_iteration (NULL, TRUE);
+	g_assert_false (timed_out);
+	g_source_remove (id);
+}
+
+static void
+test_directory_watch (void)
+{
+	const char *files[] = { "b.ogg", "a.ogg", "cover.png", "sub/c.ogg" };
+	const char *expected_start[] = { "a.ogg", "b.ogg", "sub/c.ogg" };
+	const char *expected_created[] = { "a.ogg", "a1.ogg", "b.ogg", "sub/c.ogg", "sub/d.ogg" };
+	const char *expected_renamed[] = { "0.ogg", "a.ogg", "a1.ogg", "sub/c.ogg", "sub/d.ogg" };
+	const char *expected_deleted[] = { "0.ogg", "a1.ogg", "sub/d.ogg" };
+	TotemPlParser *pl;
+	TotemPlDirWatch *watch;
+	DirWatchData data;
+	GFile *file;
+	char *dir, *from, *to;
+	guint i;
+
+	dir = g_dir_make_tmp ("totem-pl-parser-XXXXXX", NULL);
+	g_assert_nonnull (dir);
+	for (i = 0; i < G_N_ELEMENTS (files); i++)
+		make_test_file (dir, files[i]);
+
+	pl = totem_pl_parser_new ();
+	g_object_set (pl, "recurse", TRUE,
+		      "debug", option_debug,
+		      NULL);
+	file = g_file_new_for_path (dir);
+	watch = totem_pl_dir_watch_new (pl, file);
+	g_object_unref (file);
+
+	data.uris = NULL;
+	data.num_renamed = 0;
+	g_signal_connect (G_OBJECT (watch), "entry-added",
+			  G_CALLBACK (dir_watch_added_cb), &data);
+	g_signal_connect (G_OBJECT (watch), "entry-removed",
+			  G_CALLBACK (dir_watch_removed_cb), &data);
+	g_signal_connect (G_OBJECT (watch), "entry-renamed",
+			  G_CALLBACK (dir_watch_renamed_cb), &data);
+
+	/* Same entries, in the same order, as a full parse */
+	g_assert_true (totem_pl_dir_watch_start (watch, NULL, NULL));
+	g_assert_true (dir_watch_matches (&data, dir, expected_start, G_N_ELEMENTS (expected_start)));
+	g_assert_cmpuint (totem_pl_dir_watch_get_n_entries (watch), ==, G_N_ELEMENTS (expected_start));
+
+	make_test_file (dir, "a1.ogg");
+	make_test_file (dir, "sub/d.ogg");
+	dir_watch_wait (&data, dir, expected_created, G_N_ELEMENTS (expected_created));
+
+	from = g_build_filename (dir, "b.ogg", NULL);
+	to = g_build_filename (dir, "0.ogg", NULL);
+	g_assert_cmpint (g_rename (from, to), ==, 0);
+	g_free (from);
+	g_free (to);
+	dir_watch_wait (&data, dir, expected_renamed, G_N_ELEMENTS (expected_renamed));
+	g_assert_cmpuint (data.num_renamed, ==, 1);
+
+	from = g_build_filename (dir, "a.ogg", NULL);
+	g_unlink (from);
+	g_free (from);
+	from = g_build_filename (dir, "sub/c.ogg", NULL);
+	g_unlink (from);
+	g_free (from);
+	dir_watch_wait (&data, dir, expected_deleted, G_N_ELEMENTS (expected_deleted));
+	g_assert_cmpuint (totem_pl_dir_watch_get_n_entries (watch), ==, G_N_ELEMENTS (expected_deleted));
+
+	g_object_unref (watch);
+	g_object_unref (pl);
+	g_list_free_full (data.uris, g_free);
+
+	remove_test_dir (dir);
+	g_free (dir);
+}
+
 static void
 test_empty_asx (void)
 {
@@ -858,6 +1476,33 @@ test_parsing_3gpp_not_ignored (void)
 	g_free (uri);
 }
 
+static void
+test_parsing_quicktime_reference_movie (void)
+{
+	char *uri, *ret, *file_uri;
+
+	uri = get_relative_uri (TEST_SRCDIR "reference-movie.mov");
+	file_uri = get_relative_uri (TEST_SRCDIR "movie_high.mov");
+	g_assert_cmpuint (parser_test_get_num_entries (uri), ==, 2);
+	ret = parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_URI);
+	g_assert_cmpstr (ret, ==, file_uri);
+	g_free (ret);
+	g_free (file_uri);
+	g_free (uri);
+}
+
+static void
+test_parsing_iso (void)
+{
+	char *uri, *ret;
+
+	uri = get_relative_uri (TEST_SRCDIR "video-dvd.iso");
+	ret = parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_TITLE);
+	g_assert_cmpstr (ret, ==, "TEST_DVD");
+	g_free (ret);
+	g_free (uri);
+}
+
 static void
 test_parsing_ts_not_ignored (void)
 {
@@ -965,6 +1610,25 @@ test_parsing_not_asx_playlist (void)
 	g_free (uri);
 }
 
+static void
+test_parsing_asf_reference (void)
+{
+	char *uri, *ret;
+
+	uri = get_relative_uri (TEST_SRCDIR "asf-reference.asf");
+	ret = parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_URI);
+	g_assert_cmpstr (ret, ==, "mmsh://media.example.com/live/stream.wmv?MSWMExt=.asf");
+	g_free (ret);
+	g_free (uri);
+
+	/* No Ref1, so it's parsed as ASX instead */
+	uri = get_relative_uri (TEST_SRCDIR "asx-in-asf.asf");
+	ret = parser_test_get_entry_field (uri, TOTEM_PL_PARSER_FIELD_URI);
+	g_assert_cmpstr (ret, ==, "http://media.example.com/live/stream.wma");
+	g_free (ret);
+	g_free (uri);
+}
+
 static void
 test_parsing_wma_asf (void)
 {
@@ -1066,6 +1730,72 @@ test_async_parsing_signal_order (void)
 	g_main_loop_unref (data.mainloop);
 }
 
+static void
+stats_collected_cb (TotemPlParser *parser, TotemPlParserStats *stats, TotemPlParserStats **ret)
+{
+	g_assert_null (*ret);
+	*ret = totem_pl_parser_stats_copy (stats);
+}
+
+static void
+test_parsing_stats (void)
+{
+	TotemPlParser *pl;
+	TotemPlParserStats *stats = NULL;
+	char *uri;
+
+	pl = totem_pl_parser_new ();
+	g_object_set (pl, "collect-stats", TRUE,
+		      "debug", option_debug,
+		      NULL);
+	g_signal_connect (G_OBJECT (pl), "stats-collected",
+			  G_CALLBACK (stats_collected_cb), &stats);
+
+	uri = get_relative_uri (TEST_SRCDIR "relative.m3u");
+	g_assert_cmpint (totem_pl_parser_parse (pl, uri, FALSE), ==, TOTEM_PL_PARSER_RESULT_SUCCESS);
+	g_free (uri);
+	g_object_unref (pl);
+
+	g_assert_nonnull (stats);
+	g_assert_cmpuint (GPOINTER_TO_UINT (g_hash_table_lookup (stats->entries_emitted, "audio/x-mpegurl")), ==, 1);
+	g_assert_cmpuint (stats->num_reads, >=, 1);
+	g_assert_cmpuint (stats->bytes_read, >=, strlen ("3gpp-file.mp4"));
+	g_assert_cmpuint (stats->num_helper_spawns, ==, 0);
+	/* Relative entries don't get recursed into */
+	g_assert_cmpuint (stats->max_recurse_level, ==, 1);
+	g_assert_cmpuint (g_hash_table_size (stats->entries_ignored), ==, 0);
+	/* All the time is accounted to one of the phases */
+	g_assert_cmpint (stats->total_time, ==, stats->sniff_time + stats->load_time +
+			 stats->parse_time + stats->emit_time);
+	totem_pl_parser_stats_free (stats);
+}
+
+static void
+test_parsing_stats_quicktime (void)
+{
+	TotemPlParser *pl;
+	TotemPlParserStats *stats = NULL;
+	char *uri;
+
+	pl = totem_pl_parser_new ();
+	g_object_set (pl, "collect-stats", TRUE,
+		      "debug", option_debug,
+		      NULL);
+	g_signal_connect (G_OBJECT (pl), "stats-collected",
+			  G_CALLBACK (stats_collected_cb), &stats);
+
+	uri = get_relative_uri (TEST_SRCDIR "reference-movie.mov");
+	g_assert_cmpint (totem_pl_parser_parse (pl, uri, FALSE), ==, TOTEM_PL_PARSER_RESULT_SUCCESS);
+	g_free (uri);
+	g_object_unref (pl);
+
+	/* The whole reference movie fits in the sniffed data,
+	 * so it shouldn't be opened a second time */
+	g_assert_nonnull (stats);
+	g_assert_cmpuint (stats->num_reads, ==, 1);
+	totem_pl_parser_stats_free (stats);
+}
+
 #define MAX_DESCRIPTION_LEN 128
 #define DATE_BUFSIZE 512
 #define PRINT_DATE_FORMAT "%Y-%m-%dT%H:%M:%SZ"
@@ -1286,7 +2016,9 @@ main (int argc, char *argv[])
 		g_test_add_func ("/parser/date", test_date);
 		g_test_add_func ("/parser/relative", test_relative);
 		g_test_add_func ("/parser/resolution", test_resolution);
+		g_test_add_func ("/parser/resolution_differential", test_resolution_differential);
 		g_test_add_func ("/parser/parsability", test_parsability);
+		g_test_add_func ("/parser/parsability_magic", test_parsability_magic);
 		g_test_add_func ("/parser/image_link", test_image_link);
 		g_test_add_func ("/parser/m3u_relative", test_m3u_relative);
 		g_test_add_func ("/parser/m3u_audio_track", test_m3u_audio_track);
@@ -1299,6 +2031,8 @@ main (int argc, char *argv[])
 		/* Disabled, as the host is unavailable most of the time
 		 * g_test_add_func ("/parser/parsing/404_error", test_parsing_404_error); */
 		g_test_add_func ("/parser/parsing/3gpp_not_ignored", test_parsing_3gpp_not_ignored);
+		g_test_add_func ("/parser/parsing/quicktime_reference_movie", test_parsing_quicktime_reference_movie);
+		g_test_add_func ("/parser/parsing/iso", test_parsing_iso);
 		g_test_add_func ("/parser/parsing/parsing_ts_not_ignored", test_parsing_ts_not_ignored);
 		g_test_add_func ("/parser/parsing/mp4_is_flv", test_parsing_mp4_is_flv);
 		g_test_add_func ("/parser/parsing/out_of_order_asx", test_parsing_out_of_order_asx);
@@ -1318,22 +2052,33 @@ main (int argc, char *argv[])
 		g_test_add_func ("/parser/parsing/rss_link", test_parsing_rss_link);
 #endif /* HAVE_QUVI */
 		g_test_add_func ("/parser/parsing/not_asx_playlist", test_parsing_not_asx_playlist);
+		g_test_add_func ("/parser/parsing/asf_reference", test_parsing_asf_reference);
 		g_test_add_func ("/parser/parsing/not_really_php", test_parsing_not_really_php);
 		g_test_add_func ("/parser/parsing/not_really_php_but_html_instead", test_parsing_not_really_php_but_html_instead);
 		g_test_add_func ("/parser/parsing/num_items_in_pls", test_parsing_num_entries);
 		g_test_add_func ("/parser/parsing/xspf_genre", test_parsing_xspf_genre);
 		g_test_add_func ("/parser/parsing/xspf_escaping", test_parsing_xspf_escaping);
 		g_test_add_func ("/parser/parsing/xspf_xml_base", test_parsing_xspf_xml_base);
+		g_test_add_func ("/parser/parsing/xspf_recovery", test_parsing_xspf_recovery);
+		g_test_add_func ("/parser/saving/xspf", test_saving_xspf);
 		g_test_add_func ("/parser/parsing/test_pl_content_type", test_pl_content_type);
 		g_test_add_func ("/parser/parsing/itms_link", test_itms_parsing);
 		g_test_add_func ("/parser/parsing/lastfm-attributes", test_lastfm_parsing);
 		g_test_add_func ("/parser/parsing/m3u_separator", test_m3u_separator);
 		g_test_add_func ("/parser/parsing/smi_starttime", test_smi_starttime);
+		g_test_add_func ("/parser/parsing/smil_timing", test_smil_timing);
 		g_test_add_func ("/parser/parsing/m3u_leading_tabs", test_m3u_leading_tabs);
 		g_test_add_func ("/parser/parsing/empty-asx.asx", test_empty_asx);
 		g_test_add_func ("/parser/parsing/emptyplaylist.pls", test_empty_pls);
 		g_test_add_func ("/parser/parsing/dir_recurse", test_directory_recurse);
+		g_test_add_func ("/parser/parsing/dir_order", test_directory_order);
+		g_test_add_func ("/parser/parsing/dir_sniff_order", test_directory_sniff_order);
+		g_test_add_func ("/parser/parsing/pls_sniff_order", test_pls_sniff_order);
+		g_test_add_func ("/parser/parsing/dir_watch", test_directory_watch);
+		g_test_add_func ("/parser/parsing/fifo", test_parsing_fifo);
 		g_test_add_func ("/parser/parsing/async_signal_order", test_async_parsing_signal_order);
+		g_test_add_func ("/parser/parsing/stats", test_parsing_stats);
+		g_test_add_func ("/parser/parsing/stats_quicktime", test_parsing_stats_quicktime);
 		g_test_add_func ("/parser/parsing/wma_asf", test_parsing_wma_asf);
 
 		return g_test_run ();
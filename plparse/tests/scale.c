@@ -0,0 +1,411 @@
+#include "config.h"
+
+#include <locale.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "totem-pl-parser.h"
+
+/* End-to-end scalability check: a big generated playlist is parsed into
+ * a TotemPlPlaylist through the "entry-parsed" signal, saved in every
+ * TotemPlParserType, and each of those is parsed again. Each stage must
+ * cost about as much per entry at every size, so that anything walking
+ * lists from the start (as appending to, or iterating over, a playlist
+ * used to) shows up, and the peak memory use must stay under a ceiling
+ * per entry.
+ *
+ * Both depend on the machine and on its load, so "meson test" only runs
+ * it with a ratio that a quadratic cost would exceed and without the
+ * memory ceiling, while "meson test --benchmark" runs it as is. */
+
+static char *option_sizes = NULL;
+static int option_runs = 3;
+static double option_max_ratio = 2.0;
+static int option_max_rss = 8192;
+static gboolean option_debug = FALSE;
+
+static const struct {
+	TotemPlParserType type;
+	const char *name;
+	const char *extension;
+} save_types[] = {
+	{ TOTEM_PL_PARSER_PLS, "pls", "pls" },
+	{ TOTEM_PL_PARSER_M3U, "m3u", "m3u" },
+	{ TOTEM_PL_PARSER_M3U_DOS, "m3u-dos", "m3u" },
+	{ TOTEM_PL_PARSER_XSPF, "xspf", "xspf" },
+	{ TOTEM_PL_PARSER_IRIVER_PLA, "pla", "pla" },
+};
+
+/* "parse" and "walk", then "save" and "reparse" for each of the save_types */
+#define NUM_STAGES (2 + 2 * G_N_ELEMENTS (save_types))
+
+typedef struct {
+	guint num_entries;
+	gint64 durations[NUM_STAGES]; /* in microseconds, the best of all runs */
+	gint64 rss_growth; /* in kilobytes, the worst of all runs, or -1 */
+	gboolean failed;
+} ScaleResult;
+
+static char *
+scale_stage_name (guint stage)
+{
+	if (stage == 0)
+		return g_strdup ("parse");
+	if (stage == 1)
+		return g_strdup ("walk");
+	return g_strdup_printf ("%s %s",
+				stage % 2 ? "reparse" : "save",
+				save_types[(stage - 2) / 2].name);
+}
+
+static void
+scale_write_playlist (guint num_entries, const char *dir, const char *path)
+{
+	FILE *out;
+	guint i;
+
+	out = g_fopen (path, "wb");
+	if (out == NULL)
+		g_error ("Couldn't create '%s': %s", path, g_strerror (errno));
+
+	fputs ("#EXTM3U\n", out);
+	for (i = 0; i < num_entries; i++) {
+		fprintf (out, "#EXTINF:%u,Track %u\n", 60 + i % 600, i);
+		fprintf (out, "%s/track-%08u.mp3\n", dir, i);
+	}
+
+	if (fclose (out) != 0)
+		g_error ("Couldn't write '%s': %s", path, g_strerror (errno));
+}
+
+/* Resets the peak resident set size, where the kernel allows it */
+static void
+scale_reset_max_rss (void)
+{
+#ifdef G_OS_UNIX
+	FILE *clear_refs;
+
+	clear_refs = g_fopen ("/proc/self/clear_refs", "w");
+	if (clear_refs != NULL) {
+		fputs ("5", clear_refs);
+		fclose (clear_refs);
+	}
+#endif /* G_OS_UNIX */
+}
+
+/* Reads @field, such as "VmRSS:", in kilobytes, or returns -1 */
+static gint64
+scale_get_rss (const char *field)
+{
+	char *status, *value;
+	gint64 ret = -1;
+
+	if (g_file_get_contents ("/proc/self/status", &status, NULL, NULL) != FALSE) {
+		value = strstr (status, field);
+		if (value != NULL)
+			ret = g_ascii_strtoll (value + strlen (field), NULL, 10);
+		g_free (status);
+	}
+
+	return ret;
+}
+
+static void
+append_entry_cb (TotemPlParser *parser,
+		 const char *uri,
+		 GHashTable *metadata,
+		 TotemPlPlaylist *playlist)
+{
+	TotemPlPlaylistIter iter;
+
+	totem_pl_playlist_append (playlist, &iter);
+	totem_pl_playlist_set (playlist, &iter,
+			       TOTEM_PL_PARSER_FIELD_URI, uri,
+			       TOTEM_PL_PARSER_FIELD_TITLE, g_hash_table_lookup (metadata, TOTEM_PL_PARSER_FIELD_TITLE),
+			       NULL);
+}
+
+static void
+count_entry_cb (TotemPlParser *parser,
+		const char *uri,
+		GHashTable *metadata,
+		guint *num_parsed)
+{
+	(*num_parsed)++;
+}
+
+static TotemPlParser *
+scale_parser_new (void)
+{
+	TotemPlParser *parser;
+
+	parser = totem_pl_parser_new ();
+	g_object_set (parser, "debug", option_debug, NULL);
+
+	return parser;
+}
+
+/* Walks the playlist the way applications do, checking that all
+ * the entries are there, in order */
+static gboolean
+scale_check_entries (TotemPlPlaylist *playlist, guint num_entries, const char *dir)
+{
+	TotemPlPlaylistIter iter;
+	gboolean valid, ret;
+	guint i;
+
+	ret = TRUE;
+	valid = totem_pl_playlist_iter_first (playlist, &iter);
+	for (i = 0; valid && ret; i++) {
+		char *uri, *expected_path, *expected;
+
+		totem_pl_playlist_get (playlist, &iter,
+				       TOTEM_PL_PARSER_FIELD_URI, &uri,
+				       NULL);
+
+		expected_path = g_strdup_printf ("%s/track-%08u.mp3", dir, i);
+		expected = g_filename_to_uri (expected_path, NULL, NULL);
+		if (g_strcmp0 (uri, expected) != 0) {
+			g_print ("Entry %u is '%s', expected '%s'\n", i, uri, expected);
+			ret = FALSE;
+		}
+
+		g_free (uri);
+		g_free (expected);
+		g_free (expected_path);
+
+		valid = totem_pl_playlist_iter_next (playlist, &iter);
+	}
+
+	return ret && i == num_entries;
+}
+
+static void
+scale_run (guint num_entries, const char *dir, ScaleResult *result)
+{
+	TotemPlParser *parser;
+	TotemPlPlaylist *playlist;
+	TotemPlParserResult res;
+	char *path, *uri;
+	gint64 start, rss_start, rss_peak, durations[NUM_STAGES];
+	guint i;
+
+	path = g_strdup_printf ("%s/scale-%u.m3u", dir, num_entries);
+	uri = g_filename_to_uri (path, NULL, NULL);
+	scale_write_playlist (num_entries, dir, path);
+
+	scale_reset_max_rss ();
+	rss_start = scale_get_rss ("VmRSS:");
+
+	/* parse into a playlist */
+	playlist = totem_pl_playlist_new ();
+	parser = scale_parser_new ();
+	g_signal_connect (parser, "entry-parsed",
+			  G_CALLBACK (append_entry_cb), playlist);
+
+	start = g_get_monotonic_time ();
+	res = totem_pl_parser_parse (parser, uri, FALSE);
+	durations[0] = g_get_monotonic_time () - start;
+	g_object_unref (parser);
+
+	start = g_get_monotonic_time ();
+	if (res != TOTEM_PL_PARSER_RESULT_SUCCESS ||
+	    totem_pl_playlist_size (playlist) != num_entries ||
+	    scale_check_entries (playlist, num_entries, dir) == FALSE) {
+		g_print ("Parsing %u entries failed, got %u\n", num_entries, totem_pl_playlist_size (playlist));
+		result->failed = TRUE;
+	}
+	durations[1] = g_get_monotonic_time () - start;
+
+	/* save in every format, and parse again */
+	for (i = 0; i < G_N_ELEMENTS (save_types) && result->failed == FALSE; i++) {
+		GError *error = NULL;
+		GFile *file;
+		char *saved_path, *saved_uri;
+		guint num_parsed;
+		gboolean saved;
+
+		saved_path = g_strdup_printf ("%s/scale-%u-saved.%s", dir, num_entries, save_types[i].extension);
+		saved_uri = g_filename_to_uri (saved_path, NULL, NULL);
+		file = g_file_new_for_path (saved_path);
+
+		parser = scale_parser_new ();
+		start = g_get_monotonic_time ();
+		saved = totem_pl_parser_save (parser, playlist, file, "Scale", save_types[i].type, &error);
+		durations[2 + 2 * i] = g_get_monotonic_time () - start;
+		g_object_unref (parser);
+
+		if (saved == FALSE) {
+			g_print ("Saving %u entries as %s failed: %s\n", num_entries, save_types[i].name, error->message);
+			g_error_free (error);
+			result->failed = TRUE;
+		} else {
+			num_parsed = 0;
+			parser = scale_parser_new ();
+			g_signal_connect (parser, "entry-parsed",
+					  G_CALLBACK (count_entry_cb), &num_parsed);
+			start = g_get_monotonic_time ();
+			res = totem_pl_parser_parse (parser, saved_uri, FALSE);
+			durations[3 + 2 * i] = g_get_monotonic_time () - start;
+			g_object_unref (parser);
+
+			if (res != TOTEM_PL_PARSER_RESULT_SUCCESS || num_parsed != num_entries) {
+				g_print ("Reparsing %u entries saved as %s failed, got %u\n",
+					 num_entries, save_types[i].name, num_parsed);
+				result->failed = TRUE;
+			}
+		}
+
+		g_object_unref (file);
+		g_unlink (saved_path);
+		g_free (saved_path);
+		g_free (saved_uri);
+	}
+
+	rss_peak = scale_get_rss ("VmHWM:");
+	g_object_unref (playlist);
+
+	result->num_entries = num_entries;
+	if (rss_start >= 0 && rss_peak >= 0)
+		result->rss_growth = MAX (result->rss_growth, rss_peak - rss_start);
+	for (i = 0; i < NUM_STAGES && result->failed == FALSE; i++) {
+		if (result->durations[i] < 0 || durations[i] < result->durations[i])
+			result->durations[i] = durations[i];
+	}
+
+	g_unlink (path);
+	g_free (path);
+	g_free (uri);
+}
+
+static double
+scale_cost_per_entry (const ScaleResult *result, guint stage)
+{
+	return (double) result->durations[stage] / result->num_entries;
+}
+
+int
+main (int argc, char *argv[])
+{
+	GError *error = NULL;
+	GOptionContext *context;
+	ScaleResult *results, *first, *last;
+	char **sizes;
+	char *dir;
+	guint num_sizes, i, j;
+	gboolean failed = FALSE;
+	const GOptionEntry entries[] = {
+		{ "sizes", 's', 0, G_OPTION_ARG_STRING, &option_sizes, "Comma-separated increasing numbers of entries (default: 20000,80000)", "SIZES" },
+		{ "runs", 'r', 0, G_OPTION_ARG_INT, &option_runs, "Runs for each size, the fastest counts (default: 3)", "RUNS" },
+		{ "max-ratio", 'm', 0, G_OPTION_ARG_DOUBLE, &option_max_ratio, "Highest allowed growth of the cost per entry, from the smallest size to the biggest (default: 2.0)", "RATIO" },
+		{ "max-rss", 'x', 0, G_OPTION_ARG_INT, &option_max_rss, "Highest allowed peak memory use per entry, in bytes, or 0 to only print it (default: 8192)", "BYTES" },
+		{ "debug", 'd', 0, G_OPTION_ARG_NONE, &option_debug, "Enable debug", NULL },
+		{ NULL }
+	};
+
+	setlocale (LC_ALL, "");
+
+	context = g_option_context_new ("- check that playlist handling scales linearly");
+	g_option_context_add_main_entries (context, entries, GETTEXT_PACKAGE);
+	if (g_option_context_parse (context, &argc, &argv, &error) == FALSE) {
+		g_print ("Option parsing failed: %s\n", error->message);
+		return 1;
+	}
+	g_option_context_free (context);
+
+	sizes = g_strsplit (option_sizes ? option_sizes : "20000,80000", ",", -1);
+	num_sizes = g_strv_length (sizes);
+	if (num_sizes == 0 || option_runs < 1) {
+		g_print ("Nothing to run\n");
+		return 1;
+	}
+
+	dir = g_dir_make_tmp ("totem-pl-parser-scale-XXXXXX", &error);
+	if (dir == NULL) {
+		g_print ("Couldn't create the temporary directory: %s\n", error->message);
+		return 1;
+	}
+
+	results = g_new0 (ScaleResult, num_sizes);
+	for (i = 0; i < num_sizes; i++) {
+		guint num_entries;
+		int run;
+
+		num_entries = g_ascii_strtoull (sizes[i], NULL, 10);
+		if (num_entries == 0 || (i > 0 && num_entries <= results[i - 1].num_entries)) {
+			g_print ("Sizes must be increasing, and not 0\n");
+			return 1;
+		}
+
+		results[i].rss_growth = -1;
+		for (j = 0; j < NUM_STAGES; j++)
+			results[i].durations[j] = -1;
+		for (run = 0; run < option_runs && results[i].failed == FALSE; run++)
+			scale_run (num_entries, dir, &results[i]);
+		failed |= results[i].failed;
+	}
+
+	if (failed == FALSE) {
+		first = &results[0];
+		last = &results[num_sizes - 1];
+
+		/* cost of each stage, per entry, at each size */
+		g_print ("%-14s", "stage");
+		for (i = 0; i < num_sizes; i++)
+			g_print (" %8u e", results[i].num_entries);
+		g_print (" %7s  %s\n", "ratio", "result");
+
+		for (j = 0; j < NUM_STAGES; j++) {
+			char *name;
+			double ratio;
+
+			name = scale_stage_name (j);
+			g_print ("%-14s", name);
+			for (i = 0; i < num_sizes; i++)
+				g_print (" %7.2f us", scale_cost_per_entry (&results[i], j));
+
+			ratio = scale_cost_per_entry (last, j) / MAX (scale_cost_per_entry (first, j), 0.001);
+			g_print (" %7.2f  %s\n", ratio,
+				 num_sizes > 1 && ratio > option_max_ratio ? "SUPER-LINEAR" : "ok");
+			if (num_sizes > 1 && ratio > option_max_ratio)
+				failed = TRUE;
+			g_free (name);
+		}
+
+		/* peak memory use, per entry */
+		g_print ("%-14s", "peak memory");
+		for (i = 0; i < num_sizes; i++) {
+			if (results[i].rss_growth < 0)
+				g_print (" %10s", "n/a");
+			else
+				g_print (" %7" G_GINT64_FORMAT " B", results[i].rss_growth * 1024 / results[i].num_entries);
+		}
+		g_print (" %7s  ", "");
+		for (i = 0; i < num_sizes && option_max_rss > 0; i++) {
+			if (results[i].rss_growth * 1024 > (gint64) option_max_rss * results[i].num_entries)
+				break;
+		}
+		if (option_max_rss <= 0) {
+			g_print ("not checked\n");
+		} else if (i < num_sizes) {
+			g_print ("OVER %d B\n", option_max_rss);
+			failed = TRUE;
+		} else {
+			g_print ("ok\n");
+		}
+	}
+
+	g_rmdir (dir);
+	g_free (dir);
+	g_free (results);
+	g_strfreev (sizes);
+
+	return failed ? 1 : 0;
+}
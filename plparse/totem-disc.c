@@ -51,29 +51,39 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <sys/stat.h>
 
 #include <glib.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <gio/gio.h>
 
-#ifdef HAVE_LIBARCHIVE
-#include <archive.h>
-#include <archive_entry.h>
-#endif /* HAVE_ARCHIVE */
-
 #include "totem-disc.h"
 #include "totem-pl-parser.h"
+#include "totem-pl-parser-private.h"
+
+/* The content types we know about, classified once
+ * when the cache is created */
+typedef enum {
+  CD_CONTENT_CDDA    = 1 << 0,
+  CD_CONTENT_VCD     = 1 << 1,
+  CD_CONTENT_SVCD    = 1 << 2,
+  CD_CONTENT_DVD     = 1 << 3,
+  CD_CONTENT_BLURAY  = 1 << 4
+} CdContentFlags;
 
 typedef struct _CdCache {
   /* device node and mountpoint */
   char *device, *mountpoint;
   GVolume *volume;
 
-  char **content_types;
+  CdContentFlags content;
 
   GFile *iso_file;
+  /* volume label of a local ISO file */
+  char *label;
 
   /* Whether we have a medium */
   guint has_medium : 1;
@@ -89,6 +99,11 @@ typedef struct _CdCache {
   guint is_iso : 1;
 } CdCache;
 
+typedef struct _CdVolumeSnapshot CdVolumeSnapshot;
+
+/* Default number of images probed at once by totem_cd_detect_types() */
+#define CD_DETECT_MAX_JOBS 8
+
 typedef struct _CdCacheCallbackData {
   CdCache *cache;
   gboolean called;
@@ -181,141 +196,750 @@ cd_cache_get_best_mount_for_drive (GDrive *drive,
   return rank > 0;
 }
 
-static gboolean
-cd_cache_get_dev_from_volumes (GVolumeMonitor *mon, const char *device,
-			      char **mountpoint, GVolume **volume)
+/* The device nodes of the drives and volumes GIO knows about,
+ * resolved once so that looking up many devices is cheap */
+typedef struct {
+  char *device;
+  GDrive *drive;
+  GVolume *volume;
+} CdVolumeEntry;
+
+struct _CdVolumeSnapshot {
+  /* drives first, then volumes */
+  GPtrArray *entries;
+};
+
+static void
+cd_volume_entry_free (CdVolumeEntry *entry)
+{
+  g_free (entry->device);
+  g_clear_object (&entry->drive);
+  g_clear_object (&entry->volume);
+  g_free (entry);
+}
+
+static void
+cd_volume_snapshot_add (CdVolumeSnapshot *snapshot,
+			char             *ddev,
+			GDrive           *drive,
+			GVolume          *volume)
 {
+  CdVolumeEntry *entry;
+  char *resolved;
+
+  if (ddev == NULL)
+    return;
+  resolved = totem_resolve_symlink (ddev, NULL);
+  g_free (ddev);
+  if (resolved == NULL)
+    return;
+
+  entry = g_new0 (CdVolumeEntry, 1);
+  entry->device = resolved;
+  entry->drive = drive ? g_object_ref (drive) : NULL;
+  entry->volume = volume ? g_object_ref (volume) : NULL;
+  g_ptr_array_add (snapshot->entries, entry);
+}
+
+static CdVolumeSnapshot *
+cd_volume_snapshot_new (void)
+{
+  CdVolumeSnapshot *snapshot;
+  GVolumeMonitor *mon;
   GList *list, *l;
-  gboolean found;
 
-  found = FALSE;
+  snapshot = g_new0 (CdVolumeSnapshot, 1);
+  snapshot->entries = g_ptr_array_new_with_free_func ((GDestroyNotify) cd_volume_entry_free);
+
+  mon = g_volume_monitor_get ();
+
   list = g_volume_monitor_get_connected_drives (mon);
   for (l = list; l != NULL; l = l->next) {
-    GDrive *drive;
-    char *ddev, *resolved;
+    GDrive *drive = l->data;
+
+    cd_volume_snapshot_add (snapshot,
+			    g_drive_get_identifier (drive, G_VOLUME_IDENTIFIER_KIND_UNIX_DEVICE),
+			    drive, NULL);
+  }
+  g_list_free_full (list, g_object_unref);
+
+  list = g_volume_monitor_get_volumes (mon);
+  for (l = list; l != NULL; l = l->next) {
+    GVolume *vol = l->data;
+
+    cd_volume_snapshot_add (snapshot,
+			    g_volume_get_identifier (vol, G_VOLUME_IDENTIFIER_KIND_UNIX_DEVICE),
+			    NULL, vol);
+  }
+  g_list_free_full (list, g_object_unref);
+
+  g_object_unref (mon);
+
+  return snapshot;
+}
+
+static void
+cd_volume_snapshot_free (CdVolumeSnapshot *snapshot)
+{
+  g_ptr_array_free (snapshot->entries, TRUE);
+  g_free (snapshot);
+}
+
+static gboolean
+cd_cache_get_dev_from_volumes (CdVolumeSnapshot *snapshot, const char *device,
+			      char **mountpoint, GVolume **volume)
+{
+  guint i;
 
-    drive = l->data;
-    ddev = g_drive_get_identifier (drive, G_VOLUME_IDENTIFIER_KIND_UNIX_DEVICE);
-    if (ddev == NULL)
+  for (i = 0; i < snapshot->entries->len; i++) {
+    CdVolumeEntry *entry = g_ptr_array_index (snapshot->entries, i);
+
+    if (entry->drive == NULL || strcmp (entry->device, device) != 0)
       continue;
-    resolved = totem_resolve_symlink (ddev, NULL);
-    g_free (ddev);
-    if (resolved == NULL)
+    if (cd_cache_get_best_mount_for_drive (entry->drive, mountpoint, volume))
+      return TRUE;
+  }
+
+  /* Not in the drives? Look in the volumes themselves */
+  for (i = 0; i < snapshot->entries->len; i++) {
+    CdVolumeEntry *entry = g_ptr_array_index (snapshot->entries, i);
+
+    if (entry->volume == NULL || strcmp (entry->device, device) != 0)
       continue;
+    *volume = g_object_ref (entry->volume);
+    return TRUE;
+  }
 
-    if (strcmp (resolved, device) == 0) {
-      found = cd_cache_get_best_mount_for_drive (drive, mountpoint, volume);
-    }
+  return FALSE;
+}
+
+static const struct {
+  const char *content_type;
+  CdContentFlags flag;
+} content_flags[] = {
+  { "x-content/audio-cdda", CD_CONTENT_CDDA },
+  { "x-content/video-vcd", CD_CONTENT_VCD },
+  { "x-content/video-svcd", CD_CONTENT_SVCD },
+  { "x-content/video-dvd", CD_CONTENT_DVD },
+  { "x-content/video-bluray", CD_CONTENT_BLURAY },
+};
+
+static CdContentFlags
+cd_content_flags_from_type (const char *content_type)
+{
+  guint i;
+
+  if (content_type == NULL)
+    return 0;
+
+  for (i = 0; i < G_N_ELEMENTS (content_flags); i++) {
+    if (g_str_equal (content_flags[i].content_type, content_type))
+      return content_flags[i].flag;
+  }
+  return 0;
+}
+
+static CdContentFlags
+cd_content_flags_from_types (char **content_types)
+{
+  CdContentFlags flags;
+  guint i;
 
-    g_free (resolved);
-    if (found != FALSE)
+  flags = 0;
+  for (i = 0; content_types != NULL && content_types[i] != NULL; i++)
+    flags |= cd_content_flags_from_type (content_types[i]);
+
+  return flags;
+}
+
+/* Video discs in the order they've always been checked for */
+static TotemDiscMediaType
+cd_media_type_from_content_flags (CdContentFlags flags)
+{
+  if (flags & (CD_CONTENT_VCD | CD_CONTENT_SVCD))
+    return MEDIA_TYPE_VCD;
+  if (flags & CD_CONTENT_DVD)
+    return MEDIA_TYPE_DVD;
+  if (flags & CD_CONTENT_BLURAY)
+    return MEDIA_TYPE_BD;
+  return MEDIA_TYPE_DATA;
+}
+
+/* The files and directories that give away a video disc's type,
+ * as listed in the shared-mime-info treemagic rules, in the order
+ * cd_media_type_from_content_flags() prefers them. Like in treemagic,
+ * directories need to have something in them, and names are matched
+ * case-insensitively. */
+static const struct {
+  const char *path;
+  gboolean is_dir;
+  const char *content_type;
+} dir_markers[] = {
+  { "mpegav/AVSEQ01.DAT", FALSE, "x-content/video-vcd" },
+  { "MPEG2/AVSEQ01.MPG", FALSE, "x-content/video-svcd" },
+  { "VIDEO_TS/VIDEO_TS.IFO", FALSE, "x-content/video-dvd" },
+  { "VIDEO_TS/VIDEO_TS.IFO;1", FALSE, "x-content/video-dvd" },
+  { "VIDEO_TS.IFO", FALSE, "x-content/video-dvd" },
+  { "VIDEO_TS.IFO;1", FALSE, "x-content/video-dvd" },
+  { "BDAV", TRUE, "x-content/video-bluray" },
+  { "BDMV", TRUE, "x-content/video-bluray" },
+};
+
+/* Whether @name is the marker's path component starting at @component */
+static gboolean
+cd_marker_component_equal (const char *component, const char *name)
+{
+  gsize len;
+
+  len = strcspn (component, "/");
+  return strlen (name) == len &&
+    g_ascii_strncasecmp (component, name, len) == 0;
+}
+
+/* Returns the path of @name in @dir, trying it as is first,
+ * and then with any case */
+static char *
+cd_dir_find_entry (const char *dir, const char *name)
+{
+  GDir *d;
+  const char *entry;
+  char *path;
+
+  path = g_build_filename (dir, name, NULL);
+  if (g_file_test (path, G_FILE_TEST_EXISTS))
+    return path;
+  g_free (path);
+
+  d = g_dir_open (dir, 0, NULL);
+  if (d == NULL)
+    return NULL;
+
+  path = NULL;
+  while ((entry = g_dir_read_name (d)) != NULL) {
+    if (cd_marker_component_equal (name, entry)) {
+      path = g_build_filename (dir, entry, NULL);
       break;
+    }
   }
+  g_dir_close (d);
 
-  g_list_foreach (list, (GFunc) g_object_unref, NULL);
-  g_list_free (list);
+  return path;
+}
 
-  if (found != FALSE)
-    return found;
+static gboolean
+cd_dir_is_empty (const char *dir)
+{
+  GDir *d;
+  gboolean retval;
 
-  /* Not in the drives? Look in the volumes themselves */
-  found = FALSE;
-  list = g_volume_monitor_get_volumes (mon);
-  for (l = list; l != NULL; l = l->next) {
-    GVolume *vol;
-    char *ddev, *resolved;
+  d = g_dir_open (dir, 0, NULL);
+  if (d == NULL)
+    return TRUE;
+  retval = (g_dir_read_name (d) == NULL);
+  g_dir_close (d);
+
+  return retval;
+}
+
+/* @path is the entry that matched the marker's first component,
+ * and @rest the rest of the marker, if any */
+static gboolean
+cd_dir_has_marker (const char *path, const char *rest, gboolean is_dir)
+{
+  GStatBuf buf;
+  char *found;
+  gboolean retval;
+
+  if (rest != NULL) {
+    found = cd_dir_find_entry (path, rest);
+    if (found == NULL)
+      return FALSE;
+  } else {
+    found = g_strdup (path);
+  }
 
-    vol = l->data;
-    ddev = g_volume_get_identifier (vol, G_VOLUME_IDENTIFIER_KIND_UNIX_DEVICE);
-    if (ddev == NULL)
+  if (g_stat (found, &buf) != 0)
+    retval = FALSE;
+  else if (is_dir)
+    retval = S_ISDIR (buf.st_mode) && !cd_dir_is_empty (found);
+  else
+    retval = S_ISREG (buf.st_mode);
+  g_free (found);
+
+  return retval;
+}
+
+/* Only looks for the markers, rather than going through the
+ * whole tree like g_content_type_guess_for_tree(). @dir is only
+ * listed once, whatever the case of the markers in it. */
+static const char *
+cd_dir_guess_content_type (const char *dir)
+{
+  char *matches[G_N_ELEMENTS (dir_markers)] = { NULL, };
+  const char *content_type, *name;
+  GDir *d;
+  guint i;
+
+  d = g_dir_open (dir, 0, NULL);
+  if (d == NULL)
+    return NULL;
+
+  while ((name = g_dir_read_name (d)) != NULL) {
+    for (i = 0; i < G_N_ELEMENTS (dir_markers); i++) {
+      if (matches[i] == NULL &&
+	  cd_marker_component_equal (dir_markers[i].path, name))
+	matches[i] = g_build_filename (dir, name, NULL);
+    }
+  }
+  g_dir_close (d);
+
+  content_type = NULL;
+  for (i = 0; i < G_N_ELEMENTS (dir_markers); i++) {
+    if (matches[i] == NULL)
       continue;
-    resolved = totem_resolve_symlink (ddev, NULL);
-    g_free (ddev);
-    if (resolved == NULL)
+
+    if (content_type == NULL) {
+      const char *rest;
+
+      rest = strchr (dir_markers[i].path, '/');
+      if (cd_dir_has_marker (matches[i], rest ? rest + 1 : NULL, dir_markers[i].is_dir))
+	content_type = dir_markers[i].content_type;
+    }
+    g_free (matches[i]);
+  }
+
+  return content_type;
+}
+
+/* ISO9660 images are probed by reading the volume descriptor and the
+ * few directory records that can hold a marker, rather than going
+ * through the whole image */
+#define ISO_SECTOR_SIZE		2048
+/* Raw (Mode 1) sector images, as produced by some ripping tools */
+#define ISO_RAW_SECTOR_SIZE	2352
+#define ISO_RAW_DATA_OFFSET	16
+#define ISO_VD_FIRST_SECTOR	16
+#define ISO_VD_MAX_SECTORS	16
+/* The markers are in small directories near the root, anything
+ * bigger isn't worth reading */
+#define ISO_MAX_DIR_SECTORS	32
+#define ISO_DIR_RECORD_MIN_SIZE	33
+#define ISO_DIR_FLAG_DIRECTORY	0x02
+
+typedef struct {
+  int fd;
+  gsize sector_size;
+  gsize data_offset;
+  /* the directory records' flags are one byte earlier
+   * in High Sierra images */
+  gsize flags_offset;
+} IsoImage;
+
+static guint32
+iso_read_uint32_le (const guchar *buf)
+{
+  return (guint32) buf[0] | (guint32) buf[1] << 8 |
+    (guint32) buf[2] << 16 | (guint32) buf[3] << 24;
+}
+
+static gboolean
+iso_pread (int fd, guchar *buf, gsize len, goffset offset)
+{
+  while (len > 0) {
+    ssize_t res;
+
+    res = pread (fd, buf, len, offset);
+    if (res < 0 && errno == EINTR)
+      continue;
+    if (res <= 0)
+      return FALSE;
+    buf += res;
+    len -= res;
+    offset += res;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+iso_read_sectors (IsoImage *iso, guint32 lba, guint32 n_sectors, guchar *buf)
+{
+  guint32 i;
+
+  if (iso->sector_size == ISO_SECTOR_SIZE)
+    return iso_pread (iso->fd, buf, (gsize) n_sectors * ISO_SECTOR_SIZE,
+		      (goffset) lba * ISO_SECTOR_SIZE);
+
+  for (i = 0; i < n_sectors; i++) {
+    if (!iso_pread (iso->fd, buf + (gsize) i * ISO_SECTOR_SIZE, ISO_SECTOR_SIZE,
+		    (goffset) (lba + i) * iso->sector_size + iso->data_offset))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Returns the directory's records, or %NULL if it's too big */
+static guchar *
+iso_read_dir (IsoImage *iso, guint32 lba, guint32 size, gsize *len)
+{
+  guint32 n_sectors;
+  guchar *buf;
+
+  n_sectors = (size + ISO_SECTOR_SIZE - 1) / ISO_SECTOR_SIZE;
+  if (n_sectors == 0 || n_sectors > ISO_MAX_DIR_SECTORS)
+    return NULL;
+
+  buf = g_malloc ((gsize) n_sectors * ISO_SECTOR_SIZE);
+  if (!iso_read_sectors (iso, lba, n_sectors, buf)) {
+    g_free (buf);
+    return NULL;
+  }
+  *len = (gsize) n_sectors * ISO_SECTOR_SIZE;
+
+  return buf;
+}
+
+/* Compares the file identifier, without its ";1" version number,
+ * or the trailing dot of files without an extension */
+static gboolean
+iso_name_equal (const guchar *id, gsize id_len, const char *name, gsize name_len)
+{
+  const guchar *version;
+
+  version = memchr (id, ';', id_len);
+  if (version != NULL)
+    id_len = version - id;
+  if (id_len > 0 && id[id_len - 1] == '.')
+    id_len--;
+
+  return id_len == name_len &&
+    g_ascii_strncasecmp ((const char *) id, name, name_len) == 0;
+}
+
+static gboolean
+iso_dir_lookup (IsoImage     *iso,
+		const guchar *records,
+		gsize         len,
+		const char   *name,
+		gsize         name_len,
+		guint32      *lba,
+		guint32      *size,
+		gboolean     *is_dir)
+{
+  gsize pos;
+
+  pos = 0;
+  while (pos + ISO_DIR_RECORD_MIN_SIZE <= len) {
+    const guchar *record = records + pos;
+    gsize record_len, id_len;
+
+    record_len = record[0];
+    if (record_len == 0) {
+      /* Records don't cross sectors, the rest of this one is padding */
+      pos = (pos / ISO_SECTOR_SIZE + 1) * ISO_SECTOR_SIZE;
       continue;
+    }
+
+    id_len = record[32];
+    if (record_len < ISO_DIR_RECORD_MIN_SIZE ||
+	ISO_DIR_RECORD_MIN_SIZE + id_len > record_len ||
+	pos + record_len > len)
+      return FALSE;
 
-    if (strcmp (resolved, device) == 0) {
-      found = TRUE;
-      *volume = g_object_ref (vol);
+    if (iso_name_equal (record + ISO_DIR_RECORD_MIN_SIZE, id_len, name, name_len)) {
+      *lba = iso_read_uint32_le (record + 2);
+      *size = iso_read_uint32_le (record + 10);
+      *is_dir = (record[iso->flags_offset] & ISO_DIR_FLAG_DIRECTORY) != 0;
+      return TRUE;
     }
 
-    g_free (resolved);
-    if (found != FALSE)
+    pos += record_len;
+  }
+
+  return FALSE;
+}
+
+/* Whether the directory has anything besides its "." and ".." records,
+ * which have the 0 and 1 identifiers */
+static gboolean
+iso_dir_is_empty (const guchar *records, gsize len)
+{
+  gsize pos;
+
+  pos = 0;
+  while (pos + ISO_DIR_RECORD_MIN_SIZE <= len) {
+    const guchar *record = records + pos;
+    gsize record_len, id_len;
+
+    record_len = record[0];
+    if (record_len == 0) {
+      pos = (pos / ISO_SECTOR_SIZE + 1) * ISO_SECTOR_SIZE;
+      continue;
+    }
+
+    id_len = record[32];
+    if (record_len < ISO_DIR_RECORD_MIN_SIZE ||
+	ISO_DIR_RECORD_MIN_SIZE + id_len > record_len ||
+	pos + record_len > len)
+      return TRUE;
+
+    if (id_len != 1 || record[ISO_DIR_RECORD_MIN_SIZE] > 1)
+      return FALSE;
+
+    pos += record_len;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+iso_has_marker (IsoImage     *iso,
+		const guchar *root,
+		gsize         root_len,
+		const char   *path,
+		gboolean      is_dir)
+{
+  const guchar *records;
+  guchar *subdir;
+  gboolean found, entry_is_dir;
+  guint32 lba, size;
+  gsize len;
+
+  records = root;
+  len = root_len;
+  subdir = NULL;
+  found = FALSE;
+
+  while (TRUE) {
+    const char *sep;
+    gsize name_len;
+
+    sep = strchr (path, '/');
+    name_len = sep ? (gsize) (sep - path) : strlen (path);
+
+    if (!iso_dir_lookup (iso, records, len, path, name_len, &lba, &size, &entry_is_dir))
+      break;
+
+    if (sep == NULL) {
+      found = (entry_is_dir == is_dir);
+      if (found && is_dir) {
+	g_free (subdir);
+	subdir = iso_read_dir (iso, lba, size, &len);
+	found = (subdir != NULL && !iso_dir_is_empty (subdir, len));
+      }
       break;
+    }
+    if (!entry_is_dir)
+      break;
+
+    g_free (subdir);
+    subdir = iso_read_dir (iso, lba, size, &len);
+    if (subdir == NULL)
+      break;
+    records = subdir;
+    path = sep + 1;
   }
 
-  g_list_foreach (list, (GFunc) g_object_unref, NULL);
-  g_list_free (list);
+  g_free (subdir);
 
   return found;
 }
 
+static char *
+iso_get_label (const guchar *buf, gsize len)
+{
+  char *label;
+
+  label = g_strndup ((const char *) buf, len);
+  g_strstrip (label);
+  if (!g_utf8_validate (label, -1, NULL)) {
+    g_free (label);
+    return g_strdup ("");
+  }
+
+  return label;
+}
+
+/* Looks for the primary volume descriptor, with either sector size */
+static const guchar *
+iso_find_primary_vd (IsoImage *iso, guchar *buf)
+{
+  static const gsize sector_sizes[] = { ISO_SECTOR_SIZE, ISO_RAW_SECTOR_SIZE };
+  guint i, j;
+
+  for (i = 0; i < G_N_ELEMENTS (sector_sizes); i++) {
+    iso->sector_size = sector_sizes[i];
+    iso->data_offset = (iso->sector_size == ISO_RAW_SECTOR_SIZE) ? ISO_RAW_DATA_OFFSET : 0;
+
+    for (j = 0; j < ISO_VD_MAX_SECTORS; j++) {
+      if (!iso_read_sectors (iso, ISO_VD_FIRST_SECTOR + j, 1, buf))
+	break;
+
+      if (memcmp (buf + 1, "CD001", 5) == 0) {
+	/* Volume descriptor set terminator */
+	if (buf[0] == 255)
+	  break;
+	if (buf[0] == 1) {
+	  iso->flags_offset = 25;
+	  return buf;
+	}
+      } else if (memcmp (buf + 9, "CDROM", 5) == 0) {
+	if (buf[8] == 255)
+	  break;
+	if (buf[8] == 1) {
+	  iso->flags_offset = 24;
+	  return buf;
+	}
+      } else {
+	break;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/* Returns %FALSE if @filename isn't an ISO9660 or High Sierra image.
+ * UDF bridge images are read through their ISO9660 side. */
 static gboolean
-cd_cache_has_content_type (CdCache *cache, const char *content_type)
+cd_iso_probe (const char  *filename,
+	      const char **content_type,
+	      char       **label)
 {
+  IsoImage iso;
+  guchar buf[ISO_SECTOR_SIZE];
+  const guchar *root_record;
+  guchar *root;
+  gsize root_len;
   guint i;
 
-  if (cache->content_types == NULL) {
+  iso.fd = g_open (filename, O_RDONLY, 0);
+  if (iso.fd < 0)
+    return FALSE;
+
+  if (iso_find_primary_vd (&iso, buf) == NULL) {
+    g_close (iso.fd, NULL);
     return FALSE;
   }
 
-  for (i = 0; cache->content_types[i] != NULL; i++) {
-    if (g_str_equal (cache->content_types[i], content_type) != FALSE)
-      return TRUE;
+  if (iso.flags_offset == 25) {
+    *label = iso_get_label (buf + 40, 32);
+    root_record = buf + 156;
+  } else {
+    *label = iso_get_label (buf + 48, 32);
+    root_record = buf + 180;
   }
-  return FALSE;
+
+  *content_type = NULL;
+  root = iso_read_dir (&iso, iso_read_uint32_le (root_record + 2),
+		       iso_read_uint32_le (root_record + 10), &root_len);
+  if (root != NULL) {
+    for (i = 0; i < G_N_ELEMENTS (dir_markers); i++) {
+      /* Version numbers are already ignored when looking up names */
+      if (strchr (dir_markers[i].path, ';') != NULL)
+	continue;
+      if (iso_has_marker (&iso, root, root_len, dir_markers[i].path, dir_markers[i].is_dir)) {
+	*content_type = dir_markers[i].content_type;
+	break;
+      }
+    }
+    g_free (root);
+  }
+
+  g_close (iso.fd, NULL);
+
+  return TRUE;
 }
 
 static gboolean
-cd_cache_check_archive (CdCache *cache,
-			const char *filename,
-			GError **error)
+cd_cache_check_iso (CdCache *cache,
+		    const char *filename,
+		    GError **error)
 {
-#ifndef HAVE_LIBARCHIVE
-  g_set_error (error, TOTEM_PL_PARSER_ERROR, TOTEM_PL_PARSER_ERROR_MOUNT_FAILED,
-	       _("Failed to mount %s."), filename);
-  return FALSE;
-#else
-  struct archive *a;
-  struct archive_entry *entry;
-  const char * content_types[] = { NULL, NULL };
-  int r;
-
-  a = archive_read_new();
-  archive_read_support_format_iso9660(a);
-  r = archive_read_open_filename(a, filename, 10240);
-  if (r != ARCHIVE_OK) {
+  const char *content_type;
+
+  if (!cd_iso_probe (filename, &content_type, &cache->label)) {
     g_set_error (error, TOTEM_PL_PARSER_ERROR, TOTEM_PL_PARSER_ERROR_MOUNT_FAILED,
 		 _("Failed to mount %s."), filename);
     return FALSE;
   }
-  while (archive_read_next_header(a, &entry) == ARCHIVE_OK) {
-    const char *name;
 
-    name = archive_entry_pathname (entry);
-    if (g_ascii_strcasecmp (name, "VIDEO_TS/VIDEO_TS.IFO") == 0) {
-      content_types[0] = "x-content/video-dvd";
-      cache->content_types = g_strdupv ((gchar**) content_types);
-      break;
-    } else if (g_ascii_strcasecmp (name, "mpegav/AVSEQ01.DAT") == 0) {
-      content_types[0] = "x-content/video-vcd";
-      cache->content_types = g_strdupv ((gchar**) content_types);
-      break;
-    } else if (g_ascii_strcasecmp (name, "MPEG2/AVSEQ01.MPG") == 0) {
-      content_types[0] = "x-content/video-svcd";
-      cache->content_types = g_strdupv ((gchar**) content_types);
-      break;
-    } else if (g_ascii_strcasecmp (name, "BDAV") == 0 ||
-               g_ascii_strcasecmp (name, "BDMV") == 0) {
-      content_types[0] = "x-content/video-bluray";
-      cache->content_types = g_strdupv ((gchar**) content_types);
-      break;
-    }
-    archive_read_data_skip(a);
-  }
-  archive_read_free(a);
+  cache->content = cd_content_flags_from_type (content_type);
+
   return TRUE;
-#endif
+}
+
+typedef struct {
+  dev_t dev;
+  ino_t ino;
+} CdDirKey;
+
+static guint
+cd_dir_key_hash (gconstpointer key)
+{
+  const CdDirKey *k = key;
+
+  return (guint) k->ino ^ ((guint) k->dev << 16);
+}
+
+static gboolean
+cd_dir_key_equal (gconstpointer a, gconstpointer b)
+{
+  const CdDirKey *k1 = a, *k2 = b;
+
+  return k1->ino == k2->ino && k1->dev == k2->dev;
+}
+
+/*
+ * totem_cd_dir_cache_new:
+ *
+ * Creates a cache of the disc types of directories, to be passed to
+ * totem_cd_detect_type_from_dir_cached() for each directory of a scan,
+ * so that each one only gets checked once, whatever path it's reached
+ * through. Free it with g_hash_table_destroy().
+ */
+GHashTable *
+totem_cd_dir_cache_new (void)
+{
+  return g_hash_table_new_full (cd_dir_key_hash, cd_dir_key_equal, g_free, NULL);
+}
+
+/* Returns %MEDIA_TYPE_ERROR if @dir isn't a directory */
+static TotemDiscMediaType
+cd_dir_detect_type (const char *dir, GHashTable *dir_cache)
+{
+  GStatBuf buf;
+  CdDirKey key;
+  TotemDiscMediaType type;
+
+  if (g_stat (dir, &buf) != 0 || !S_ISDIR (buf.st_mode))
+    return MEDIA_TYPE_ERROR;
+
+  memset (&key, 0, sizeof (key));
+  key.dev = buf.st_dev;
+  key.ino = buf.st_ino;
+
+  if (dir_cache != NULL) {
+    gpointer value;
+
+    value = g_hash_table_lookup (dir_cache, &key);
+    if (value != NULL)
+      return GPOINTER_TO_INT (value);
+  }
+
+  type = cd_media_type_from_content_flags
+    (cd_content_flags_from_type (cd_dir_guess_content_type (dir)));
+
+  if (dir_cache != NULL) {
+    CdDirKey *cache_key;
+
+    cache_key = g_new (CdDirKey, 1);
+    *cache_key = key;
+    g_hash_table_insert (dir_cache, cache_key, GINT_TO_POINTER (type));
+  }
+
+  return type;
 }
 
 static char *
@@ -341,36 +965,44 @@ unescape_archive_name (const char *orig_uri)
   return escape2;
 }
 
+/* Returns the local path for @dev, or %NULL if it hasn't got one */
+static char *
+cd_get_local_path (const char *dev)
+{
+  GFile *file;
+  char *local;
+
+  if (dev[0] == '/')
+    return g_strdup (dev);
+
+  if (g_str_has_prefix (dev, "archive://")) {
+    char *orig_uri;
+    orig_uri = unescape_archive_name (dev);
+    file = g_file_new_for_uri (orig_uri);
+    g_free (orig_uri);
+  } else {
+    file = g_file_new_for_commandline_arg (dev);
+  }
+  local = g_file_get_path (file);
+  g_object_unref (file);
+
+  return local;
+}
+
 static CdCache *
-cd_cache_new (const char *dev,
-	      GError     **error)
+cd_cache_new (const char       *dev,
+	      CdVolumeSnapshot *snapshot,
+	      GError          **error)
 {
   CdCache *cache;
   char *mountpoint = NULL, *device, *local;
-  GVolumeMonitor *mon;
+  CdVolumeSnapshot *own_snapshot = NULL;
   GVolume *volume = NULL;
-  GFile *file;
   gboolean found, self_mounted;
 
-  if (dev[0] == '/') {
-    local = g_strdup (dev);
-    file = g_file_new_for_path (dev);
-  } else {
-    if (g_str_has_prefix (dev, "archive://")) {
-      char *orig_uri;
-      orig_uri = unescape_archive_name (dev);
-      file = g_file_new_for_uri (orig_uri);
-      g_free (orig_uri);
-      local = g_file_get_path (file);
-    } else {
-      file = g_file_new_for_commandline_arg (dev);
-      local = g_file_get_path (file);
-    }
-  }
-
+  local = cd_get_local_path (dev);
   if (local == NULL) {
     /* No error, just no cache */
-    g_object_unref (file);
     return NULL;
   }
 
@@ -380,8 +1012,7 @@ cd_cache_new (const char *dev,
     cache = g_new0 (CdCache, 1);
     cache->mountpoint = local;
     cache->is_media = FALSE;
-    cache->content_types = g_content_type_guess_for_tree (file);
-    g_object_unref (file);
+    cache->content = cd_content_flags_from_type (cd_dir_guess_content_type (local));
 
     return cache;
   } else if (g_file_test (local, G_FILE_TEST_IS_REGULAR)) {
@@ -389,11 +1020,10 @@ cd_cache_new (const char *dev,
     cache->is_iso = TRUE;
     cache->is_media = FALSE;
 
-    g_object_unref (file);
-
-    if (cd_cache_check_archive (cache, local, error) == FALSE) {
+    if (cd_cache_check_iso (cache, local, error) == FALSE) {
+      g_free (local);
       cd_cache_free (cache);
-      return FALSE;
+      return NULL;
     }
 
     cache->device = local;
@@ -403,16 +1033,17 @@ cd_cache_new (const char *dev,
     return cache;
   }
 
-  g_object_unref (file);
-
   /* We have a local device
    * retrieve mountpoint and volume from gio volumes */
   device = totem_resolve_symlink (local, error);
   g_free (local);
   if (!device)
     return NULL;
-  mon = g_volume_monitor_get ();
-  found = cd_cache_get_dev_from_volumes (mon, device, &mountpoint, &volume);
+  if (snapshot == NULL)
+    snapshot = own_snapshot = cd_volume_snapshot_new ();
+  found = cd_cache_get_dev_from_volumes (snapshot, device, &mountpoint, &volume);
+  if (own_snapshot != NULL)
+    cd_volume_snapshot_free (own_snapshot);
   if (!found) {
     g_set_error (error, TOTEM_PL_PARSER_ERROR, TOTEM_PL_PARSER_ERROR_NO_DISC,
 	_("No media in drive for device “%s”."),
@@ -434,7 +1065,11 @@ cd_cache_new (const char *dev,
 
     mount = g_volume_get_mount (volume);
     if (mount) {
-      cache->content_types = g_mount_guess_content_type_sync (mount, FALSE, NULL, NULL);
+      char **content_types;
+
+      content_types = g_mount_guess_content_type_sync (mount, FALSE, NULL, NULL);
+      cache->content = cd_content_flags_from_types (content_types);
+      g_strfreev (content_types);
       g_object_unref (mount);
     }
   }
@@ -563,8 +1198,6 @@ cd_cache_free (CdCache *cache)
 {
   GMount *mount;
 
-  g_strfreev (cache->content_types);
-
   if (cache->iso_file && cache->self_mounted) {
     mount = g_file_find_enclosing_mount (cache->iso_file,
 					 NULL, NULL);
@@ -591,72 +1224,28 @@ cd_cache_free (CdCache *cache)
     g_object_unref (cache->volume);
   g_free (cache->mountpoint);
   g_free (cache->device);
+  g_free (cache->label);
   g_free (cache);
 }
 
+/* Opens the device and the mountpoint once, and gives the disc's type
+ * from the content types found when the cache was created */
 static TotemDiscMediaType
-cd_cache_disc_is_cdda (CdCache *cache,
-		       GError **error)
-{
-  /* We can't have audio CDs on disc, yet */
-  if (cache->is_media == FALSE)
-    return MEDIA_TYPE_DATA;
-  if (!cd_cache_open_device (cache, error))
-    return MEDIA_TYPE_ERROR;
-  if (cd_cache_has_content_type (cache, "x-content/audio-cdda") != FALSE)
-    return MEDIA_TYPE_CDDA;
-
-  return MEDIA_TYPE_DATA;
-}
-
-static TotemDiscMediaType
-cd_cache_disc_is_vcd (CdCache *cache,
-                      GError **error)
+cd_cache_get_type (CdCache *cache,
+		   gboolean check_cdda,
+		   GError **error)
 {
-  /* open disc and open mount */
   if (!cd_cache_open_device (cache, error))
     return MEDIA_TYPE_ERROR;
-  if (!cd_cache_open_mountpoint (cache, error))
-    return MEDIA_TYPE_ERROR;
-
-  if (cd_cache_has_content_type (cache, "x-content/video-vcd") != FALSE)
-    return MEDIA_TYPE_VCD;
-  if (cd_cache_has_content_type (cache, "x-content/video-svcd") != FALSE)
-    return MEDIA_TYPE_VCD;
-
-  return MEDIA_TYPE_DATA;
-}
 
-static TotemDiscMediaType
-cd_cache_disc_is_dvd (CdCache *cache,
-		      GError **error)
-{
-  /* open disc, check capabilities and open mount */
-  if (!cd_cache_open_device (cache, error))
-    return MEDIA_TYPE_ERROR;
-  if (!cd_cache_open_mountpoint (cache, error))
-    return MEDIA_TYPE_ERROR;
-
-  if (cd_cache_has_content_type (cache, "x-content/video-dvd") != FALSE)
-    return MEDIA_TYPE_DVD;
-
-  return MEDIA_TYPE_DATA;
-}
+  /* We can't have audio CDs on disc, yet */
+  if (check_cdda && cache->is_media && (cache->content & CD_CONTENT_CDDA))
+    return MEDIA_TYPE_CDDA;
 
-static TotemDiscMediaType
-cd_cache_disc_is_bd (CdCache *cache,
-		     GError **error)
-{
-  /* open disc, check capabilities and open mount */
-  if (!cd_cache_open_device (cache, error))
-    return MEDIA_TYPE_ERROR;
   if (!cd_cache_open_mountpoint (cache, error))
     return MEDIA_TYPE_ERROR;
 
-  if (cd_cache_has_content_type (cache, "x-content/video-bluray") != FALSE)
-    return MEDIA_TYPE_BD;
-
-  return MEDIA_TYPE_DATA;
+  return cd_media_type_from_content_flags (cache->content);
 }
 
 /**
@@ -702,39 +1291,18 @@ totem_cd_dir_get_parent (const char *dir)
   return parent;
 }
 
-/**
- * totem_cd_detect_type_from_dir:
- * @dir: a directory URI
- * @mrl: (out) (transfer full) (allow-none): return location for the disc's MRL, or %NULL
- * @error: return location for a #GError, or %NULL
- *
- * Detects the disc's type, given its mount directory URI. If
- * a string pointer is passed to @mrl, it will return the disc's
- * MRL as from totem_cd_mrl_from_type().
- *
- * Note that this function does synchronous I/O.
- *
- * If no disc is present in the drive, a #TOTEM_PL_PARSER_ERROR_NO_DISC
- * error will be returned. On unknown mounting errors, a
- * #TOTEM_PL_PARSER_ERROR_MOUNT_FAILED error will be returned. On other
- * I/O errors, or if resolution of symlinked mount paths failed, a code from
- * #GIOErrorEnum will be returned.
- *
- * Return value: #TotemDiscMediaType corresponding to the disc's type, or #MEDIA_TYPE_ERROR on failure
- **/
-TotemDiscMediaType
-totem_cd_detect_type_from_dir (const char *dir, char **mrl, GError **error)
+/* The slow path, for images and devices */
+static TotemDiscMediaType
+cd_cache_detect_type_from_dir (const char *dir, char **mrl, GError **error)
 {
   CdCache *cache;
   TotemDiscMediaType type;
 
   g_return_val_if_fail (dir != NULL, MEDIA_TYPE_ERROR);
 
-  if (!(cache = cd_cache_new (dir, error)))
+  if (!(cache = cd_cache_new (dir, NULL, error)))
     return MEDIA_TYPE_ERROR;
-  if ((type = cd_cache_disc_is_vcd (cache, error)) == MEDIA_TYPE_DATA &&
-      (type = cd_cache_disc_is_dvd (cache, error)) == MEDIA_TYPE_DATA &&
-      (type = cd_cache_disc_is_bd (cache, error)) == MEDIA_TYPE_DATA) {
+  if ((type = cd_cache_get_type (cache, FALSE, error)) == MEDIA_TYPE_DATA) {
     /* is it the directory itself? */
     char *parent;
 
@@ -743,13 +1311,11 @@ totem_cd_detect_type_from_dir (const char *dir, char **mrl, GError **error)
     if (!parent)
       return type;
 
-    cache = cd_cache_new (parent, error);
+    cache = cd_cache_new (parent, NULL, error);
     g_free (parent);
     if (!cache)
       return MEDIA_TYPE_ERROR;
-    if ((type = cd_cache_disc_is_vcd (cache, error)) == MEDIA_TYPE_DATA &&
-	(type = cd_cache_disc_is_dvd (cache, error)) == MEDIA_TYPE_DATA &&
-	(type = cd_cache_disc_is_bd (cache, error)) == MEDIA_TYPE_DATA) {
+    if ((type = cd_cache_get_type (cache, FALSE, error)) == MEDIA_TYPE_DATA) {
       /* crap, nothing found */
       cd_cache_free (cache);
       return type;
@@ -774,6 +1340,103 @@ totem_cd_detect_type_from_dir (const char *dir, char **mrl, GError **error)
   return type;
 }
 
+/*
+ * totem_cd_detect_type_from_dir_cached:
+ * @dir: a directory URI
+ * @mrl: (out) (transfer full) (allow-none): return location for the disc's MRL, or %NULL
+ * @dir_cache: (allow-none): a cache from totem_cd_dir_cache_new(), or %NULL
+ * @error: return location for a #GError, or %NULL
+ *
+ * Like totem_cd_detect_type_from_dir(), but remembers the type of
+ * the directories looked at in @dir_cache.
+ */
+TotemDiscMediaType
+totem_cd_detect_type_from_dir_cached (const char  *dir,
+				      char       **mrl,
+				      GHashTable  *dir_cache,
+				      GError     **error)
+{
+  TotemDiscMediaType type;
+  GFile *file;
+  char *local, *disc_dir;
+
+  g_return_val_if_fail (dir != NULL, MEDIA_TYPE_ERROR);
+
+  if (dir[0] == '/')
+    file = g_file_new_for_path (dir);
+  else if (g_str_has_prefix (dir, "archive://") == FALSE)
+    file = g_file_new_for_commandline_arg (dir);
+  else
+    return cd_cache_detect_type_from_dir (dir, mrl, error);
+  local = g_file_get_path (file);
+  g_object_unref (file);
+
+  if (local == NULL)
+    return MEDIA_TYPE_ERROR;
+
+  type = cd_dir_detect_type (local, dir_cache);
+  if (type == MEDIA_TYPE_ERROR) {
+    /* Not a directory after all */
+    g_free (local);
+    return cd_cache_detect_type_from_dir (dir, mrl, error);
+  }
+
+  disc_dir = local;
+  if (type == MEDIA_TYPE_DATA) {
+    char *parent;
+
+    /* is it the directory itself? */
+    parent = g_path_get_dirname (local);
+    if (g_strcmp0 (parent, local) != 0)
+      type = cd_dir_detect_type (parent, dir_cache);
+    if (type == MEDIA_TYPE_DVD || type == MEDIA_TYPE_VCD || type == MEDIA_TYPE_BD) {
+      disc_dir = parent;
+      g_free (local);
+    } else {
+      type = MEDIA_TYPE_DATA;
+      g_free (parent);
+    }
+  }
+
+  if (mrl != NULL) {
+    if (type == MEDIA_TYPE_DVD)
+      *mrl = totem_cd_mrl_from_type ("dvd", disc_dir);
+    else if (type == MEDIA_TYPE_VCD)
+      *mrl = totem_cd_mrl_from_type ("vcd", disc_dir);
+    else if (type == MEDIA_TYPE_BD)
+      *mrl = totem_cd_mrl_from_type ("bluray", disc_dir);
+  }
+  g_free (disc_dir);
+
+  return type;
+}
+
+/**
+ * totem_cd_detect_type_from_dir:
+ * @dir: a directory URI
+ * @mrl: (out) (transfer full) (allow-none): return location for the disc's MRL, or %NULL
+ * @error: return location for a #GError, or %NULL
+ *
+ * Detects the disc's type, given its mount directory URI. If
+ * a string pointer is passed to @mrl, it will return the disc's
+ * MRL as from totem_cd_mrl_from_type().
+ *
+ * Note that this function does synchronous I/O.
+ *
+ * If no disc is present in the drive, a #TOTEM_PL_PARSER_ERROR_NO_DISC
+ * error will be returned. On unknown mounting errors, a
+ * #TOTEM_PL_PARSER_ERROR_MOUNT_FAILED error will be returned. On other
+ * I/O errors, or if resolution of symlinked mount paths failed, a code from
+ * #GIOErrorEnum will be returned.
+ *
+ * Return value: #TotemDiscMediaType corresponding to the disc's type, or #MEDIA_TYPE_ERROR on failure
+ **/
+TotemDiscMediaType
+totem_cd_detect_type_from_dir (const char *dir, char **mrl, GError **error)
+{
+  return totem_cd_detect_type_from_dir_cached (dir, mrl, NULL, error);
+}
+
 /**
  * totem_cd_detect_type_with_url:
  * @device: a device node path
@@ -794,27 +1457,33 @@ TotemDiscMediaType
 totem_cd_detect_type_with_url (const char *device,
     			       char      **mrl,
 			       GError     **error)
+{
+  return totem_cd_detect_type_with_label (device, mrl, NULL, error);
+}
+
+static TotemDiscMediaType
+cd_detect_type (const char        *device,
+		CdVolumeSnapshot  *snapshot,
+		char             **mrl,
+		char             **label,
+		GError           **error)
 {
   CdCache *cache;
   TotemDiscMediaType type;
 
   if (mrl != NULL)
     *mrl = NULL;
+  if (label != NULL)
+    *label = NULL;
 
-  if (!(cache = cd_cache_new (device, error)))
+  if (!(cache = cd_cache_new (device, snapshot, error)))
     return MEDIA_TYPE_ERROR;
 
-  type = cd_cache_disc_is_cdda (cache, error);
-  if (type == MEDIA_TYPE_ERROR && *error != NULL) {
-    cd_cache_free (cache);
-    return type;
-  }
+  type = cd_cache_get_type (cache, TRUE, error);
 
-  if ((type == MEDIA_TYPE_DATA || type == MEDIA_TYPE_ERROR) &&
-      (type = cd_cache_disc_is_vcd (cache, error)) == MEDIA_TYPE_DATA &&
-      (type = cd_cache_disc_is_dvd (cache, error)) == MEDIA_TYPE_DATA &&
-      (type = cd_cache_disc_is_bd (cache, error)) == MEDIA_TYPE_DATA) {
-    /* crap, nothing found */
+  if (label != NULL && type != MEDIA_TYPE_ERROR) {
+    *label = cache->label;
+    cache->label = NULL;
   }
 
   if (mrl == NULL) {
@@ -871,6 +1540,8 @@ totem_cd_detect_type_with_url (const char *device,
     if (cache->is_iso) {
       type = MEDIA_TYPE_ERROR;
       /* No error, it's just not usable */
+      if (label != NULL)
+	g_clear_pointer (label, g_free);
     } else {
       *mrl = g_filename_to_uri (cache->mountpoint, NULL, NULL);
       if (*mrl == NULL)
@@ -888,6 +1559,152 @@ totem_cd_detect_type_with_url (const char *device,
   return type;
 }
 
+/*
+ * totem_cd_detect_type_with_label:
+ * @device: a device node path
+ * @mrl: (out) (transfer full) (allow-none): return location for the disc's MRL, or %NULL
+ * @label: (out) (transfer full) (allow-none): return location for the volume label, or %NULL
+ * @error: return location for a #GError, or %NULL
+ *
+ * Like totem_cd_detect_type_with_url(), but also returns the volume
+ * label of ISO images, read while detecting their type. The label is
+ * an empty string if it isn't valid UTF-8, and %NULL for anything but
+ * ISO images.
+ */
+TotemDiscMediaType
+totem_cd_detect_type_with_label (const char  *device,
+				 char       **mrl,
+				 char       **label,
+				 GError     **error)
+{
+  return cd_detect_type (device, NULL, mrl, label, error);
+}
+
+/* Images and directories don't need the main loop or the volume
+ * monitor, so they can be probed from other threads */
+static gboolean
+cd_can_detect_in_thread (const char *device)
+{
+  GStatBuf buf;
+  char *local;
+  gboolean retval;
+
+  local = cd_get_local_path (device);
+  if (local == NULL)
+    return FALSE;
+  retval = (g_stat (local, &buf) == 0 &&
+	    (S_ISDIR (buf.st_mode) || S_ISREG (buf.st_mode)));
+  g_free (local);
+
+  return retval;
+}
+
+static void
+cd_detect_info (TotemDiscInfo *info, CdVolumeSnapshot *snapshot)
+{
+  gint64 start;
+
+  start = g_get_monotonic_time ();
+  info->type = cd_detect_type (info->device, snapshot, &info->mrl, &info->label, &info->error);
+  info->probe_time = g_get_monotonic_time () - start;
+}
+
+static void
+cd_detect_info_thread (gpointer data, gpointer user_data)
+{
+  cd_detect_info (data, NULL);
+}
+
+/**
+ * totem_disc_info_free:
+ * @info: a #TotemDiscInfo
+ *
+ * Frees a #TotemDiscInfo returned by totem_cd_detect_types().
+ *
+ * Since: 3.28
+ **/
+void
+totem_disc_info_free (TotemDiscInfo *info)
+{
+  if (info == NULL)
+    return;
+
+  g_free (info->device);
+  g_free (info->mrl);
+  g_free (info->label);
+  g_clear_error (&info->error);
+  g_free (info);
+}
+
+/**
+ * totem_cd_detect_types:
+ * @devices: (array zero-terminated=1): a %NULL-terminated array of device
+ *   node paths, directories, ISO images or URIs
+ * @max_jobs: the maximum number of images and directories to probe at
+ *   the same time, or 0 for a default based on the number of processors
+ *
+ * Detects the type of many discs at once, as totem_cd_detect_type_with_url()
+ * would for each of them, also returning the volume label of ISO images.
+ *
+ * Images and directories are probed in parallel on up to @max_jobs
+ * threads, while devices are looked up in the calling thread, in a single
+ * snapshot of the system's drives and volumes.
+ *
+ * Note that this function does synchronous I/O.
+ *
+ * Return value: (transfer full) (element-type TotemDiscInfo): an array of
+ *   #TotemDiscInfo, in the same order as @devices
+ *
+ * Since: 3.28
+ **/
+GPtrArray *
+totem_cd_detect_types (const char * const *devices,
+		       guint               max_jobs)
+{
+  GPtrArray *infos, *local_infos;
+  CdVolumeSnapshot *snapshot;
+  GThreadPool *pool;
+  guint i;
+
+  g_return_val_if_fail (devices != NULL, NULL);
+
+  if (max_jobs == 0)
+    max_jobs = MIN (g_get_num_processors (), CD_DETECT_MAX_JOBS);
+
+  infos = g_ptr_array_new_with_free_func ((GDestroyNotify) totem_disc_info_free);
+  local_infos = g_ptr_array_new ();
+  pool = g_thread_pool_new (cd_detect_info_thread, NULL, max_jobs, FALSE, NULL);
+
+  for (i = 0; devices[i] != NULL; i++) {
+    TotemDiscInfo *info;
+
+    info = g_new0 (TotemDiscInfo, 1);
+    info->device = g_strdup (devices[i]);
+    g_ptr_array_add (infos, info);
+
+    if (cd_can_detect_in_thread (info->device))
+      g_thread_pool_push (pool, info, NULL);
+    else
+      g_ptr_array_add (local_infos, info);
+  }
+
+  /* Devices might need mounting, which needs the main loop */
+  snapshot = NULL;
+  for (i = 0; i < local_infos->len; i++) {
+    if (snapshot == NULL)
+      snapshot = cd_volume_snapshot_new ();
+    cd_detect_info (g_ptr_array_index (local_infos, i), snapshot);
+  }
+
+  g_thread_pool_free (pool, FALSE, TRUE);
+
+  if (snapshot != NULL)
+    cd_volume_snapshot_free (snapshot);
+  g_ptr_array_free (local_infos, TRUE);
+
+  return infos;
+}
+
 /**
  * totem_cd_detect_type:
  * @device: a device node path
@@ -920,7 +1737,7 @@ totem_cd_has_medium (const char *device)
   CdCache *cache;
   gboolean retval = TRUE;
 
-  if (!(cache = cd_cache_new (device, NULL)))
+  if (!(cache = cd_cache_new (device, NULL, NULL)))
     return TRUE;
 
   retval = cd_cache_has_medium (cache);
@@ -52,6 +52,28 @@ typedef enum {
 
 #define MediaType TotemDiscMediaType
 
+/**
+ * TotemDiscInfo:
+ * @device: the device node path, directory, image or URI it was detected from
+ * @type: the disc's type, or %MEDIA_TYPE_ERROR on failure
+ * @mrl: the disc's MRL, or %NULL
+ * @label: the volume label of ISO images, or %NULL
+ * @error: the error when @type is %MEDIA_TYPE_ERROR, or %NULL
+ * @probe_time: how long detecting the disc's type took, in microseconds
+ *
+ * The result of detecting a disc's type with totem_cd_detect_types().
+ *
+ * Since: 3.28
+ **/
+typedef struct {
+  char *device;
+  TotemDiscMediaType type;
+  char *mrl;
+  char *label;
+  GError *error;
+  gint64 probe_time;
+} TotemDiscInfo;
+
 GQuark totem_disc_media_type_quark	(void) G_GNUC_CONST;
 #define TOTEM_DISC_MEDIA_TYPE		totem_disc_media_type_quark ()
 
@@ -66,6 +88,9 @@ TotemDiscMediaType	totem_cd_detect_type_from_dir (const char *dir,
 const char *	totem_cd_get_human_readable_name (TotemDiscMediaType type);
 char *		totem_cd_mrl_from_type (const char *scheme, const char *dir);
 gboolean	totem_cd_has_medium (const char  *device);
+GPtrArray *	totem_cd_detect_types (const char * const *devices,
+				       guint               max_jobs);
+void		totem_disc_info_free (TotemDiscInfo *info);
 
 G_END_DECLS
 
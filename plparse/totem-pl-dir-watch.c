@@ -0,0 +1,1125 @@
+/*
+   The Gnome Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   The Gnome Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with the Gnome Library; see the file COPYING.LIB.  If not,
+   write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301  USA.
+ */
+
+/**
+ * SECTION:totem-pl-dir-watch
+ * @short_description: live playlist of a directory
+ * @stability: Unstable
+ * @include: totem-pl-dir-watch.h
+ * @see_also: #TotemPlParser
+ *
+ * #TotemPlDirWatch parses a directory once, the same way
+ * totem_pl_parser_parse() would, and then follows the changes made
+ * to it, reporting only the entries that were added, removed or renamed.
+ *
+ * Entries are kept in the order totem_pl_parser_parse() would give
+ * them, and every signal carries the position the entry has (or had)
+ * in that order, so that a view of the playlist can be kept up to date
+ * without re-parsing the whole directory.
+ *
+ * Files that changed get parsed again on their own, with the
+ * #TotemPlParser the watch was created with, so playlists found in the
+ * directory are followed, and ignored schemes and MIME types apply as
+ * they would for a full parse.
+ *
+ * The watch needs to be used from the thread the #TotemPlParser was
+ * created in, with a running main loop to receive changes.
+ *
+ * <example>
+ *  <title>Keeping a directory's playlist up to date</title>
+ *  <programlisting>
+ * static void
+ * entry_added (TotemPlDirWatch *watch, guint position, const char *uri, GHashTable *metadata, gpointer user_data)
+ * {
+ *	g_print ("Added URI “%s” at %u\n", uri, position);
+ * }
+ *
+ * TotemPlParser *parser = totem_pl_parser_new ();
+ * TotemPlDirWatch *watch = totem_pl_dir_watch_new (parser, dir);
+ * g_signal_connect (G_OBJECT (watch), "entry-added", G_CALLBACK (entry_added), NULL);
+ *
+ * if (totem_pl_dir_watch_start (watch, NULL, &error) == FALSE)
+ *	g_error ("Directory can't be watched: %s", error->message);
+ *  </programlisting>
+ * </example>
+ **/
+
+#include "config.h"
+
+#include <string.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "totem-pl-dir-watch.h"
+#include "totem-disc.h"
+#include "totem-pl-parser-private.h"
+#include "totemplparser-marshal.h"
+
+#define WATCH_ATTRIBUTES G_FILE_ATTRIBUTE_STANDARD_NAME "," \
+			 G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
+			 G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE
+
+#if GLIB_CHECK_VERSION (2, 46, 0)
+#define WATCH_MONITOR_FLAGS G_FILE_MONITOR_WATCH_MOVES
+#else
+#define WATCH_MONITOR_FLAGS G_FILE_MONITOR_SEND_MOVED
+#endif
+
+typedef struct WatchNode WatchNode;
+
+/* A file or directory under the watched directory */
+struct WatchNode {
+	WatchNode *parent;
+	GFile *file;
+	char *name;
+	/* collation key, as used by totem_pl_parser_add_directory() */
+	char *key;
+	gboolean sort_last;
+	guint depth;
+
+	/* Only for directories whose contents are followed,
+	 * name to WatchNode */
+	GHashTable *children;
+	GFileMonitor *monitor;
+
+	/* The entries the parser gave for this file, in order, or %NULL */
+	GPtrArray *entries;
+};
+
+typedef struct {
+	WatchNode *node;
+	guint index;
+	char *uri;
+	GHashTable *metadata;
+	GSequenceIter *iter;
+} WatchEntry;
+
+typedef struct {
+	WatchNode *node;
+	GFileInfo *info;
+} WatchChild;
+
+typedef struct {
+	TotemPlParser *parser;
+	gulong entry_parsed_id;
+	GFile *dir;
+	WatchNode *root;
+	/* All the entries, in playlist order */
+	GSequence *entries;
+	/* Entries being received from the parser, see watch_node_parse() */
+	GPtrArray *collected;
+	/* Disc types of the directories, while scanning */
+	GHashTable *disc_dirs;
+	/* The parser's TotemPlParser:recurse when started */
+	gboolean recurse;
+	/* Whether a directory couldn't be monitored yet */
+	gboolean monitor_failed;
+} TotemPlDirWatchPrivate;
+
+#define TOTEM_PL_DIR_WATCH_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), TOTEM_TYPE_PL_DIR_WATCH, TotemPlDirWatchPrivate))
+
+/* Signals */
+enum {
+	ENTRY_ADDED,
+	ENTRY_REMOVED,
+	ENTRY_RENAMED,
+	LAST_SIGNAL
+};
+
+static guint totem_pl_dir_watch_signals[LAST_SIGNAL];
+
+static void totem_pl_dir_watch_finalize (GObject *object);
+static void watch_node_scan (TotemPlDirWatch *watch,
+			     WatchNode *node,
+			     GCancellable *cancellable);
+
+G_DEFINE_TYPE (TotemPlDirWatch, totem_pl_dir_watch, G_TYPE_OBJECT)
+
+static void
+totem_pl_dir_watch_class_init (TotemPlDirWatchClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->finalize = totem_pl_dir_watch_finalize;
+
+	g_type_class_add_private (klass, sizeof (TotemPlDirWatchPrivate));
+
+	/**
+	 * TotemPlDirWatch::entry-added:
+	 * @watch: the object which received the signal
+	 * @position: the position of the new entry in the playlist
+	 * @uri: the URI of the entry
+	 * @metadata: (type GHashTable) (element-type utf8 utf8): a #GHashTable of metadata relating to the entry,
+	 * as for #TotemPlParser::entry-parsed
+	 *
+	 * The ::entry-added signal is emitted when an entry appears in the directory,
+	 * including for all the entries found by totem_pl_dir_watch_start().
+	 *
+	 * Since: 3.28
+	 **/
+	totem_pl_dir_watch_signals[ENTRY_ADDED] =
+		g_signal_new ("entry-added",
+			      G_TYPE_FROM_CLASS (klass),
+			      G_SIGNAL_RUN_LAST,
+			      G_STRUCT_OFFSET (TotemPlDirWatchClass, entry_added),
+			      NULL, NULL,
+			      _totemplparser_marshal_VOID__UINT_STRING_BOXED,
+			      G_TYPE_NONE, 3, G_TYPE_UINT, G_TYPE_STRING, TOTEM_TYPE_PL_PARSER_METADATA);
+	/**
+	 * TotemPlDirWatch::entry-removed:
+	 * @watch: the object which received the signal
+	 * @position: the position the entry had in the playlist
+	 * @uri: the URI of the entry
+	 *
+	 * The ::entry-removed signal is emitted when an entry goes away from the directory,
+	 * or changed enough that it's now a different entry.
+	 *
+	 * Since: 3.28
+	 **/
+	totem_pl_dir_watch_signals[ENTRY_REMOVED] =
+		g_signal_new ("entry-removed",
+			      G_TYPE_FROM_CLASS (klass),
+			      G_SIGNAL_RUN_LAST,
+			      G_STRUCT_OFFSET (TotemPlDirWatchClass, entry_removed),
+			      NULL, NULL,
+			      _totemplparser_marshal_VOID__UINT_STRING,
+			      G_TYPE_NONE, 2, G_TYPE_UINT, G_TYPE_STRING);
+	/**
+	 * TotemPlDirWatch::entry-renamed:
+	 * @watch: the object which received the signal
+	 * @old_position: the position the entry had in the playlist
+	 * @new_position: the position of the entry in the playlist, once
+	 * removed from @old_position
+	 * @old_uri: the previous URI of the entry
+	 * @new_uri: the new URI of the entry
+	 *
+	 * The ::entry-renamed signal is emitted when a media file is renamed, or moved
+	 * elsewhere in the directory. Its metadata doesn't change.
+	 *
+	 * Moving anything else, such as a sub-directory or a playlist, is reported as
+	 * its entries being removed, and added again.
+	 *
+	 * Since: 3.28
+	 **/
+	totem_pl_dir_watch_signals[ENTRY_RENAMED] =
+		g_signal_new ("entry-renamed",
+			      G_TYPE_FROM_CLASS (klass),
+			      G_SIGNAL_RUN_LAST,
+			      G_STRUCT_OFFSET (TotemPlDirWatchClass, entry_renamed),
+			      NULL, NULL,
+			      _totemplparser_marshal_VOID__UINT_UINT_STRING_STRING,
+			      G_TYPE_NONE, 4, G_TYPE_UINT, G_TYPE_UINT, G_TYPE_STRING, G_TYPE_STRING);
+}
+
+static void
+totem_pl_dir_watch_init (TotemPlDirWatch *watch)
+{
+	TotemPlDirWatchPrivate *priv;
+
+	priv = TOTEM_PL_DIR_WATCH_GET_PRIVATE (watch);
+	priv->entries = g_sequence_new (NULL);
+}
+
+static void
+watch_entry_free (WatchEntry *entry)
+{
+	g_free (entry->uri);
+	g_hash_table_unref (entry->metadata);
+	g_free (entry);
+}
+
+static WatchNode *
+watch_node_new (WatchNode *parent, GFile *file, const char *name)
+{
+	WatchNode *node;
+
+	node = g_new0 (WatchNode, 1);
+	node->parent = parent;
+	node->file = g_object_ref (file);
+	node->name = g_strdup (name);
+	node->sort_last = name[0] == SORT_LAST_CHAR1 || name[0] == SORT_LAST_CHAR2;
+	node->key = g_utf8_collate_key_for_filename (name, -1);
+	if (parent != NULL) {
+		node->depth = parent->depth + 1;
+		g_hash_table_insert (parent->children, node->name, node);
+	}
+
+	return node;
+}
+
+/* Same order as totem_pl_parser_add_directory(), with the names
+ * breaking ties so that the order is always the same */
+static int
+watch_node_compare_siblings (const WatchNode *a, const WatchNode *b)
+{
+	int ret;
+
+	if (a->sort_last && !b->sort_last)
+		return +1;
+	if (!a->sort_last && b->sort_last)
+		return -1;
+	ret = strcmp (a->key, b->key);
+	if (ret == 0)
+		ret = strcmp (a->name, b->name);
+	return ret;
+}
+
+static int
+watch_child_compare (gconstpointer a, gconstpointer b)
+{
+	return watch_node_compare_siblings (((WatchChild *) a)->node, ((WatchChild *) b)->node);
+}
+
+/* Entries are in depth-first order of the nodes they came from */
+static int
+watch_entry_compare (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+	const WatchEntry *entry_a = a, *entry_b = b;
+	const WatchNode *node_a, *node_b;
+
+	node_a = entry_a->node;
+	node_b = entry_b->node;
+	if (node_a == node_b) {
+		if (entry_a->index == entry_b->index)
+			return 0;
+		return entry_a->index < entry_b->index ? -1 : +1;
+	}
+
+	while (node_a->depth > node_b->depth)
+		node_a = node_a->parent;
+	while (node_b->depth > node_a->depth)
+		node_b = node_b->parent;
+	if (node_a == node_b)
+		return entry_a->node->depth < entry_b->node->depth ? -1 : +1;
+
+	while (node_a->parent != node_b->parent) {
+		node_a = node_a->parent;
+		node_b = node_b->parent;
+	}
+
+	return watch_node_compare_siblings (node_a, node_b);
+}
+
+static void
+watch_node_clear_entries (TotemPlDirWatch *watch, WatchNode *node, gboolean notify)
+{
+	guint i;
+
+	if (node->entries == NULL)
+		return;
+
+	for (i = 0; i < node->entries->len; i++) {
+		WatchEntry *entry = g_ptr_array_index (node->entries, i);
+
+		if (notify) {
+			g_signal_emit (watch, totem_pl_dir_watch_signals[ENTRY_REMOVED], 0,
+				       g_sequence_iter_get_position (entry->iter), entry->uri);
+		}
+		g_sequence_remove (entry->iter);
+	}
+
+	g_ptr_array_free (node->entries, TRUE);
+	node->entries = NULL;
+}
+
+static gboolean
+watch_metadata_equal (GHashTable *a, GHashTable *b)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+
+	if (g_hash_table_size (a) != g_hash_table_size (b))
+		return FALSE;
+
+	g_hash_table_iter_init (&iter, a);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		if (g_strcmp0 (value, g_hash_table_lookup (b, key)) != 0)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+watch_entries_equal (GPtrArray *a, GPtrArray *b)
+{
+	guint i;
+
+	if (a->len != b->len)
+		return FALSE;
+
+	for (i = 0; i < a->len; i++) {
+		WatchEntry *entry_a = g_ptr_array_index (a, i);
+		WatchEntry *entry_b = g_ptr_array_index (b, i);
+
+		if (strcmp (entry_a->uri, entry_b->uri) != 0 ||
+		    watch_metadata_equal (entry_a->metadata, entry_b->metadata) == FALSE)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Takes @entries, and reports the difference with what @node had */
+static void
+watch_node_set_entries (TotemPlDirWatch *watch, WatchNode *node, GPtrArray *entries)
+{
+	TotemPlDirWatchPrivate *priv;
+	guint i;
+
+	priv = TOTEM_PL_DIR_WATCH_GET_PRIVATE (watch);
+
+	if (entries->len == 0) {
+		g_ptr_array_free (entries, TRUE);
+		entries = NULL;
+	}
+
+	if (node->entries == NULL && entries == NULL)
+		return;
+	if (node->entries != NULL && entries != NULL &&
+	    watch_entries_equal (node->entries, entries)) {
+		g_ptr_array_free (entries, TRUE);
+		return;
+	}
+
+	watch_node_clear_entries (watch, node, TRUE);
+	node->entries = entries;
+	if (entries == NULL)
+		return;
+
+	for (i = 0; i < entries->len; i++) {
+		WatchEntry *entry = g_ptr_array_index (entries, i);
+
+		entry->node = node;
+		entry->index = i;
+		entry->iter = g_sequence_insert_sorted (priv->entries, entry, watch_entry_compare, NULL);
+		g_signal_emit (watch, totem_pl_dir_watch_signals[ENTRY_ADDED], 0,
+			       g_sequence_iter_get_position (entry->iter), entry->uri, entry->metadata);
+	}
+}
+
+static void
+watch_entry_parsed_cb (TotemPlParser *parser,
+		       const char *uri,
+		       GHashTable *metadata,
+		       TotemPlDirWatch *watch)
+{
+	TotemPlDirWatchPrivate *priv;
+	WatchEntry *entry;
+
+	priv = TOTEM_PL_DIR_WATCH_GET_PRIVATE (watch);
+	if (priv->collected == NULL)
+		return;
+
+	entry = g_new0 (WatchEntry, 1);
+	entry->uri = g_strdup (uri);
+	entry->metadata = g_hash_table_ref (metadata);
+	g_ptr_array_add (priv->collected, entry);
+}
+
+static void
+watch_collect_begin (TotemPlDirWatch *watch)
+{
+	TotemPlDirWatchPrivate *priv;
+
+	priv = TOTEM_PL_DIR_WATCH_GET_PRIVATE (watch);
+	g_assert (priv->collected == NULL);
+	priv->collected = g_ptr_array_new_with_free_func ((GDestroyNotify) watch_entry_free);
+}
+
+static GPtrArray *
+watch_collect_end (TotemPlDirWatch *watch)
+{
+	TotemPlDirWatchPrivate *priv;
+	GPtrArray *entries;
+
+	priv = TOTEM_PL_DIR_WATCH_GET_PRIVATE (watch);
+	entries = priv->collected;
+	priv->collected = NULL;
+
+	return entries;
+}
+
+/* Gives @node's entries, as totem_pl_parser_add_directory() would
+ * for a file in the directory */
+static void
+watch_node_parse (TotemPlDirWatch *watch, WatchNode *node, GFileInfo *info)
+{
+	TotemPlDirWatchPrivate *priv;
+	TotemPlParseData parse_data;
+	TotemPlParserResult ret;
+	const char *content_type;
+
+	priv = TOTEM_PL_DIR_WATCH_GET_PRIVATE (watch);
+
+	watch_collect_begin (watch);
+
+	/* Ignore partial files */
+	content_type = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE);
+	if (g_strcmp0 ("application/x-partial-download", content_type) == 0) {
+		watch_node_set_entries (watch, node, watch_collect_end (watch));
+		return;
+	}
+
+	totem_pl_parser_parse_data_init (priv->parser, &parse_data, FALSE);
+	parse_data.recurse_level = node->depth;
+	ret = totem_pl_parser_parse_internal (priv->parser, node->file, NULL, &parse_data);
+	totem_pl_parser_parse_data_clear (&parse_data);
+
+	if (ret != TOTEM_PL_PARSER_RESULT_SUCCESS &&
+	    ret != TOTEM_PL_PARSER_RESULT_IGNORED &&
+	    ret != TOTEM_PL_PARSER_RESULT_ERROR) {
+		char *uri;
+
+		uri = g_file_get_uri (node->file);
+		totem_pl_parser_add_one_uri (priv->parser, uri, NULL);
+		g_free (uri);
+	}
+
+	watch_node_set_entries (watch, node, watch_collect_end (watch));
+}
+
+static void
+watch_node_free (TotemPlDirWatch *watch, WatchNode *node, gboolean notify)
+{
+	if (node->monitor != NULL) {
+		g_signal_handlers_disconnect_matched (node->monitor, G_SIGNAL_MATCH_DATA,
+						      0, 0, NULL, NULL, node);
+		g_file_monitor_cancel (node->monitor);
+		g_object_unref (node->monitor);
+	}
+
+	if (node->children != NULL) {
+		GList *children, *l;
+
+		children = g_hash_table_get_values (node->children);
+		for (l = children; l != NULL; l = l->next)
+			watch_node_free (watch, l->data, notify);
+		g_list_free (children);
+		g_hash_table_destroy (node->children);
+	}
+
+	watch_node_clear_entries (watch, node, notify);
+
+	g_object_unref (node->file);
+	g_free (node->name);
+	g_free (node->key);
+	g_free (node);
+}
+
+static void
+watch_node_remove (TotemPlDirWatch *watch, WatchNode *node)
+{
+	g_hash_table_remove (node->parent->children, node->name);
+	watch_node_free (watch, node, TRUE);
+}
+
+/* Finds the node for @file, if it's being watched */
+static WatchNode *
+watch_lookup_node (TotemPlDirWatch *watch, GFile *file)
+{
+	TotemPlDirWatchPrivate *priv;
+	WatchNode *node;
+	char *path;
+	char **components;
+	guint i;
+
+	priv = TOTEM_PL_DIR_WATCH_GET_PRIVATE (watch);
+	if (g_file_equal (priv->root->file, file))
+		return priv->root;
+
+	path = g_file_get_relative_path (priv->root->file, file);
+	if (path == NULL)
+		return NULL;
+
+	components = g_strsplit (path, G_DIR_SEPARATOR_S, -1);
+	g_free (path);
+
+	node = priv->root;
+	for (i = 0; components[i] != NULL && node != NULL; i++) {
+		if (node->children == NULL)
+			node = NULL;
+		else
+			node = g_hash_table_lookup (node->children, components[i]);
+	}
+	g_strfreev (components);
+
+	return node;
+}
+
+static void
+watch_node_add_child (TotemPlDirWatch *watch,
+		      WatchNode *dir,
+		      GFile *file,
+		      GFileInfo *info,
+		      GCancellable *cancellable)
+{
+	TotemPlDirWatchPrivate *priv;
+	WatchNode *node;
+
+	priv = TOTEM_PL_DIR_WATCH_GET_PRIVATE (watch);
+
+	node = watch_node_new (dir, file, g_file_info_get_name (info));
+	if (priv->recurse &&
+	    g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
+		watch_node_scan (watch, node, cancellable);
+	else
+		watch_node_parse (watch, node, info);
+}
+
+static void
+watch_file_created (TotemPlDirWatch *watch, WatchNode *dir, GFile *file);
+
+static void
+watch_file_changed (TotemPlDirWatch *watch, WatchNode *dir, GFile *file)
+{
+	TotemPlDirWatchPrivate *priv;
+	WatchNode *node;
+	GFileInfo *info;
+	char *name;
+
+	priv = TOTEM_PL_DIR_WATCH_GET_PRIVATE (watch);
+
+	name = g_file_get_basename (file);
+	node = g_hash_table_lookup (dir->children, name);
+	g_free (name);
+
+	if (node == NULL) {
+		watch_file_created (watch, dir, file);
+		return;
+	}
+
+	/* Directories' own changes don't matter */
+	if (node->children != NULL)
+		return;
+
+	info = g_file_query_info (file, WATCH_ATTRIBUTES, G_FILE_QUERY_INFO_NONE, NULL, NULL);
+	if (info == NULL)
+		return;
+
+	/* A directory to follow now, it should be handled as new */
+	if (priv->recurse &&
+	    g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
+		watch_node_remove (watch, node);
+		watch_node_add_child (watch, dir, file, info, NULL);
+	} else {
+		watch_node_parse (watch, node, info);
+	}
+	g_object_unref (info);
+}
+
+static void
+watch_file_created (TotemPlDirWatch *watch, WatchNode *dir, GFile *file)
+{
+	GFileInfo *info;
+	char *name;
+	gboolean exists;
+
+	name = g_file_get_basename (file);
+	exists = g_hash_table_contains (dir->children, name);
+	g_free (name);
+
+	if (exists) {
+		watch_file_changed (watch, dir, file);
+		return;
+	}
+
+	info = g_file_query_info (file, WATCH_ATTRIBUTES, G_FILE_QUERY_INFO_NONE, NULL, NULL);
+	if (info == NULL)
+		return;
+	watch_node_add_child (watch, dir, file, info, NULL);
+	g_object_unref (info);
+}
+
+static void
+watch_file_deleted (TotemPlDirWatch *watch, WatchNode *dir, GFile *file)
+{
+	WatchNode *node;
+	char *name;
+
+	name = g_file_get_basename (file);
+	node = g_hash_table_lookup (dir->children, name);
+	g_free (name);
+
+	if (node != NULL)
+		watch_node_remove (watch, node);
+}
+
+/* A plain media file, whose only entry is itself, can just be renamed
+ * when its name doesn't make the parser see it differently */
+static gboolean
+watch_node_can_rename (WatchNode *node, WatchNode *dest_dir, GFile *dest)
+{
+	WatchEntry *entry;
+	char *uri, *name, *old_type, *new_type;
+	gboolean ret;
+
+	if (node->children != NULL ||
+	    node->entries == NULL ||
+	    node->entries->len != 1 ||
+	    dest_dir->depth != node->parent->depth)
+		return FALSE;
+
+	entry = g_ptr_array_index (node->entries, 0);
+	uri = g_file_get_uri (node->file);
+	ret = g_str_equal (uri, entry->uri);
+	g_free (uri);
+	if (ret == FALSE)
+		return FALSE;
+
+	name = g_file_get_basename (dest);
+	old_type = g_content_type_guess (node->name, NULL, 0, NULL);
+	new_type = g_content_type_guess (name, NULL, 0, NULL);
+	ret = g_content_type_equals (old_type, new_type);
+	g_free (old_type);
+	g_free (new_type);
+	g_free (name);
+
+	return ret;
+}
+
+static void
+watch_node_rename (TotemPlDirWatch *watch, WatchNode *node, WatchNode *dest_dir, GFile *dest)
+{
+	WatchEntry *entry;
+	char *name, *old_uri;
+	gint old_position;
+
+	entry = g_ptr_array_index (node->entries, 0);
+	old_position = g_sequence_iter_get_position (entry->iter);
+
+	g_hash_table_remove (node->parent->children, node->name);
+	name = g_file_get_basename (dest);
+	g_free (node->name);
+	g_free (node->key);
+	node->name = name;
+	node->sort_last = name[0] == SORT_LAST_CHAR1 || name[0] == SORT_LAST_CHAR2;
+	node->key = g_utf8_collate_key_for_filename (name, -1);
+	node->parent = dest_dir;
+	g_object_unref (node->file);
+	node->file = g_object_ref (dest);
+	g_hash_table_insert (dest_dir->children, node->name, node);
+
+	old_uri = entry->uri;
+	entry->uri = g_file_get_uri (dest);
+	g_sequence_sort_changed (entry->iter, watch_entry_compare, NULL);
+
+	g_signal_emit (watch, totem_pl_dir_watch_signals[ENTRY_RENAMED], 0,
+		       old_position, g_sequence_iter_get_position (entry->iter),
+		       old_uri, entry->uri);
+	g_free (old_uri);
+}
+
+static void
+watch_file_moved (TotemPlDirWatch *watch, GFile *file, GFile *dest)
+{
+	WatchNode *node, *dest_dir, *existing;
+	GFile *dest_parent;
+	char *name;
+
+	node = watch_lookup_node (watch, file);
+
+	dest_dir = NULL;
+	if (dest != NULL) {
+		dest_parent = g_file_get_parent (dest);
+		if (dest_parent != NULL) {
+			dest_dir = watch_lookup_node (watch, dest_parent);
+			g_object_unref (dest_parent);
+		}
+		if (dest_dir != NULL && dest_dir->children == NULL)
+			dest_dir = NULL;
+	}
+
+	if (node == NULL || node->parent == NULL) {
+		if (dest_dir != NULL)
+			watch_file_created (watch, dest_dir, dest);
+		return;
+	}
+	if (dest_dir == NULL) {
+		watch_node_remove (watch, node);
+		return;
+	}
+
+	/* Replacing another file */
+	name = g_file_get_basename (dest);
+	existing = g_hash_table_lookup (dest_dir->children, name);
+	g_free (name);
+	if (existing == node)
+		return;
+	if (existing != NULL)
+		watch_node_remove (watch, existing);
+
+	if (watch_node_can_rename (node, dest_dir, dest)) {
+		watch_node_rename (watch, node, dest_dir, dest);
+	} else {
+		watch_node_remove (watch, node);
+		watch_file_created (watch, dest_dir, dest);
+	}
+}
+
+static void
+watch_monitor_changed_cb (GFileMonitor *monitor,
+			  GFile *file,
+			  GFile *other_file,
+			  GFileMonitorEvent event_type,
+			  WatchNode *dir)
+{
+	TotemPlDirWatch *watch;
+	TotemPlDirWatchPrivate *priv;
+	GFile *parent;
+	gboolean is_child;
+
+	watch = g_object_get_data (G_OBJECT (monitor), "totem-pl-dir-watch");
+	priv = TOTEM_PL_DIR_WATCH_GET_PRIVATE (watch);
+
+	/* The watched directory itself going away */
+	if (g_file_equal (file, dir->file)) {
+		if (dir == priv->root &&
+		    event_type == G_FILE_MONITOR_EVENT_DELETED) {
+			GList *children, *l;
+
+			children = g_hash_table_get_values (dir->children);
+			for (l = children; l != NULL; l = l->next)
+				watch_node_remove (watch, l->data);
+			g_list_free (children);
+		}
+		return;
+	}
+
+	parent = g_file_get_parent (file);
+	is_child = parent != NULL && g_file_equal (parent, dir->file);
+	g_clear_object (&parent);
+	if (is_child == FALSE)
+		return;
+
+	switch (event_type) {
+	case G_FILE_MONITOR_EVENT_CREATED:
+		watch_file_created (watch, dir, file);
+		break;
+	case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+		watch_file_changed (watch, dir, file);
+		break;
+	case G_FILE_MONITOR_EVENT_DELETED:
+		watch_file_deleted (watch, dir, file);
+		break;
+#if GLIB_CHECK_VERSION (2, 46, 0)
+	case G_FILE_MONITOR_EVENT_RENAMED:
+	case G_FILE_MONITOR_EVENT_MOVED_OUT:
+		watch_file_moved (watch, file, other_file);
+		break;
+	case G_FILE_MONITOR_EVENT_MOVED_IN:
+		/* Already handled if the other side was watched too */
+		if (other_file != NULL && watch_lookup_node (watch, other_file) != NULL)
+			watch_file_moved (watch, other_file, file);
+		else
+			watch_file_created (watch, dir, file);
+		break;
+#else
+	case G_FILE_MONITOR_EVENT_MOVED:
+		watch_file_moved (watch, file, other_file);
+		break;
+#endif
+	case G_FILE_MONITOR_EVENT_CHANGED:
+	case G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED:
+	case G_FILE_MONITOR_EVENT_PRE_UNMOUNT:
+	case G_FILE_MONITOR_EVENT_UNMOUNTED:
+	default:
+		break;
+	}
+}
+
+/* A directory that can't be monitored still gets listed, its changes
+ * just aren't followed */
+static void
+watch_node_monitor (TotemPlDirWatch *watch, WatchNode *node, GCancellable *cancellable)
+{
+	TotemPlDirWatchPrivate *priv;
+	GError *error = NULL;
+
+	priv = TOTEM_PL_DIR_WATCH_GET_PRIVATE (watch);
+
+	node->monitor = g_file_monitor_directory (node->file, WATCH_MONITOR_FLAGS, cancellable, &error);
+	if (node->monitor == NULL) {
+		/* Only warn once, running out of inotify watches,
+		 * the usual cause, makes all the others fail too */
+		if (priv->monitor_failed == FALSE &&
+		    g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED) == FALSE) {
+			char *uri;
+
+			uri = g_file_get_uri (node->file);
+			g_warning ("Changes to '%s' won't be followed: %s", uri, error->message);
+			g_free (uri);
+			priv->monitor_failed = TRUE;
+		}
+		g_error_free (error);
+		return;
+	}
+
+	g_object_set_data (G_OBJECT (node->monitor), "totem-pl-dir-watch", watch);
+	g_signal_connect (G_OBJECT (node->monitor), "changed",
+			  G_CALLBACK (watch_monitor_changed_cb), node);
+}
+
+static gboolean
+watch_node_list (TotemPlDirWatch *watch, WatchNode *node, GCancellable *cancellable, GError **error)
+{
+	TotemPlDirWatchPrivate *priv;
+	GFileEnumerator *e;
+	GFileInfo *info;
+	GArray *children;
+	guint i;
+
+	priv = TOTEM_PL_DIR_WATCH_GET_PRIVATE (watch);
+
+	/* Start watching before listing, so nothing gets missed */
+	watch_node_monitor (watch, node, cancellable);
+
+	e = g_file_enumerate_children (node->file,
+				       WATCH_ATTRIBUTES,
+				       G_FILE_QUERY_INFO_NONE,
+				       cancellable, error);
+	if (e == NULL)
+		return FALSE;
+
+	children = g_array_new (FALSE, FALSE, sizeof (WatchChild));
+	while ((info = g_file_enumerator_next_file (e, cancellable, NULL)) != NULL) {
+		WatchChild child;
+		GFile *file;
+
+		file = g_file_get_child (node->file, g_file_info_get_name (info));
+		child.node = watch_node_new (node, file, g_file_info_get_name (info));
+		child.info = info;
+		g_array_append_val (children, child);
+		g_object_unref (file);
+	}
+	g_file_enumerator_close (e, NULL, NULL);
+	g_object_unref (e);
+
+	/* Scanning in playlist order makes all the entries get
+	 * appended, each after the previous one */
+	g_array_sort (children, watch_child_compare);
+
+	for (i = 0; i < children->len; i++) {
+		WatchChild *child = &g_array_index (children, WatchChild, i);
+
+		if (g_cancellable_is_cancelled (cancellable) == FALSE) {
+			if (priv->recurse &&
+			    g_file_info_get_file_type (child->info) == G_FILE_TYPE_DIRECTORY)
+				watch_node_scan (watch, child->node, cancellable);
+			else
+				watch_node_parse (watch, child->node, child->info);
+		}
+		g_object_unref (child->info);
+	}
+	g_array_free (children, TRUE);
+
+	return g_cancellable_set_error_if_cancelled (cancellable, error) == FALSE;
+}
+
+/* Gives @node's entries, as totem_pl_parser_add_directory() would
+ * for a directory */
+static gboolean
+watch_node_scan_full (TotemPlDirWatch *watch, WatchNode *node, GCancellable *cancellable, GError **error)
+{
+	TotemPlDirWatchPrivate *priv;
+	TotemDiscMediaType type;
+	char *uri, *media_uri;
+	gboolean free_disc_dirs, ret;
+
+	priv = TOTEM_PL_DIR_WATCH_GET_PRIVATE (watch);
+
+	if (node->depth > RECURSE_LEVEL_MAX)
+		return TRUE;
+
+	free_disc_dirs = FALSE;
+	if (priv->disc_dirs == NULL) {
+		priv->disc_dirs = totem_cd_dir_cache_new ();
+		free_disc_dirs = TRUE;
+	}
+
+	ret = TRUE;
+	media_uri = NULL;
+	uri = g_file_get_uri (node->file);
+	type = totem_cd_detect_type_from_dir_cached (uri, &media_uri, priv->disc_dirs, NULL);
+	g_free (uri);
+
+	if (type != MEDIA_TYPE_DATA && type != MEDIA_TYPE_ERROR && media_uri != NULL) {
+		char *base_name = NULL, *fname;
+
+		fname = g_file_get_path (node->file);
+		if (fname != NULL) {
+			base_name = g_filename_display_basename (fname);
+			g_free (fname);
+		}
+		watch_collect_begin (watch);
+		totem_pl_parser_add_one_uri (priv->parser, media_uri, base_name);
+		watch_node_set_entries (watch, node, watch_collect_end (watch));
+		g_free (base_name);
+	} else if (node->depth < RECURSE_LEVEL_MAX) {
+		/* Deeper than this, the parser wouldn't give anything */
+		node->children = g_hash_table_new (g_str_hash, g_str_equal);
+		ret = watch_node_list (watch, node, cancellable, error);
+	}
+	g_free (media_uri);
+
+	if (free_disc_dirs)
+		g_clear_pointer (&priv->disc_dirs, g_hash_table_destroy);
+
+	return ret;
+}
+
+/* A sub-directory that can't be listed has no entries,
+ * as with totem_pl_parser_parse() */
+static void
+watch_node_scan (TotemPlDirWatch *watch, WatchNode *node, GCancellable *cancellable)
+{
+	TotemPlParser *parser;
+	GError *error = NULL;
+
+	parser = TOTEM_PL_DIR_WATCH_GET_PRIVATE (watch)->parser;
+
+	if (watch_node_scan_full (watch, node, cancellable, &error) == FALSE) {
+		DEBUG(PARSE, node->file, g_print ("Couldn't list '%s': %s\n", uri, error->message));
+		g_error_free (error);
+	}
+}
+
+static void
+totem_pl_dir_watch_finalize (GObject *object)
+{
+	TotemPlDirWatchPrivate *priv;
+
+	priv = TOTEM_PL_DIR_WATCH_GET_PRIVATE (object);
+
+	if (priv->root != NULL)
+		watch_node_free (TOTEM_PL_DIR_WATCH (object), priv->root, FALSE);
+	g_sequence_free (priv->entries);
+	if (priv->parser != NULL) {
+		g_signal_handler_disconnect (priv->parser, priv->entry_parsed_id);
+		g_object_unref (priv->parser);
+	}
+	g_clear_object (&priv->dir);
+
+	G_OBJECT_CLASS (totem_pl_dir_watch_parent_class)->finalize (object);
+}
+
+/**
+ * totem_pl_dir_watch_new:
+ * @parser: a #TotemPlParser
+ * @dir: the directory to watch
+ *
+ * Creates a new #TotemPlDirWatch object, which will use @parser to parse
+ * the files in @dir. Its #TotemPlParser:recurse property says whether
+ * sub-directories are followed, as for totem_pl_parser_parse().
+ *
+ * @parser's own signals, such as #TotemPlParser::entry-parsed, are emitted
+ * too while the watch parses files, so it's best to give the watch a parser
+ * that isn't used for anything else.
+ *
+ * Returns: The newly created #TotemPlDirWatch
+ *
+ * Since: 3.28
+ **/
+TotemPlDirWatch *
+totem_pl_dir_watch_new (TotemPlParser *parser, GFile *dir)
+{
+	TotemPlDirWatch *watch;
+	TotemPlDirWatchPrivate *priv;
+
+	g_return_val_if_fail (TOTEM_IS_PL_PARSER (parser), NULL);
+	g_return_val_if_fail (G_IS_FILE (dir), NULL);
+
+	watch = g_object_new (TOTEM_TYPE_PL_DIR_WATCH, NULL);
+	priv = TOTEM_PL_DIR_WATCH_GET_PRIVATE (watch);
+	priv->parser = g_object_ref (parser);
+	priv->dir = g_object_ref (dir);
+	priv->entry_parsed_id = g_signal_connect (G_OBJECT (parser), "entry-parsed",
+						  G_CALLBACK (watch_entry_parsed_cb), watch);
+
+	return watch;
+}
+
+/**
+ * totem_pl_dir_watch_start:
+ * @watch: a #TotemPlDirWatch
+ * @cancellable: (allow-none): optional #GCancellable object, or %NULL
+ * @error: return location for a #GError, or %NULL
+ *
+ * Parses the watched directory, emitting #TotemPlDirWatch::entry-added for
+ * each of its entries in order, and starts following its changes.
+ *
+ * Directories that can't be monitored, for example because the system's
+ * limit of watches was reached, still have their entries reported, but their
+ * changes aren't followed, and a warning is printed. The same goes for a
+ * directory that is the root of a video disc, such as a DVD's: its only
+ * entry is the disc itself, and the files in it aren't watched.
+ *
+ * Returns: %TRUE if the directory was parsed, %FALSE if it couldn't
+ * be read, or if @cancellable was cancelled
+ *
+ * Since: 3.28
+ **/
+gboolean
+totem_pl_dir_watch_start (TotemPlDirWatch *watch,
+			  GCancellable *cancellable,
+			  GError **error)
+{
+	TotemPlDirWatchPrivate *priv;
+	char *name;
+
+	g_return_val_if_fail (TOTEM_IS_PL_DIR_WATCH (watch), FALSE);
+
+	priv = TOTEM_PL_DIR_WATCH_GET_PRIVATE (watch);
+	g_return_val_if_fail (priv->root == NULL, FALSE);
+
+	g_object_get (G_OBJECT (priv->parser), "recurse", &priv->recurse, NULL);
+
+	name = g_file_get_basename (priv->dir);
+	priv->root = watch_node_new (NULL, priv->dir, name ? name : "");
+	g_free (name);
+
+	if (watch_node_scan_full (watch, priv->root, cancellable, error) == FALSE) {
+		/* Take back what was already reported */
+		watch_node_free (watch, priv->root, TRUE);
+		priv->root = NULL;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * totem_pl_dir_watch_get_n_entries:
+ * @watch: a #TotemPlDirWatch
+ *
+ * Returns the number of entries currently in the watched directory's playlist.
+ *
+ * Returns: The number of entries
+ *
+ * Since: 3.28
+ **/
+guint
+totem_pl_dir_watch_get_n_entries (TotemPlDirWatch *watch)
+{
+	TotemPlDirWatchPrivate *priv;
+
+	g_return_val_if_fail (TOTEM_IS_PL_DIR_WATCH (watch), 0);
+
+	priv = TOTEM_PL_DIR_WATCH_GET_PRIVATE (watch);
+
+	return g_sequence_get_length (priv->entries);
+}
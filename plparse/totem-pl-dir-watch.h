@@ -0,0 +1,88 @@
+/*
+   The Gnome Library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   The Gnome Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public
+   License along with the Gnome Library; see the file COPYING.LIB.  If not,
+   write to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301  USA.
+ */
+
+#ifndef __TOTEM_PL_DIR_WATCH_H__
+#define __TOTEM_PL_DIR_WATCH_H__
+
+#include <glib-object.h>
+#include <gio/gio.h>
+
+#include "totem-pl-parser.h"
+
+G_BEGIN_DECLS
+
+#define TOTEM_TYPE_PL_DIR_WATCH            (totem_pl_dir_watch_get_type ())
+#define TOTEM_PL_DIR_WATCH(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), TOTEM_TYPE_PL_DIR_WATCH, TotemPlDirWatch))
+#define TOTEM_PL_DIR_WATCH_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), TOTEM_TYPE_PL_DIR_WATCH, TotemPlDirWatchClass))
+#define TOTEM_IS_PL_DIR_WATCH(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TOTEM_TYPE_PL_DIR_WATCH))
+#define TOTEM_IS_PL_DIR_WATCH_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), TOTEM_TYPE_PL_DIR_WATCH))
+
+/**
+ * TotemPlDirWatch:
+ *
+ * All the fields in the #TotemPlDirWatch structure are private and should never be accessed directly.
+ *
+ * Since: 3.28
+ **/
+typedef struct {
+	GObject parent_instance;
+} TotemPlDirWatch;
+
+/**
+ * TotemPlDirWatchClass:
+ * @parent_class: the parent class
+ * @entry_added: the generic signal handler for the #TotemPlDirWatch::entry-added signal,
+ * which can be overridden by inheriting classes
+ * @entry_removed: the generic signal handler for the #TotemPlDirWatch::entry-removed signal,
+ * which can be overridden by inheriting classes
+ * @entry_renamed: the generic signal handler for the #TotemPlDirWatch::entry-renamed signal,
+ * which can be overridden by inheriting classes
+ *
+ * The class structure for the #TotemPlDirWatch type.
+ *
+ * Since: 3.28
+ **/
+typedef struct {
+	GObjectClass parent_class;
+
+	/* signals */
+	void (*entry_added) (TotemPlDirWatch *watch,
+			     guint position,
+			     const char *uri,
+			     GHashTable *metadata);
+	void (*entry_removed) (TotemPlDirWatch *watch,
+			       guint position,
+			       const char *uri);
+	void (*entry_renamed) (TotemPlDirWatch *watch,
+			       guint old_position,
+			       guint new_position,
+			       const char *old_uri,
+			       const char *new_uri);
+} TotemPlDirWatchClass;
+
+GType totem_pl_dir_watch_get_type (void) G_GNUC_CONST;
+
+TotemPlDirWatch *totem_pl_dir_watch_new	(TotemPlParser *parser,
+					 GFile *dir);
+gboolean totem_pl_dir_watch_start	(TotemPlDirWatch *watch,
+					 GCancellable *cancellable,
+					 GError **error);
+guint totem_pl_dir_watch_get_n_entries	(TotemPlDirWatch *watch);
+
+G_END_DECLS
+
+#endif /* __TOTEM_PL_DIR_WATCH_H__ */
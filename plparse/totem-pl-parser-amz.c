@@ -133,7 +133,7 @@ totem_pl_parser_add_amz (TotemPlParser *parser,
 	TotemPlParserResult ret;
 	gsize b64len;
 
-	if (g_file_load_contents (file, NULL, &b64data, &b64len, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (file, parse_data, &b64data, &b64len) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
 	if (amzfile_decrypt_blob (b64data, b64len, &contents) == FALSE) {
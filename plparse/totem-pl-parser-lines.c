@@ -260,7 +260,7 @@ totem_pl_parser_add_ram (TotemPlParser *parser, GFile *file, TotemPlParseData *p
 	gsize size;
 	guint i;
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (file, parse_data, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
 	lines = g_strsplit_set (contents, "\r\n", 0);
@@ -377,6 +377,18 @@ totem_pl_parser_get_extvlcopt_audio_track (const char *line)
 	return g_strdup_printf ("%d", id);
 }
 
+/* The local file an M3U line will get parsed as, if any */
+static GFile *
+totem_pl_parser_m3u_line_get_local_file (const char *line)
+{
+	for (; g_ascii_isspace (line[0]); line++)
+		;
+
+	if (line[0] == G_DIR_SEPARATOR || g_str_has_prefix (line, "file://"))
+		return g_file_new_for_commandline_arg (line);
+	return NULL;
+}
+
 TotemPlParserResult
 totem_pl_parser_add_m3u (TotemPlParser *parser,
 			 GFile *file,
@@ -391,9 +403,12 @@ totem_pl_parser_add_m3u (TotemPlParser *parser,
 	gboolean dos_mode = FALSE;
 	const char *extinfo, *extvlcopt_audiotrack;
 	char *pl_uri;
+	TotemPlParserResolveBase *relative_base;
+	TotemPlParserSniffBatch *batch;
+	guint next_sniff;
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE) {
-		DEBUG (file, g_print ("Failed to load '%s'\n", uri));
+	if (totem_pl_parser_load_contents (file, parse_data, &contents, &size) == FALSE) {
+		DEBUG (FORMAT, file, g_print ("Failed to load '%s'\n", uri));
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 	}
 
@@ -401,7 +416,7 @@ totem_pl_parser_add_m3u (TotemPlParser *parser,
 	if (g_str_has_prefix (contents, "[playlist]") != FALSE
 			|| g_str_has_prefix (contents, "[Playlist]") != FALSE
 			|| g_str_has_prefix (contents, "[PLAYLIST]") != FALSE) {
-		DEBUG (file, g_print ("Parsing '%s' playlist as PLS\n", uri));
+		DEBUG (FORMAT, file, g_print ("Parsing '%s' playlist as PLS\n", uri));
 		retval = totem_pl_parser_add_pls_with_contents (parser, file, base_file, contents, parse_data);
 		g_free (contents);
 		return retval;
@@ -409,7 +424,7 @@ totem_pl_parser_add_m3u (TotemPlParser *parser,
 
 	if (strstr (contents, EXTINF_HLS) ||
 	    strstr (contents, EXTINF_HLS2)) {
-		DEBUG (file, g_print ("Unhandled HLS playlist '%s', should be passed to player\n", uri));
+		DEBUG (FORMAT, file, g_print ("Unhandled HLS playlist '%s', should be passed to player\n", uri));
 		g_free (contents);
 		return retval;
 	}
@@ -429,6 +444,9 @@ totem_pl_parser_add_m3u (TotemPlParser *parser,
 	extinfo = NULL;
 	extvlcopt_audiotrack = NULL;
 
+	/* Created on the first relative entry, and shared by all the others */
+	relative_base = NULL;
+
 	/* figure out whether we're a unix m3u or dos m3u */
 	if (strstr(contents, "\x0d")) {
 		dos_mode = TRUE;
@@ -448,12 +466,24 @@ totem_pl_parser_add_m3u (TotemPlParser *parser,
 				 TOTEM_PL_PARSER_FIELD_CONTENT_TYPE, "audio/x-mpegurl",
 				 NULL);
 
+	batch = totem_pl_parser_sniff_batch_new (parser);
+	next_sniff = 0;
+
 	for (i = 0; lines[i] != NULL; i++) {
 		const char *line;
 		char *length;
 		gint64 length_num = 0;
 		char *audio_track;
 
+		/* Start reading the next local files, for those that need sniffing */
+		for (; lines[next_sniff] != NULL && next_sniff <= i + SNIFF_MAX_AHEAD; next_sniff++) {
+			GFile *next_file;
+
+			next_file = totem_pl_parser_m3u_line_get_local_file (lines[next_sniff]);
+			totem_pl_parser_sniff_batch_add (batch, next_file, parse_data);
+			g_clear_object (&next_file);
+		}
+
 		line = lines[i];
 
 		if (line[0] == '\0')
@@ -484,18 +514,26 @@ totem_pl_parser_add_m3u (TotemPlParser *parser,
 		/* Either it's a URI, or it has a proper path ... */
 		if (strstr(line, "://") != NULL
 				|| line[0] == G_DIR_SEPARATOR) {
-			GFile *uri;
-
-			uri = g_file_new_for_commandline_arg (line);
-			if (length_num < 0 ||
-			    totem_pl_parser_parse_internal (parser, uri, NULL, parse_data) != TOTEM_PL_PARSER_RESULT_SUCCESS) {
+			TotemPlParserResult ret = TOTEM_PL_PARSER_RESULT_UNHANDLED;
+
+			/* Streams are added straight away, so only create
+			 * a GFile if we're going to recurse into the entry */
+			if (length_num >= 0) {
+				GFile *uri;
+
+				uri = g_file_new_for_commandline_arg (line);
+				totem_pl_parser_sniff_batch_claim (batch, i, parse_data);
+				ret = totem_pl_parser_parse_internal (parser, uri, NULL, parse_data);
+				totem_pl_parser_sniff_batch_release (batch, i, parse_data);
+				g_object_unref (uri);
+			}
+			if (ret != TOTEM_PL_PARSER_RESULT_SUCCESS) {
 				totem_pl_parser_add_uri (parser,
 							 TOTEM_PL_PARSER_FIELD_URI, line,
 							 TOTEM_PL_PARSER_FIELD_TITLE, totem_pl_parser_get_extinfo_title (extinfo),
 							 TOTEM_PL_PARSER_FIELD_AUDIO_TRACK, audio_track,
 							 NULL);
 			}
-			g_object_unref (uri);
 		} else if (g_ascii_isalpha (line[0]) != FALSE
 			   && g_str_has_prefix (line + 1, ":\\")) {
 			/* Path relative to a drive on Windows, we need to use
@@ -530,21 +568,26 @@ totem_pl_parser_add_m3u (TotemPlParser *parser,
 			g_free (tmpuri);
 		} else {
 			/* Try with a base */
-			GFile *uri, *_base_file;
+			char *uri;
 			char sep;
 
-			_base_file = g_file_get_parent (file);
+			if (relative_base == NULL) {
+				GFile *parent;
+
+				parent = g_file_get_parent (file);
+				relative_base = totem_pl_parser_resolve_base_new_for_dir (parent);
+				g_object_unref (parent);
+			}
 			sep = (dos_mode ? '\\' : '/');
 			if (sep == '\\')
 				lines[i] = g_strdelimit (lines[i], "\\", '/');
-			uri = g_file_get_child (_base_file, line);
-			g_object_unref (_base_file);
+			uri = totem_pl_parser_resolve_base_child_uri (relative_base, line);
 			totem_pl_parser_add_uri (parser,
-						 TOTEM_PL_PARSER_FIELD_FILE, uri,
+						 TOTEM_PL_PARSER_FIELD_URI, uri,
 						 TOTEM_PL_PARSER_FIELD_TITLE, totem_pl_parser_get_extinfo_title (extinfo),
 						 TOTEM_PL_PARSER_FIELD_AUDIO_TRACK, audio_track,
 						 NULL);
-			g_object_unref (uri);
+			g_free (uri);
 		}
 		extinfo = NULL;
 		extvlcopt_audiotrack = NULL;
@@ -552,7 +595,9 @@ totem_pl_parser_add_m3u (TotemPlParser *parser,
 		g_free (audio_track);
 	}
 
+	totem_pl_parser_sniff_batch_free (batch);
 	g_strfreev (lines);
+	totem_pl_parser_resolve_base_free (relative_base);
 
 	totem_pl_parser_playlist_end (parser, pl_uri);
 	g_free (pl_uri);
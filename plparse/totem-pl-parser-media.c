@@ -35,84 +35,7 @@
 #include "totem-pl-parser-media.h"
 #include "totem-pl-parser-private.h"
 
-/* Files that start with these characters sort after files that don't. */
-#define SORT_LAST_CHAR1 '.'
-#define SORT_LAST_CHAR2 '#'
-
 #ifndef TOTEM_PL_PARSER_MINI
-/* Returns NULL if we don't have an ISO image,
- * or an empty string if it's non-UTF-8 data */
-static char *
-totem_pl_parser_iso_get_title (GFile *_file)
-{
-	char *fname;
-	FILE  *file;
-#define BUFFER_SIZE 128
-	char buf [BUFFER_SIZE+1];
-	int res;
-	char *str;
-
-	fname = g_file_get_path (_file);
-	if (fname == NULL)
-		return NULL;
-
-	file = fopen (fname, "rb");
-	g_free (fname);
-	if (file == NULL)
-		return NULL;
-
-	/* Verify we have an ISO image */
-	/* This check is for the raw sector images */
-	res = fseek (file, 37633L, SEEK_SET);
-	if (res != 0) {
-		fclose (file);
-		return NULL;
-	}
-
-	res = fread (buf, sizeof (char), 5, file);
-	if (res != 5 || strncmp (buf, "CD001", 5) != 0) {
-		/* Standard ISO images */
-		res = fseek (file, 32769L, SEEK_SET);
-		if (res != 0) {
-			fclose (file);
-			return NULL;
-		}
-		res = fread (buf, sizeof (char), 5, file);
-		if (res != 5 || strncmp (buf, "CD001", 5) != 0) {
-			/* High Sierra images */
-			res = fseek (file, 32776L, SEEK_SET);
-			if (res != 0) {
-				fclose (file);
-				return NULL;
-			}
-			res = fread (buf, sizeof (char), 5, file);
-			if (res != 5 || strncmp (buf, "CDROM", 5) != 0) {
-				fclose (file);
-				return NULL;
-			}
-		}
-	}
-	/* Extract the volume label from the image */
-	res = fseek (file, 32808L, SEEK_SET);
-	if (res != 0) {
-		fclose (file);
-		return NULL;
-	}
-	res = fread (buf, sizeof(char), BUFFER_SIZE, file);
-	fclose (file);
-	if (res != BUFFER_SIZE)
-		return NULL;
-
-	buf [BUFFER_SIZE] = '\0';
-	str = g_strdup (g_strstrip (buf));
-	if (!g_utf8_validate (str, -1, NULL)) {
-		g_free (str);
-		return g_strdup ("");
-	}
-
-	return str;
-}
-
 TotemPlParserResult
 totem_pl_parser_add_iso (TotemPlParser *parser,
 			 GFile *file,
@@ -121,21 +44,21 @@ totem_pl_parser_add_iso (TotemPlParser *parser,
 			 gpointer data)
 {
 	TotemDiscMediaType type;
-	char *uri, *retval;
+	char *uri, *retval, *label;
 
 	uri = g_file_get_uri (file);
-	type = totem_cd_detect_type_with_url (uri, &retval, NULL);
+	type = totem_cd_detect_type_with_label (uri, &retval, &label, NULL);
 	g_free (uri);
 	if (type == MEDIA_TYPE_DVD || type == MEDIA_TYPE_VCD) {
-		char *label;
-
-		label = totem_pl_parser_iso_get_title (file);
 		totem_pl_parser_add_one_uri (parser, retval, label);
 		g_free (label);
 		g_free (retval);
 		return TOTEM_PL_PARSER_RESULT_SUCCESS;
 	}
 
+	g_free (label);
+	g_free (retval);
+
 	return TOTEM_PL_PARSER_RESULT_IGNORED;
 }
 
@@ -160,69 +83,221 @@ totem_pl_parser_add_cue (TotemPlParser *parser,
 	return TOTEM_PL_PARSER_RESULT_SUCCESS;
 }
 
+/* The listings of the next few sub-directories are loaded on other
+ * threads while the current directory's entries are being parsed */
+#define DIR_PREFETCH_MAX_JOBS 4
+#define DIR_PREFETCH_MAX_AHEAD 8
+
+#define DIR_ATTRIBUTES G_FILE_ATTRIBUTE_STANDARD_NAME "," \
+		       G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
+		       G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE
+
+typedef struct {
+	GFileInfo *info;
+	/* collation key, computed once for sorting */
+	char *key;
+	gboolean sort_last;
+} DirEntry;
+
+typedef struct {
+	GFile *file;
+	GCancellable *cancellable;
+	DirEntry *entries;
+	guint num_entries;
+	gboolean result;
+	gboolean unhandled;
+	gboolean done;
+	gint ref_count;
+} DirListing;
+
+static GMutex dir_listing_lock;
+static GCond dir_listing_cond;
+
 static int
-totem_pl_parser_dir_compare (GFileInfo *a, GFileInfo *b)
+dir_entry_compare (gconstpointer a, gconstpointer b)
 {
-	const char *name_1, *name_2;
-	char *key_1, *key_2;
-	gboolean sort_last_1, sort_last_2;
-	int compare;
-
-	name_1 = g_file_info_get_name (a);
-	name_2 = g_file_info_get_name (b);
-
-	if (name_1 == NULL) {
-		if (name_2 == NULL)
-			compare = 0;
-		else
-			compare = -1;
-	} else {	
-		sort_last_1 = name_1[0] == SORT_LAST_CHAR1 || name_1[0] == SORT_LAST_CHAR2;
-		sort_last_2 = name_2[0] == SORT_LAST_CHAR1 || name_2[0] == SORT_LAST_CHAR2;
-		
-		if (sort_last_1 && !sort_last_2) {
-			compare = +1;
-		} else if (!sort_last_1 && sort_last_2) {
-			compare = -1;
-		} else {
-			key_1 = g_utf8_collate_key_for_filename (name_1, -1);
-			key_2 = g_utf8_collate_key_for_filename (name_2, -1);
-			compare = strcmp (key_1, key_2);
-			g_free (key_1);
-			g_free (key_2);
-		}
+	const DirEntry *entry_1 = a, *entry_2 = b;
+
+	if (entry_1->sort_last && !entry_2->sort_last)
+		return +1;
+	if (!entry_1->sort_last && entry_2->sort_last)
+		return -1;
+	return strcmp (entry_1->key, entry_2->key);
+}
+
+static DirListing *
+dir_listing_new (GFile *file)
+{
+	DirListing *listing;
+
+	listing = g_new0 (DirListing, 1);
+	listing->file = g_object_ref (file);
+	listing->cancellable = g_cancellable_new ();
+	listing->ref_count = 1;
+
+	return listing;
+}
+
+static DirListing *
+dir_listing_ref (DirListing *listing)
+{
+	g_atomic_int_inc (&listing->ref_count);
+	return listing;
+}
+
+static void
+dir_listing_unref (DirListing *listing)
+{
+	guint i;
+
+	if (!g_atomic_int_dec_and_test (&listing->ref_count))
+		return;
+
+	for (i = 0; i < listing->num_entries; i++) {
+		g_clear_object (&listing->entries[i].info);
+		g_free (listing->entries[i].key);
 	}
+	g_free (listing->entries);
+	g_object_unref (listing->cancellable);
+	g_object_unref (listing->file);
+	g_free (listing);
+}
 
-	return compare;
+/* Drops a listing nobody claimed */
+static void
+dir_listing_cancel (DirListing *listing)
+{
+	g_cancellable_cancel (listing->cancellable);
+	dir_listing_unref (listing);
 }
 
-static gboolean
-totem_pl_parser_load_directory (GFile *file, GList **list, gboolean *unhandled)
+static void
+dir_listing_load (DirListing *listing)
 {
 	GFileEnumerator *e;
 	GFileInfo *info;
 	GError *err = NULL;
+	GArray *entries;
 
-	*list = NULL;
-	*unhandled = FALSE;
-
-	e = g_file_enumerate_children (file,
-				       G_FILE_ATTRIBUTE_STANDARD_NAME "," G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE,
+	e = g_file_enumerate_children (listing->file,
+				       DIR_ATTRIBUTES,
 				       G_FILE_QUERY_INFO_NONE,
-				       NULL, &err);
+				       listing->cancellable, &err);
 	if (e == NULL) {
 		if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED) != FALSE)
-			*unhandled = TRUE;
+			listing->unhandled = TRUE;
 		g_error_free (err);
-		return FALSE;
+		return;
 	}
 
-	while ((info = g_file_enumerator_next_file (e, NULL, NULL)) != NULL)
-		*list = g_list_prepend (*list, info);
+	entries = g_array_new (FALSE, FALSE, sizeof (DirEntry));
+	while ((info = g_file_enumerator_next_file (e, listing->cancellable, NULL)) != NULL) {
+		DirEntry entry;
+		const char *name;
+
+		name = g_file_info_get_name (info);
+		entry.info = info;
+		entry.sort_last = name[0] == SORT_LAST_CHAR1 || name[0] == SORT_LAST_CHAR2;
+		entry.key = g_utf8_collate_key_for_filename (name, -1);
+		g_array_append_val (entries, entry);
+	}
 
 	g_file_enumerator_close (e, NULL, NULL);
 	g_object_unref (e);
-	return TRUE;
+
+	g_array_sort (entries, dir_entry_compare);
+	listing->num_entries = entries->len;
+	listing->entries = (DirEntry *) g_array_free (entries, FALSE);
+	listing->result = TRUE;
+}
+
+static void
+dir_listing_load_thread (DirListing *listing,
+			 gpointer    user_data)
+{
+	dir_listing_load (listing);
+
+	g_mutex_lock (&dir_listing_lock);
+	listing->done = TRUE;
+	g_cond_broadcast (&dir_listing_cond);
+	g_mutex_unlock (&dir_listing_lock);
+
+	dir_listing_unref (listing);
+}
+
+static void
+dir_listing_prefetch (GFile *file, TotemPlParseData *parse_data)
+{
+	DirListing *listing;
+
+	if (parse_data->dir_pool == NULL) {
+		parse_data->dir_pool = g_thread_pool_new ((GFunc) dir_listing_load_thread, NULL,
+							  DIR_PREFETCH_MAX_JOBS, FALSE, NULL);
+		parse_data->dir_listings = g_hash_table_new_full (g_str_hash, g_str_equal,
+								  g_free, (GDestroyNotify) dir_listing_cancel);
+	}
+
+	listing = dir_listing_new (file);
+	g_hash_table_insert (parse_data->dir_listings, g_file_get_uri (file), listing);
+	g_thread_pool_push (parse_data->dir_pool, dir_listing_ref (listing), NULL);
+}
+
+/* Drops the prefetched listing of @file if it wasn't used */
+static void
+dir_listing_drop (GFile *file, TotemPlParseData *parse_data)
+{
+	char *uri;
+
+	if (parse_data->dir_listings == NULL)
+		return;
+
+	uri = g_file_get_uri (file);
+	g_hash_table_remove (parse_data->dir_listings, uri);
+	g_free (uri);
+}
+
+/* Returns the listing of @file, waiting for it if it's being
+ * prefetched, or loading it now otherwise */
+static DirListing *
+dir_listing_claim (GFile *file, TotemPlParseData *parse_data)
+{
+	DirListing *listing;
+	gpointer key, value;
+	char *uri;
+
+	listing = NULL;
+	if (parse_data->dir_listings != NULL) {
+		uri = g_file_get_uri (file);
+		if (g_hash_table_lookup_extended (parse_data->dir_listings, uri, &key, &value)) {
+			g_hash_table_steal (parse_data->dir_listings, uri);
+			g_free (key);
+			listing = value;
+		}
+		g_free (uri);
+	}
+
+	if (listing == NULL) {
+		listing = dir_listing_new (file);
+		dir_listing_load (listing);
+		return listing;
+	}
+
+	g_mutex_lock (&dir_listing_lock);
+	while (listing->done == FALSE)
+		g_cond_wait (&dir_listing_cond, &dir_listing_lock);
+	g_mutex_unlock (&dir_listing_lock);
+
+	return listing;
+}
+
+/* Partial downloads are ignored */
+static gboolean
+dir_entry_is_partial (GFileInfo *info)
+{
+	const char *content_type;
+
+	content_type = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE);
+	return g_strcmp0 ("application/x-partial-download", content_type) == 0;
 }
 
 TotemPlParserResult
@@ -233,13 +308,18 @@ totem_pl_parser_add_directory (TotemPlParser *parser,
 			       gpointer data)
 {
 	TotemDiscMediaType type;
-	GList *list, *l;
+	DirListing *listing;
+	TotemPlParserSniffBatch *batch;
 	char *media_uri, *uri;
-	gboolean unhandled;
+	guint i, next, next_sniff, num_ahead;
 
 	uri = g_file_get_uri (file);
 	media_uri = NULL;
-	type = totem_cd_detect_type_from_dir (uri, &media_uri, NULL);
+	/* Shared by all the directories of the parse, so that their
+	 * parents only get checked once */
+	if (parse_data->disc_dirs == NULL)
+		parse_data->disc_dirs = totem_cd_dir_cache_new ();
+	type = totem_cd_detect_type_from_dir_cached (uri, &media_uri, parse_data->disc_dirs, NULL);
 	g_free (uri);
 
 	if (type != MEDIA_TYPE_DATA && type != MEDIA_TYPE_ERROR && media_uri != NULL) {
@@ -257,29 +337,66 @@ totem_pl_parser_add_directory (TotemPlParser *parser,
 	}
 	g_free (media_uri);
 
-	if (totem_pl_parser_load_directory (file, &list, &unhandled) == FALSE) {
-		if (unhandled != FALSE)
-			return TOTEM_PL_PARSER_RESULT_UNHANDLED;
-		return TOTEM_PL_PARSER_RESULT_ERROR;
+	listing = dir_listing_claim (file, parse_data);
+	if (listing->result == FALSE) {
+		TotemPlParserResult ret;
+
+		ret = listing->unhandled ? TOTEM_PL_PARSER_RESULT_UNHANDLED : TOTEM_PL_PARSER_RESULT_ERROR;
+		dir_listing_unref (listing);
+		return ret;
 	}
 
-	list = g_list_sort (list, (GCompareFunc) totem_pl_parser_dir_compare);
-	l = list;
+	batch = totem_pl_parser_sniff_batch_new (parser);
+	next = 0;
+	next_sniff = 0;
+	num_ahead = 0;
 
-	while (l != NULL) {
-		GFileInfo *info = l->data;
+	for (i = 0; i < listing->num_entries; i++) {
+		DirEntry *entry = &listing->entries[i];
 		GFile *item;
 		TotemPlParserResult ret;
-		const char *content_type;
+		gboolean is_dir;
+
+		/* Keep the listings of the next sub-directories coming */
+		while (parse_data->recurse &&
+		       next < listing->num_entries &&
+		       num_ahead < DIR_PREFETCH_MAX_AHEAD) {
+			GFileInfo *next_info = listing->entries[next].info;
 
-		item = g_file_get_child (file, g_file_info_get_name (info));
+			if (g_file_info_get_file_type (next_info) == G_FILE_TYPE_DIRECTORY) {
+				GFile *child;
 
-		/* Ignore partial files */
-		content_type = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE);
-		if (g_strcmp0 ("application/x-partial-download", content_type) == 0)
+				child = g_file_get_child (file, g_file_info_get_name (next_info));
+				dir_listing_prefetch (child, parse_data);
+				g_object_unref (child);
+				num_ahead++;
+			}
+			next++;
+		}
+
+		/* And the start of the next files, for those that need sniffing */
+		for (; next_sniff < listing->num_entries && next_sniff <= i + SNIFF_MAX_AHEAD; next_sniff++) {
+			GFileInfo *next_info = listing->entries[next_sniff].info;
+			GFile *child = NULL;
+
+			if (g_file_info_get_file_type (next_info) != G_FILE_TYPE_DIRECTORY &&
+			    dir_entry_is_partial (next_info) == FALSE)
+				child = g_file_get_child (file, g_file_info_get_name (next_info));
+			totem_pl_parser_sniff_batch_add (batch, child, parse_data);
+			g_clear_object (&child);
+		}
+
+		is_dir = parse_data->recurse &&
+			g_file_info_get_file_type (entry->info) == G_FILE_TYPE_DIRECTORY;
+		item = g_file_get_child (file, g_file_info_get_name (entry->info));
+
+		if (dir_entry_is_partial (entry->info)) {
 			ret = TOTEM_PL_PARSER_RESULT_IGNORED;
-		else
+		} else {
+			totem_pl_parser_sniff_batch_claim (batch, i, parse_data);
 			ret = totem_pl_parser_parse_internal (parser, item, NULL, parse_data);
+			totem_pl_parser_sniff_batch_release (batch, i, parse_data);
+		}
 
 		if (ret != TOTEM_PL_PARSER_RESULT_SUCCESS &&
 		    ret != TOTEM_PL_PARSER_RESULT_IGNORED &&
@@ -291,13 +408,17 @@ totem_pl_parser_add_directory (TotemPlParser *parser,
 			g_free (item_uri);
 		}
 
-		g_object_unref (item);
-		g_object_unref (info);
+		if (is_dir) {
+			dir_listing_drop (item, parse_data);
+			num_ahead--;
+		}
 
-		l = l->next;
+		g_object_unref (item);
+		g_clear_object (&entry->info);
 	}
 
-	g_list_free (list);
+	totem_pl_parser_sniff_batch_free (batch);
+	dir_listing_unref (listing);
 
 	return TOTEM_PL_PARSER_RESULT_SUCCESS;
 }
@@ -320,7 +441,7 @@ totem_pl_parser_add_block (TotemPlParser *parser,
 	type = totem_cd_detect_type_with_url (path, &media_uri, &err);
 	g_free (path);
 	if (err != NULL) {
-		DEBUG(file, g_print ("Couldn't get CD type for URI '%s': %s\n", uri, err->message));
+		DEBUG(FORMAT, file, g_print ("Couldn't get CD type for URI '%s': %s\n", uri, err->message));
 		g_error_free (err);
 	}
 	if (media_uri == NULL)
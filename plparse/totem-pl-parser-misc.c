@@ -47,7 +47,7 @@ totem_pl_parser_add_gvp (TotemPlParser *parser,
 	char *contents, **lines, *title, *url_link, *version;
 	gsize size;
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (file, parse_data, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
 	if (g_str_has_prefix (contents, "#.download.the.free.Google.Video.Player") == FALSE && g_str_has_prefix (contents, "# download the free Google Video Player") == FALSE) {
@@ -99,7 +99,7 @@ totem_pl_parser_add_desktop (TotemPlParser *parser,
 	gsize size;
 	TotemPlParserResult res = TOTEM_PL_PARSER_RESULT_ERROR;
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (file, parse_data, &contents, &size) == FALSE)
 		return res;
 
 	lines = g_strsplit (contents, "\n", 0);
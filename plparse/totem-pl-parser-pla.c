@@ -73,7 +73,7 @@ totem_pl_parser_save_pla (TotemPlParser    *parser,
 	strncpy (buffer + TITLE_OFFSET, title, TITLE_SIZE);
 	if (totem_pl_parser_write_buffer (G_OUTPUT_STREAM (stream), buffer, RECORD_SIZE, error) == FALSE)
 	{
-		DEBUG(output, g_print ("Couldn't write header block for '%s'", uri));
+		DEBUG(FORMAT, output, g_print ("Couldn't write header block for '%s'", uri));
 		g_free (buffer);
 		return FALSE;
 	}
@@ -103,7 +103,7 @@ totem_pl_parser_save_pla (TotemPlParser    *parser,
 
 		if (path == NULL)
 		{
-			DEBUG1(g_print ("Couldn't convert URI '%s' to a filename: %s\n", euri, (*error)->message));
+			DEBUG1(FORMAT, g_print ("Couldn't convert URI '%s' to a filename: %s\n", euri, (*error)->message));
 			g_free (euri);
 			ret = FALSE;
 			break;
@@ -136,7 +136,7 @@ totem_pl_parser_save_pla (TotemPlParser    *parser,
 		converted = g_convert (path, -1, "UTF-16BE", "UTF-8", NULL, &written, error);
 		if (converted == NULL)
 		{
-			DEBUG1(g_print ("Couldn't convert filename '%s' to UTF-16BE\n", path));
+			DEBUG1(FORMAT, g_print ("Couldn't convert filename '%s' to UTF-16BE\n", path));
 			g_free (path);
 			ret = FALSE;
 			break;
@@ -151,7 +151,7 @@ totem_pl_parser_save_pla (TotemPlParser    *parser,
 
 		if (totem_pl_parser_write_buffer (G_OUTPUT_STREAM (stream), buffer, RECORD_SIZE, error) == FALSE)
 		{
-			DEBUG1(g_print ("Couldn't write entry %d to the file\n", i));
+			DEBUG1(FORMAT, g_print ("Couldn't write entry %d to the file\n", i));
 			ret = FALSE;
 			break;
 		}
@@ -175,13 +175,13 @@ totem_pl_parser_add_pla (TotemPlParser *parser,
 	guint offset, max_entries, entry;
 	gsize size;
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (file, parse_data, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
 	if (size < RECORD_SIZE)
 	{
 		g_free (contents);
-		DEBUG(file, g_print ("playlist '%s' is too short: %d\n", uri, (unsigned int) size));
+		DEBUG(FORMAT, file, g_print ("playlist '%s' is too short: %d\n", uri, (unsigned int) size));
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 	}
 
@@ -189,7 +189,7 @@ totem_pl_parser_add_pla (TotemPlParser *parser,
 	max_entries = GINT32_FROM_BE (*((gint32 *)contents));
 	if (strcmp (contents + FORMAT_ID_OFFSET, "iriver UMS PLA") != 0)
 	{
-		DEBUG(file, g_print ("playlist '%s' signature doesn't match: %s\n", uri, contents + 4));
+		DEBUG(FORMAT, file, g_print ("playlist '%s' signature doesn't match: %s\n", uri, contents + 4));
 		g_free (contents);
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 	}
@@ -219,7 +219,7 @@ totem_pl_parser_add_pla (TotemPlParser *parser,
 				  NULL, NULL, &error);
 		if (path == NULL)
 		{
-			DEBUG1(g_print ("error converting entry %d to UTF-8: %s\n", entry, error->message));
+			DEBUG1(FORMAT, g_print ("error converting entry %d to UTF-8: %s\n", entry, error->message));
 			g_error_free (error);
 			retval = TOTEM_PL_PARSER_RESULT_ERROR;
 			break;
@@ -232,7 +232,7 @@ totem_pl_parser_add_pla (TotemPlParser *parser,
 		uri = g_filename_to_uri (path, NULL, NULL);
 		if (uri == NULL)
 		{
-			DEBUG1(g_print ("error converting path %s to URI: %s\n", path, error->message));
+			DEBUG1(FORMAT, g_print ("error converting path %s to URI: %s\n", path, error->message));
 			g_error_free (error);
 			retval = TOTEM_PL_PARSER_RESULT_ERROR;
 			break;
@@ -157,6 +157,52 @@ ensure_utf8_valid (char *input)
 	return utf8_valid;
 }
 
+/* The file entry @index will get parsed as, if it's going to be parsed.
+ * Returns %FALSE if the playlist has no such entry. */
+static gboolean
+totem_pl_parser_pls_entry_get_file (TotemPlParser             *parser,
+				    GHashTable                *entries,
+				    guint                      index,
+				    GFile                     *base_file,
+				    TotemPlParserResolveBase **relative_base,
+				    GFile                    **target)
+{
+	char *key, *file_str, *length;
+
+	*target = NULL;
+
+	key = g_strdup_printf ("file%d", index);
+	file_str = g_hash_table_lookup (entries, key);
+	g_free (key);
+	if (file_str == NULL)
+		return FALSE;
+
+	/* Streams are added without being parsed */
+	key = g_strdup_printf ("length%d", index);
+	length = g_hash_table_lookup (entries, key);
+	g_free (key);
+	if (length != NULL &&
+	    totem_pl_parser_parse_duration (length, totem_pl_parser_is_debugging_enabled (parser)) < 0)
+		return TRUE;
+
+	if (strstr (file_str, "://") != NULL || file_str[0] == G_DIR_SEPARATOR) {
+		*target = g_file_new_for_commandline_arg (file_str);
+	} else {
+		char *utf8_filename, *target_uri;
+
+		if (*relative_base == NULL)
+			*relative_base = totem_pl_parser_resolve_base_new_for_dir (base_file);
+
+		utf8_filename = ensure_utf8_valid (file_str);
+		target_uri = totem_pl_parser_resolve_base_child_uri (*relative_base, utf8_filename);
+		*target = g_file_new_for_uri (target_uri);
+		g_free (utf8_filename);
+		g_free (target_uri);
+	}
+
+	return TRUE;
+}
+
 TotemPlParserResult
 totem_pl_parser_add_pls_with_contents (TotemPlParser *parser,
 				       GFile *file,
@@ -172,7 +218,10 @@ totem_pl_parser_add_pls_with_contents (TotemPlParser *parser,
 	gboolean fallback;
 	GHashTable *entries;
 	guint found_entries;
-	char *uri;
+	char *uri, *base_uri;
+	TotemPlParserResolveBase *relative_base;
+	TotemPlParserSniffBatch *batch;
+	guint next_sniff, queued_entries;
 
 	lines = g_strsplit_set (contents, "\r\n", 0);
 
@@ -236,15 +285,36 @@ totem_pl_parser_add_pls_with_contents (TotemPlParser *parser,
 		base_file = g_file_get_parent (file);
 	else
 		base_file = g_object_ref (_base_file);
+	/* Handed out with every entry, so only convert it once */
+	base_uri = g_file_get_uri (base_file);
+	/* Created on the first relative entry, and shared by all the others */
+	relative_base = NULL;
 
 	retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
 
+	/* Entry i is item i - 1 of the batch */
+	batch = totem_pl_parser_sniff_batch_new (parser);
+	next_sniff = 1;
+	queued_entries = 0;
+
 	found_entries = 0;
 	for (i = 1; found_entries < num_entries; i++) {
 		char *file_str, *title, *genre, *length;
 		char *file_key, *title_key, *genre_key, *length_key;
 		gint64 length_num;
 
+		/* Start reading the next local files, for those that need sniffing,
+		 * relative ones included */
+		for (; queued_entries < num_entries && next_sniff <= i + SNIFF_MAX_AHEAD; next_sniff++) {
+			GFile *next_file;
+
+			if (totem_pl_parser_pls_entry_get_file (parser, entries, next_sniff, base_file,
+								&relative_base, &next_file))
+				queued_entries++;
+			totem_pl_parser_sniff_batch_add (batch, next_file, parse_data);
+			g_clear_object (&next_file);
+		}
+
 		file_key = g_strdup_printf ("file%d", i);
 		title_key = g_strdup_printf ("title%d", i);
 		length_key = g_strdup_printf ("length%d", i);
@@ -276,45 +346,69 @@ totem_pl_parser_add_pls_with_contents (TotemPlParser *parser,
 			length_num = totem_pl_parser_parse_duration (length, totem_pl_parser_is_debugging_enabled (parser));
 
 		if (strstr (file_str, "://") != NULL || file_str[0] == G_DIR_SEPARATOR) {
-			GFile *target;
+			TotemPlParserResult ret = TOTEM_PL_PARSER_RESULT_UNHANDLED;
+
+			if (length_num >= 0) {
+				GFile *target;
 
-			target = g_file_new_for_commandline_arg (file_str);
-			if (length_num < 0 || totem_pl_parser_parse_internal (parser, target, NULL, parse_data) != TOTEM_PL_PARSER_RESULT_SUCCESS) {
+				target = g_file_new_for_commandline_arg (file_str);
+				totem_pl_parser_sniff_batch_claim (batch, i - 1, parse_data);
+				ret = totem_pl_parser_parse_internal (parser, target, NULL, parse_data);
+				totem_pl_parser_sniff_batch_release (batch, i - 1, parse_data);
+				g_object_unref (target);
+			}
+			if (ret != TOTEM_PL_PARSER_RESULT_SUCCESS) {
 				totem_pl_parser_add_uri (parser,
 							 TOTEM_PL_PARSER_FIELD_URI, file_str,
 							 TOTEM_PL_PARSER_FIELD_TITLE, title,
 							 TOTEM_PL_PARSER_FIELD_GENRE, genre,
 							 TOTEM_PL_PARSER_FIELD_DURATION, length,
-							 TOTEM_PL_PARSER_FIELD_BASE_FILE, base_file, NULL);
+							 TOTEM_PL_PARSER_FIELD_BASE, base_uri, NULL);
 			}
-			g_object_unref (target);
 		} else {
-			GFile *target;
-			char *utf8_filename;
+			TotemPlParserResult ret = TOTEM_PL_PARSER_RESULT_UNHANDLED;
+			char *utf8_filename, *target_uri;
+
+			if (relative_base == NULL)
+				relative_base = totem_pl_parser_resolve_base_new_for_dir (base_file);
 
 			utf8_filename = ensure_utf8_valid (file_str);
-			target = g_file_get_child_for_display_name (base_file, utf8_filename, NULL);
+			target_uri = totem_pl_parser_resolve_base_child_uri (relative_base, utf8_filename);
 			g_free (utf8_filename);
 
-			if (length_num < 0 || totem_pl_parser_parse_internal (parser, target, base_file, parse_data) != TOTEM_PL_PARSER_RESULT_SUCCESS) {
+			if (length_num >= 0) {
+				GFile *target;
+
+				target = g_file_new_for_uri (target_uri);
+				totem_pl_parser_sniff_batch_claim (batch, i - 1, parse_data);
+				ret = totem_pl_parser_parse_internal (parser, target, base_file, parse_data);
+				totem_pl_parser_sniff_batch_release (batch, i - 1, parse_data);
+				g_object_unref (target);
+			}
+			if (ret != TOTEM_PL_PARSER_RESULT_SUCCESS) {
 				totem_pl_parser_add_uri (parser,
-							 TOTEM_PL_PARSER_FIELD_FILE, target,
+							 TOTEM_PL_PARSER_FIELD_URI, target_uri,
 							 TOTEM_PL_PARSER_FIELD_TITLE, title,
 							 TOTEM_PL_PARSER_FIELD_GENRE, genre,
 							 TOTEM_PL_PARSER_FIELD_DURATION, length,
-							 TOTEM_PL_PARSER_FIELD_BASE_FILE, base_file, NULL);
+							 TOTEM_PL_PARSER_FIELD_BASE, base_uri, NULL);
 			}
 
-			g_object_unref (target);
+			g_free (target_uri);
 		}
 
 		parse_data->fallback = fallback;
 	}
 
+	totem_pl_parser_sniff_batch_free (batch);
+
 	uri = g_file_get_uri (file);
 	totem_pl_parser_playlist_end (parser, uri);
 	g_free (uri);
 
+	g_free (base_uri);
+	if (relative_base != NULL)
+		totem_pl_parser_resolve_base_free (relative_base);
 	g_object_unref (base_file);
         g_hash_table_destroy (entries);
 
@@ -332,7 +426,7 @@ totem_pl_parser_add_pls (TotemPlParser *parser,
 	char *contents;
 	gsize size;
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (file, parse_data, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
 	if (size == 0) {
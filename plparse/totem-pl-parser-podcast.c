@@ -301,7 +301,7 @@ totem_pl_parser_add_rss (TotemPlParser *parser,
 	char *contents;
 	gsize size;
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (file, parse_data, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
 	doc = totem_pl_parser_parse_xml_relaxed (contents, size);
@@ -552,7 +552,7 @@ totem_pl_parser_add_atom (TotemPlParser *parser,
 	char *contents, *uri;
 	gsize size;
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (file, parse_data, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
 	doc = totem_pl_parser_parse_xml_relaxed (contents, size);
@@ -671,19 +671,19 @@ totem_pl_parser_add_itms (TotemPlParser *parser,
 
 	id = get_itms_id (file);
 	if (id == NULL) {
-		DEBUG(file, g_print ("Could not get ITMS ID for URL '%s'\n", uri));
+		DEBUG(FORMAT, file, g_print ("Could not get ITMS ID for URL '%s'\n", uri));
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 	}
 
-	DEBUG(file, g_print ("Got ID '%s' for URL '%s'", id, uri));
+	DEBUG(FORMAT, file, g_print ("Got ID '%s' for URL '%s'", id, uri));
 
 	json_uri = g_strdup_printf ("https://itunes.apple.com/lookup?id=%s&entity=podcast", id);
 	g_free (id);
 	json_file = g_file_new_for_uri (json_uri);
 	g_free (json_uri);
 
-	if (g_file_load_contents (json_file, NULL, &contents, &len, NULL, NULL) == FALSE) {
-		DEBUG(json_file, g_print ("Failed to load URL '%s'\n", uri));
+	if (totem_pl_parser_load_contents (json_file, parse_data, &contents, &len) == FALSE) {
+		DEBUG(FORMAT, json_file, g_print ("Failed to load URL '%s'\n", uri));
 		g_object_unref (json_file);
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 	}
@@ -691,7 +691,7 @@ totem_pl_parser_add_itms (TotemPlParser *parser,
 	feed_url = totem_pl_parser_parse_json (contents, len, totem_pl_parser_is_debugging_enabled (parser));
 	g_free (contents);
 	if (feed_url == NULL) {
-		DEBUG(json_file, g_print ("Failed to parse JSON file at '%s'\n", uri));
+		DEBUG(FORMAT, json_file, g_print ("Failed to parse JSON file at '%s'\n", uri));
 		g_object_unref (json_file);
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 	}
@@ -700,7 +700,7 @@ totem_pl_parser_add_itms (TotemPlParser *parser,
 	feed_file = g_file_new_for_uri (feed_url);
 	g_free (feed_url);
 
-	DEBUG(feed_file, g_print ("Found feed URI: %s\n", uri));
+	DEBUG(FORMAT, feed_file, g_print ("Found feed URI: %s\n", uri));
 
 	ret = totem_pl_parser_add_rss (parser, feed_file, NULL, parse_data, NULL);
 	g_object_unref (feed_file);
@@ -803,7 +803,7 @@ totem_pl_parser_add_opml (TotemPlParser *parser,
 	char *contents, *uri;
 	gsize size;
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (file, parse_data, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
 	doc = totem_pl_parser_parse_xml_relaxed (contents, size);
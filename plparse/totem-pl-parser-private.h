@@ -58,6 +58,7 @@
 
 #ifndef TOTEM_PL_PARSER_MINI
 #include "totem-pl-parser.h"
+#include "totem-disc.h"
 #include <glib-object.h>
 #include <gio/gio.h>
 #include <gio/gio.h>
@@ -82,11 +83,22 @@
 #define ASF_REF_MIME_TYPE "application/vnd.ms-asf"
 #define HLS_MIME_TYPE "application/vnd.apple.mpegurl"
 
+/* Files that start with these characters sort after files that don't. */
+#define SORT_LAST_CHAR1 '.'
+#define SORT_LAST_CHAR2 '#'
+
 #define TOTEM_PL_PARSER_FIELD_FILE		"gfile-object"
 #define TOTEM_PL_PARSER_FIELD_BASE_FILE		"gfile-object-base"
 
-#define DEBUG(file, x) {					\
-	if (totem_pl_parser_is_debugging_enabled (parser)) {	\
+/* Debug output, for @parser, in one of the #TotemPlParserDebugCategory
+ * categories, such as SNIFF. Unless some parser has debugging enabled,
+ * this is a single load and branch, and @x isn't evaluated.
+ * DEBUG() gives @x the URI of @file, as "uri". */
+#define DEBUG_ENABLED(category)							\
+	(G_UNLIKELY (g_atomic_int_get (&totem_pl_parser_debugging) > 0) &&	\
+	 totem_pl_parser_debug_enabled (parser, TOTEM_PL_PARSER_DEBUG_##category))
+#define DEBUG(category, file, x) {				\
+	if (DEBUG_ENABLED (category)) {				\
 		if (file != NULL) {				\
 			char *uri;				\
 								\
@@ -99,26 +111,130 @@
 		}						\
 	}							\
 }
-#define DEBUG1(x) {						\
-	if (totem_pl_parser_is_debugging_enabled (parser)) {	\
+#define DEBUG1(category, x) {					\
+	if (DEBUG_ENABLED (category)) {				\
 		x;						\
 	}							\
 }
 
+/* Static tracepoints, only compiled in with the enable-tracing build
+ * option. They are USDT probes under the "totem_pl_parser" provider,
+ * which perf, bpftrace or SystemTap can attach to on a running system,
+ * and are a single nop when nothing is attached. Their arguments are
+ * values the code already has at hand, except for the URIs of files,
+ * which TRACE_URI() gives @x as "uri", as DEBUG() does. Each probe has
+ * a semaphore, which the tracer bumps while it's attached, so the URI
+ * only gets worked out for @name's probe when something listens to it.
+ * New probes need adding to TRACE_PROBES(). */
+#ifdef HAVE_SYS_SDT_H
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define TRACE_PROBES(X)				\
+	X (parse_start)				\
+	X (parse_done)				\
+	X (sniff_start)				\
+	X (sniff_done)				\
+	X (handler_start)			\
+	X (handler_done)			\
+	X (emit_start)				\
+	X (emit_done)				\
+	X (xml_build_start)			\
+	X (xml_build_done)			\
+	X (videosite_check_start)		\
+	X (videosite_check_done)		\
+	X (videosite_parse_start)		\
+	X (videosite_parse_done)
+#define TRACE_SEMAPHORE(name)		totem_pl_parser_##name##_semaphore
+#define TRACE_DECLARE_SEMAPHORE(name)	\
+	extern unsigned short TRACE_SEMAPHORE (name) __attribute__ ((section (".probes")));
+TRACE_PROBES (TRACE_DECLARE_SEMAPHORE)
+#define TRACE_ENABLED(name)		G_UNLIKELY (TRACE_SEMAPHORE (name) != 0)
+#define TRACE(name)			DTRACE_PROBE (totem_pl_parser, name)
+#define TRACE1(name, a1)		DTRACE_PROBE1 (totem_pl_parser, name, a1)
+#define TRACE2(name, a1, a2)		DTRACE_PROBE2 (totem_pl_parser, name, a1, a2)
+#define TRACE3(name, a1, a2, a3)	DTRACE_PROBE3 (totem_pl_parser, name, a1, a2, a3)
+#define TRACE_URI(name, file, x) {				\
+	if (TRACE_ENABLED (name)) {				\
+		char *uri;					\
+								\
+		uri = g_file_get_uri (file);			\
+		x;						\
+		g_free (uri);					\
+	}							\
+}
+#else
+#define TRACE(name)
+#define TRACE1(name, a1)
+#define TRACE2(name, a1, a2)
+#define TRACE3(name, a1, a2, a3)
+#define TRACE_URI(name, file, x)
+#endif /* HAVE_SYS_SDT_H */
+
+/* How deep playlists and directories get followed */
+#define RECURSE_LEVEL_MAX 4
+/* How many entries ahead of the one being parsed
+ * get added to a #TotemPlParserSniffBatch */
+#define SNIFF_MAX_AHEAD 32
+
 typedef struct {
 	guint recurse_level;
 	guint fallback : 1;
 	guint recurse : 1;
 	guint force : 1;
 	guint disable_unsafe : 1;
+	/* Of an asynchronous parse, or NULL */
+	GCancellable *cancellable;
+	/* URI to the GBytes of the whole of small remote files,
+	 * see totem_pl_parser_prefetch_claim() */
+	GHashTable *prefetched;
+	/* URI to the GBytes of the start of files, see
+	 * totem_pl_parser_sniff_batch_claim() and totem_pl_parser_prefetch_claim() */
+	GHashTable *sniffed;
+	/* Disc types of the directories already seen */
+	GHashTable *disc_dirs;
+	/* Directory listings being loaded ahead of time,
+	 * see totem_pl_parser_add_directory() */
+	GHashTable *dir_listings;
+	GThreadPool *dir_pool;
+	/* Length of the sniffed data last handed to a playlist
+	 * handler, which it can only rely on before parsing others */
+	gsize data_len;
 } TotemPlParseData;
 
 #ifndef TOTEM_PL_PARSER_MINI
+/* Categories of debug output, which the TOTEM_PL_PARSER_DEBUG environment
+ * variable can select, as in "TOTEM_PL_PARSER_DEBUG=sniff,fetch", when
+ * TotemPlParser:debug is set. All of them are output if it's unset. */
+typedef enum {
+	TOTEM_PL_PARSER_DEBUG_PARSE	= 1 << 0, /* which parser gets used, and why */
+	TOTEM_PL_PARSER_DEBUG_SNIFF	= 1 << 1, /* mime-type detection */
+	TOTEM_PL_PARSER_DEBUG_FETCH	= 1 << 2, /* fetching and reading ahead */
+	TOTEM_PL_PARSER_DEBUG_FORMAT	= 1 << 3  /* the parsers for each format */
+} TotemPlParserDebugCategory;
+
+/* The number of parsers with TotemPlParser:debug set */
+extern gint totem_pl_parser_debugging;
+
+/* What the time of a parse is accounted to in its #TotemPlParserStats,
+ * see totem_pl_parser_stats_enter() */
+typedef enum {
+	TOTEM_PL_PARSER_PHASE_PARSE,
+	TOTEM_PL_PARSER_PHASE_SNIFF,
+	TOTEM_PL_PARSER_PHASE_LOAD,
+	TOTEM_PL_PARSER_PHASE_EMIT
+} TotemPlParserPhase;
+
+typedef struct TotemPlParserResolveBase TotemPlParserResolveBase;
+typedef struct TotemPlParserPrefetch TotemPlParserPrefetch;
+typedef struct TotemPlParserSniffBatch TotemPlParserSniffBatch;
+
 char *totem_pl_parser_read_ini_line_string	(char **lines, const char *key);
 int   totem_pl_parser_read_ini_line_int		(char **lines, const char *key);
 char *totem_pl_parser_read_ini_line_string_with_sep (char **lines, const char *key,
 						     const char *sep);
 gboolean totem_pl_parser_is_debugging_enabled	(TotemPlParser *parser);
+gboolean totem_pl_parser_debug_enabled		(TotemPlParser *parser,
+						 TotemPlParserDebugCategory category);
 char *totem_pl_parser_base_uri			(GFile *file);
 void totem_pl_parser_playlist_end		(TotemPlParser *parser,
 						 const char *playlist_title);
@@ -136,14 +252,57 @@ gboolean totem_pl_parser_write_buffer		(GOutputStream *stream,
 						 const char *buf,
 						 guint size,
 						 GError **error);
+const char * totem_pl_playlist_iter_lookup	(TotemPlPlaylistIter *iter,
+						 const char *key);
+gboolean totem_pl_playlist_iter_step		(TotemPlPlaylistIter *iter);
 char * totem_pl_parser_relative			(GFile *output,
 						 const char *filepath);
 char * totem_pl_parser_resolve_uri		(GFile *base_gfile,
 						 const char *relative_uri);
+TotemPlParserResolveBase * totem_pl_parser_resolve_base_new (GFile *base_file);
+TotemPlParserResolveBase * totem_pl_parser_resolve_base_new_for_dir (GFile *dir);
+void totem_pl_parser_resolve_base_free		(TotemPlParserResolveBase *base);
+char * totem_pl_parser_resolve_uri_with_base	(const TotemPlParserResolveBase *base,
+						 const char *relative_uri);
+char * totem_pl_parser_resolve_base_child_uri	(const TotemPlParserResolveBase *base,
+						 const char *path);
 TotemPlParserResult totem_pl_parser_parse_internal (TotemPlParser *parser,
 						    GFile *file,
 						    GFile *base_file,
 						    TotemPlParseData *parse_data);
+void totem_pl_parser_parse_data_init		(TotemPlParser *parser,
+						 TotemPlParseData *parse_data,
+						 gboolean fallback);
+void totem_pl_parser_parse_data_clear		(TotemPlParseData *parse_data);
+TotemPlParserPrefetch * totem_pl_parser_prefetch_new (TotemPlParser *parser,
+						     GPtrArray *files,
+						     TotemPlParseData *parse_data);
+void totem_pl_parser_prefetch_claim		(TotemPlParserPrefetch *prefetch,
+						 guint index,
+						 TotemPlParseData *parse_data);
+void totem_pl_parser_prefetch_release		(TotemPlParserPrefetch *prefetch,
+						 guint index,
+						 TotemPlParseData *parse_data);
+void totem_pl_parser_prefetch_free		(TotemPlParserPrefetch *prefetch);
+TotemPlParserSniffBatch * totem_pl_parser_sniff_batch_new (TotemPlParser *parser);
+void totem_pl_parser_sniff_batch_add		(TotemPlParserSniffBatch *batch,
+						 GFile *file,
+						 TotemPlParseData *parse_data);
+void totem_pl_parser_sniff_batch_claim		(TotemPlParserSniffBatch *batch,
+						 guint index,
+						 TotemPlParseData *parse_data);
+void totem_pl_parser_sniff_batch_release	(TotemPlParserSniffBatch *batch,
+						 guint index,
+						 TotemPlParseData *parse_data);
+void totem_pl_parser_sniff_batch_free		(TotemPlParserSniffBatch *batch);
+TotemPlParserPhase totem_pl_parser_stats_enter	(TotemPlParserPhase phase);
+void totem_pl_parser_stats_leave		(TotemPlParserPhase previous);
+void totem_pl_parser_stats_add_read		(gsize bytes);
+void totem_pl_parser_stats_add_helper_spawn	(void);
+gboolean totem_pl_parser_load_contents		(GFile *file,
+						 TotemPlParseData *parse_data,
+						 char **contents,
+						 gsize *length);
 void totem_pl_parser_add_one_uri		(TotemPlParser *parser,
 						 const char *uri,
 						 const char *title);
@@ -164,6 +323,15 @@ xml_node_t * totem_pl_parser_parse_xml_relaxed	(char *contents,
 gboolean totem_pl_parser_fix_string		(const char  *name,
 						 const char  *value,
 						 char       **ret);
+GHashTable * totem_cd_dir_cache_new		(void);
+TotemDiscMediaType totem_cd_detect_type_from_dir_cached (const char  *dir,
+							 char       **mrl,
+							 GHashTable  *dir_cache,
+							 GError     **error);
+TotemDiscMediaType totem_cd_detect_type_with_label (const char  *device,
+						    char       **mrl,
+						    char       **label,
+						    GError     **error);
 
 #endif /* !TOTEM_PL_PARSER_MINI */
 
@@ -26,6 +26,7 @@
 #include <glib.h>
 
 #ifndef TOTEM_PL_PARSER_MINI
+#include <gio/gio.h>
 #include "xmlparser.h"
 
 #include "totem-pl-parser.h"
@@ -76,7 +77,7 @@ totem_pl_parser_add_quicktime_rtsptext (TotemPlParser *parser,
 	gsize size;
 	char **lines;
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (file, parse_data, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
 	lines = g_strsplit_set (contents, "\r\n", 0);
@@ -131,7 +132,7 @@ totem_pl_parser_add_quicktime_metalink (TotemPlParser *parser,
 	if (g_str_has_prefix (data, "SMILtext") != FALSE) {
 		TotemPlParserResult retval;
 
-		if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+		if (totem_pl_parser_load_contents (file, parse_data, &contents, &size) == FALSE)
 			return TOTEM_PL_PARSER_RESULT_ERROR;
 
 		retval = totem_pl_parser_add_smil_with_data (parser,
@@ -142,7 +143,7 @@ totem_pl_parser_add_quicktime_metalink (TotemPlParser *parser,
 		return retval;
 	}
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (file, parse_data, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
 	doc = totem_pl_parser_parse_xml_relaxed (contents, size);
@@ -197,6 +198,305 @@ totem_pl_parser_add_quicktime_metalink (TotemPlParser *parser,
 	return TOTEM_PL_PARSER_RESULT_SUCCESS;
 }
 
+/* QuickTime reference movies point to the actual media through a
+ * "rmra" atom inside the "moov" atom, with one "rmda" atom per
+ * alternative, each holding a "rdrf" data reference. Real movies have
+ * their "mvhd" and "trak" atoms there instead, so reading a few atom
+ * headers is enough to tell them apart, without reading the media.
+ *
+ * Those headers are usually all in the data already read for sniffing,
+ * the file only gets opened again when "moov" comes after it, behind
+ * the few small atoms allowed before it in a reference movie. */
+#define QT_ATOM(a, b, c, d) ((guint32) (a) << 24 | (guint32) (b) << 16 | (guint32) (c) << 8 | (guint32) (d))
+#define QT_SIZE_TO_END G_MAXUINT64
+/* The most atoms we'll look at, at the top-level and in "moov" */
+#define QT_MAX_ATOMS 32
+#define QT_MAX_RMRA_SIZE (64 * 1024)
+/* The most we'd read to skip an atom, when we can't seek */
+#define QT_MAX_SKIP_SIZE (64 * 1024)
+
+typedef struct {
+	guint32 type;
+	guint header_size;
+	guint64 size; /* of the payload */
+} QtAtom;
+
+/* Reads the start of a file from the sniffed data, and the rest
+ * from the file itself, only opened if needed */
+typedef struct {
+	GFile *file;
+	GCancellable *cancellable;
+	const guint8 *data;
+	gsize len;
+	/* Whether @data holds the whole file */
+	gboolean complete;
+	GInputStream *stream;
+	/* Of the next read, and of @stream */
+	guint64 offset;
+	guint64 stream_offset;
+	/* From @stream */
+	gsize bytes_read;
+} QtReader;
+
+static guint32
+qt_read_uint32 (const guint8 *data)
+{
+	return (guint32) data[0] << 24 | (guint32) data[1] << 16 | (guint32) data[2] << 8 | data[3];
+}
+
+static gboolean
+qt_reader_read (QtReader *reader, guint8 *buffer, gsize count)
+{
+	gsize bytes_read;
+
+	if (reader->offset < reader->len) {
+		bytes_read = MIN (count, reader->len - reader->offset);
+		memcpy (buffer, reader->data + reader->offset, bytes_read);
+		reader->offset += bytes_read;
+		buffer += bytes_read;
+		count -= bytes_read;
+	}
+	if (count == 0)
+		return TRUE;
+	if (reader->complete)
+		return FALSE;
+
+	if (reader->stream == NULL) {
+		GFileInputStream *stream;
+
+		stream = g_file_read (reader->file, reader->cancellable, NULL);
+		if (stream == NULL)
+			return FALSE;
+		reader->stream = G_INPUT_STREAM (stream);
+		reader->stream_offset = 0;
+	}
+
+	if (reader->stream_offset != reader->offset) {
+		guint64 skip = reader->offset - reader->stream_offset;
+
+		if (G_IS_SEEKABLE (reader->stream) && g_seekable_can_seek (G_SEEKABLE (reader->stream))) {
+			if (g_seekable_seek (G_SEEKABLE (reader->stream), reader->offset, G_SEEK_SET,
+					     reader->cancellable, NULL) == FALSE)
+				return FALSE;
+		} else {
+			/* Don't download the media just to get past it */
+			if (skip > QT_MAX_SKIP_SIZE ||
+			    g_input_stream_skip (reader->stream, skip, reader->cancellable, NULL) != (gssize) skip)
+				return FALSE;
+			reader->bytes_read += skip;
+		}
+		reader->stream_offset = reader->offset;
+	}
+
+	if (g_input_stream_read_all (reader->stream, buffer, count, &bytes_read,
+				     reader->cancellable, NULL) == FALSE)
+		return FALSE;
+	reader->bytes_read += bytes_read;
+	reader->offset += bytes_read;
+	reader->stream_offset += bytes_read;
+
+	return bytes_read == count;
+}
+
+/* Reads the header of the next atom, which has to fit in the
+ * @available bytes left in its parent */
+static gboolean
+qt_read_atom_header (QtReader *reader, guint64 available, QtAtom *atom)
+{
+	guint8 header[16];
+	guint64 size;
+
+	if (available < 8 || qt_reader_read (reader, header, 8) == FALSE)
+		return FALSE;
+
+	size = qt_read_uint32 (header);
+	atom->type = qt_read_uint32 (header + 4);
+	atom->header_size = 8;
+
+	if (size == 1) {
+		/* 64-bit size */
+		if (available < 16 || qt_reader_read (reader, header + 8, 8) == FALSE)
+			return FALSE;
+		size = (guint64) qt_read_uint32 (header + 8) << 32 | qt_read_uint32 (header + 12);
+		atom->header_size = 16;
+	} else if (size == 0) {
+		/* Runs to the end of the parent */
+		atom->size = (available == QT_SIZE_TO_END) ? QT_SIZE_TO_END : available - atom->header_size;
+		return TRUE;
+	}
+
+	if (size < atom->header_size || size > available)
+		return FALSE;
+	atom->size = size - atom->header_size;
+
+	return TRUE;
+}
+
+/* Only moves the offset, the next read seeks if needed */
+static gboolean
+qt_skip_atom (QtReader *reader, const QtAtom *atom)
+{
+	if (atom->size == QT_SIZE_TO_END || atom->size > G_MAXINT64 - reader->offset)
+		return FALSE;
+
+	reader->offset += atom->size;
+	return TRUE;
+}
+
+/* Finds the atom of @type in the @size bytes of @data, and returns
+ * its payload, starting the search at @offset, updated to point
+ * past the atom found */
+static const guint8 *
+qt_find_child (const guint8 *data, gsize size, gsize *offset, guint32 type, gsize *child_size)
+{
+	while (size - *offset >= 8) {
+		const guint8 *atom = data + *offset;
+		guint32 atom_size;
+
+		atom_size = qt_read_uint32 (atom);
+		if (atom_size < 8 || atom_size > size - *offset)
+			return NULL;
+		*offset += atom_size;
+
+		if (qt_read_uint32 (atom + 4) == type) {
+			*child_size = atom_size - 8;
+			return atom + 8;
+		}
+	}
+
+	return NULL;
+}
+
+static void
+qt_parse_rmra (const guint8 *rmra, gsize rmra_size, GPtrArray *uris)
+{
+	const guint8 *rmda, *rdrf;
+	gsize offset, rmda_size, rdrf_size;
+
+	offset = 0;
+	while ((rmda = qt_find_child (rmra, rmra_size, &offset, QT_ATOM ('r','m','d','a'), &rmda_size)) != NULL) {
+		gsize rdrf_offset = 0;
+		guint32 ref_size;
+
+		rdrf = qt_find_child (rmda, rmda_size, &rdrf_offset, QT_ATOM ('r','d','r','f'), &rdrf_size);
+		/* Flags, type of reference, size of reference */
+		if (rdrf == NULL || rdrf_size < 12)
+			continue;
+		/* Aliases only make sense on a Mac */
+		if (qt_read_uint32 (rdrf + 4) != QT_ATOM ('u','r','l',' '))
+			continue;
+		ref_size = qt_read_uint32 (rdrf + 8);
+		if (ref_size == 0 || ref_size > rdrf_size - 12)
+			continue;
+
+		g_ptr_array_add (uris, g_strndup ((const char *) rdrf + 12, ref_size));
+	}
+}
+
+/* Returns %TRUE if the "moov" atom is a reference movie's, adding the
+ * URIs of the movies it references to @uris */
+static gboolean
+qt_parse_moov (QtReader *reader, guint64 moov_size, GPtrArray *uris)
+{
+	QtAtom atom;
+	guint i;
+
+	for (i = 0; i < QT_MAX_ATOMS && moov_size > 0; i++) {
+		if (qt_read_atom_header (reader, moov_size, &atom) == FALSE)
+			return FALSE;
+		if (moov_size != QT_SIZE_TO_END)
+			moov_size -= atom.header_size + atom.size;
+
+		if (atom.type == QT_ATOM ('r','m','r','a')) {
+			guint8 *rmra;
+			gboolean retval;
+
+			if (atom.size > QT_MAX_RMRA_SIZE)
+				return FALSE;
+			rmra = g_malloc (atom.size);
+			retval = qt_reader_read (reader, rmra, atom.size);
+			if (retval != FALSE)
+				qt_parse_rmra (rmra, atom.size, uris);
+			g_free (rmra);
+
+			return retval;
+		}
+
+		/* A real movie */
+		if (atom.type == QT_ATOM ('m','v','h','d')
+		    || atom.type == QT_ATOM ('t','r','a','k'))
+			return FALSE;
+
+		if (qt_skip_atom (reader, &atom) == FALSE)
+			return FALSE;
+	}
+
+	return FALSE;
+}
+
+static TotemPlParserResult
+totem_pl_parser_add_quicktime_reference_movie (TotemPlParser *parser,
+					       GFile *file,
+					       GFile *base_file,
+					       TotemPlParseData *parse_data,
+					       gpointer data)
+{
+	QtReader reader;
+	GPtrArray *uris;
+	QtAtom atom;
+	guint i;
+
+	memset (&reader, 0, sizeof (reader));
+	reader.file = file;
+	reader.cancellable = parse_data->cancellable;
+	if (data != NULL) {
+		reader.data = data;
+		reader.len = parse_data->data_len;
+		reader.complete = reader.len < MIME_READ_CHUNK_SIZE;
+	}
+
+	uris = g_ptr_array_new_with_free_func (g_free);
+	for (i = 0; i < QT_MAX_ATOMS; i++) {
+		if (qt_read_atom_header (&reader, QT_SIZE_TO_END, &atom) == FALSE)
+			break;
+
+		if (atom.type == QT_ATOM ('m','o','o','v')) {
+			qt_parse_moov (&reader, atom.size, uris);
+			break;
+		}
+
+		/* Media data, so a real movie, or not a QuickTime file at all */
+		if (atom.type != QT_ATOM ('f','t','y','p')
+		    && atom.type != QT_ATOM ('w','i','d','e')
+		    && atom.type != QT_ATOM ('f','r','e','e')
+		    && atom.type != QT_ATOM ('s','k','i','p'))
+			break;
+
+		if (qt_skip_atom (&reader, &atom) == FALSE)
+			break;
+	}
+	if (reader.stream != NULL) {
+		totem_pl_parser_stats_add_read (reader.bytes_read);
+		g_object_unref (reader.stream);
+	}
+
+	DEBUG(FORMAT, file, g_print ("URI '%s' is a QuickTime reference movie to %u movies\n", uri, uris->len));
+
+	for (i = 0; i < uris->len; i++) {
+		char *resolved_uri;
+
+		resolved_uri = totem_pl_parser_resolve_uri (base_file, g_ptr_array_index (uris, i));
+		totem_pl_parser_add_uri (parser,
+					 TOTEM_PL_PARSER_FIELD_URI, resolved_uri,
+					 NULL);
+		g_free (resolved_uri);
+	}
+	i = uris->len;
+	g_ptr_array_free (uris, TRUE);
+
+	return i > 0 ? TOTEM_PL_PARSER_RESULT_SUCCESS : TOTEM_PL_PARSER_RESULT_UNHANDLED;
+}
+
 TotemPlParserResult
 totem_pl_parser_add_quicktime (TotemPlParser *parser,
 			       GFile *file,
@@ -204,10 +504,11 @@ totem_pl_parser_add_quicktime (TotemPlParser *parser,
 			       TotemPlParseData *parse_data,
 			       gpointer data)
 {
-	if (data == NULL || totem_pl_parser_is_quicktime (data, strlen (data)) == NULL)
-		return TOTEM_PL_PARSER_RESULT_UNHANDLED;
+	if (data != NULL && totem_pl_parser_is_quicktime (data, strlen (data)) != NULL)
+		return totem_pl_parser_add_quicktime_metalink (parser, file, base_file, parse_data, data);
 
-	return totem_pl_parser_add_quicktime_metalink (parser, file, base_file, parse_data, data);
+	/* Not a text reference, but it could still be a reference movie */
+	return totem_pl_parser_add_quicktime_reference_movie (parser, file, base_file, parse_data, data);
 }
 
 #endif /* !TOTEM_PL_PARSER_MINI */
@@ -23,6 +23,7 @@
 #include "config.h"
 
 #ifndef TOTEM_PL_PARSER_MINI
+#include <string.h>
 #include <glib.h>
 
 #include <gio/gio.h>
@@ -35,126 +36,386 @@
 #include "totem-pl-parser-private.h"
 
 #ifndef TOTEM_PL_PARSER_MINI
+/* All the times are in milliseconds. Those that can't be known
+ * from the document alone, such as indefinite or event-based ones,
+ * are unresolved, as are all the times following them in a <seq> */
+#define SMIL_TIME_UNRESOLVED -1
+
+typedef enum {
+	SMIL_ELEMENT_OTHER,
+	SMIL_ELEMENT_MEDIA,
+	SMIL_ELEMENT_TEXTSTREAM,
+	SMIL_ELEMENT_SEQ,
+	SMIL_ELEMENT_PAR,
+	SMIL_ELEMENT_SWITCH
+} SmilElementType;
+
+typedef struct {
+	TotemPlParser *parser;
+	const TotemPlParserResolveBase *base;
+	const char *title;
+	const char * const *languages;
+	/* The available bandwidth in bits per second, or 0 if unknown,
+	 * in which case the first alternative of a <switch> wins */
+	guint bitrate;
+	gboolean added;
+} SmilContext;
+
+/* A media element waiting for a possible <textstream> sibling */
+typedef struct {
+	xml_node_t *node;
+	gint64 offset;
+	gint64 duration;
+	const char *subtitle_uri;
+} SmilEntry;
+
+static gint64
+smil_parse_time (const char *str)
+{
+	gdouble value;
+	char *end;
+
+	if (str == NULL)
+		return SMIL_TIME_UNRESOLVED;
+
+	while (g_ascii_isspace (*str))
+		str++;
+	/* SMIL 1.0 clip-begin and clip-end values */
+	if (g_ascii_strncasecmp (str, "npt=", 4) == 0)
+		str += 4;
+	/* Rules out "indefinite", "media", event-based values, and
+	 * anything g_ascii_strtod() would accept that isn't a time */
+	if (g_ascii_isdigit (*str) == FALSE && *str != '.')
+		return SMIL_TIME_UNRESOLVED;
+
+	value = g_ascii_strtod (str, &end);
+	if (end == str)
+		return SMIL_TIME_UNRESOLVED;
+
+	if (*end == ':') {
+		gdouble parts[3];
+		guint num_parts = 0;
+
+		/* Clock values, "hh:mm:ss.fraction" or "mm:ss.fraction" */
+		parts[num_parts++] = value;
+		while (*end == ':' && num_parts < G_N_ELEMENTS (parts)) {
+			const char *part = end + 1;
+
+			if (g_ascii_isdigit (*part) == FALSE)
+				return SMIL_TIME_UNRESOLVED;
+			parts[num_parts++] = g_ascii_strtod (part, &end);
+		}
+		if (num_parts == 3)
+			value = parts[0] * 3600 + parts[1] * 60 + parts[2];
+		else
+			value = parts[0] * 60 + parts[1];
+		value *= 1000;
+	} else {
+		/* Timecount values, "10.5s", "2min", or plain seconds */
+		while (g_ascii_isspace (*end))
+			end++;
+		if (g_ascii_strncasecmp (end, "ms", 2) == 0) {
+			end += 2;
+		} else if (g_ascii_strncasecmp (end, "min", 3) == 0) {
+			value *= 60 * 1000;
+			end += 3;
+		} else if (g_ascii_strncasecmp (end, "h", 1) == 0) {
+			value *= 60 * 60 * 1000;
+			end += 1;
+		} else {
+			if (g_ascii_strncasecmp (end, "s", 1) == 0)
+				end += 1;
+			value *= 1000;
+		}
+	}
+
+	while (g_ascii_isspace (*end))
+		end++;
+	if (*end != '\0')
+		return SMIL_TIME_UNRESOLVED;
+
+	return (gint64) (value + 0.5);
+}
+
+static const char *
+smil_node_get_property (xml_node_t *node, const char *name, const char *smil1_name)
+{
+	const char *value;
+
+	value = xml_parser_get_property (node, name);
+	if (value == NULL)
+		value = xml_parser_get_property (node, smil1_name);
+	return value;
+}
+
+static SmilElementType
+smil_element_type (const char *name)
+{
+	if (g_ascii_strcasecmp (name, "video") == 0
+	    || g_ascii_strcasecmp (name, "audio") == 0
+	    || g_ascii_strcasecmp (name, "media") == 0)
+		return SMIL_ELEMENT_MEDIA;
+	if (g_ascii_strcasecmp (name, "textstream") == 0)
+		return SMIL_ELEMENT_TEXTSTREAM;
+	if (g_ascii_strcasecmp (name, "seq") == 0)
+		return SMIL_ELEMENT_SEQ;
+	if (g_ascii_strcasecmp (name, "par") == 0)
+		return SMIL_ELEMENT_PAR;
+	if (g_ascii_strcasecmp (name, "switch") == 0)
+		return SMIL_ELEMENT_SWITCH;
+	return SMIL_ELEMENT_OTHER;
+}
+
+static gboolean
+smil_language_matches (const SmilContext *ctx, const char *value)
+{
+	char **tags;
+	gboolean retval;
+	guint i, j;
+
+	if (ctx->languages == NULL)
+		return TRUE;
+
+	tags = g_strsplit (value, ",", -1);
+	retval = FALSE;
+	for (i = 0; tags[i] != NULL && retval == FALSE; i++) {
+		const char *tag = g_strstrip (tags[i]);
+
+		for (j = 0; ctx->languages[j] != NULL; j++) {
+			const char *lang = ctx->languages[j];
+			gsize len;
+
+			/* "en_GB" matches "en-GB" and "en-GB-oed",
+			 * and "en" matches any English */
+			for (len = 0; lang[len] != '\0'; len++) {
+				char c = lang[len] == '_' ? '-' : lang[len];
+
+				if (g_ascii_tolower (c) != g_ascii_tolower (tag[len]))
+					break;
+			}
+			if (lang[len] == '\0' && (tag[len] == '\0' || tag[len] == '-')) {
+				retval = TRUE;
+				break;
+			}
+		}
+	}
+	g_strfreev (tags);
+
+	return retval;
+}
+
+/* The SMIL test attributes, for <switch> alternatives,
+ * or to skip any element */
+static gboolean
+smil_node_passes_tests (const SmilContext *ctx, xml_node_t *node)
+{
+	const char *value;
+
+	value = smil_node_get_property (node, "systemBitrate", "system-bitrate");
+	if (value != NULL && ctx->bitrate != 0 &&
+	    g_ascii_strtoull (value, NULL, 10) > ctx->bitrate)
+		return FALSE;
+
+	value = smil_node_get_property (node, "systemLanguage", "system-language");
+	if (value != NULL && smil_language_matches (ctx, value) == FALSE)
+		return FALSE;
+
+	return TRUE;
+}
+
+/* The explicit duration of @node, from its "dur" or "end" attributes,
+ * or @implicit_duration otherwise */
+static gint64
+smil_node_get_duration (xml_node_t *node, gint64 implicit_duration)
+{
+	gint64 duration, begin, end;
+
+	duration = smil_parse_time (xml_parser_get_property (node, "dur"));
+	if (duration != SMIL_TIME_UNRESOLVED)
+		return duration;
+
+	end = smil_parse_time (xml_parser_get_property (node, "end"));
+	if (end != SMIL_TIME_UNRESOLVED) {
+		begin = smil_parse_time (xml_parser_get_property (node, "begin"));
+		if (begin == SMIL_TIME_UNRESOLVED)
+			begin = 0;
+		return MAX (end - begin, 0);
+	}
+
+	return implicit_duration;
+}
+
 static void
-parse_smil_entry_add (TotemPlParser *parser,
-		      GFile *base_file,
-		      const char *uri,
-		      const char *title,
-		      const char *abstract,
-		      const char *copyright,
-		      const char *author,
-		      const char *clip_begin,
-		      const char *dur,
-		      const char *subtitle_uri)
+smil_entry_add (SmilContext *ctx, SmilEntry *entry)
 {
-	char *resolved_uri, *sub;
-	GFile *resolved;
+	xml_node_t *node = entry->node;
+	const char *uri, *title, *subtitle_uri, *dur;
+	char *resolved_uri, *sub, *duration_ms, *offset_ms;
 
-	resolved_uri = totem_pl_parser_resolve_uri (base_file, uri);
-	if (resolved_uri == NULL)
-		resolved = g_file_new_for_uri (uri);
-	else
-		resolved = g_file_new_for_uri (resolved_uri);
-	g_free (resolved_uri);
+	if (node == NULL)
+		return;
+	entry->node = NULL;
+
+	uri = xml_parser_get_property (node, "src");
+	if (uri == NULL)
+		return;
+	resolved_uri = totem_pl_parser_resolve_uri_with_base (ctx->base, uri);
 
 	sub = NULL;
+	subtitle_uri = entry->subtitle_uri;
 	if (subtitle_uri != NULL)
-		sub = totem_pl_parser_resolve_uri (base_file, subtitle_uri);
+		sub = totem_pl_parser_resolve_uri_with_base (ctx->base, subtitle_uri);
+
+	title = xml_parser_get_property (node, "title");
+	if (title == NULL)
+		title = ctx->title;
+
+	/* Fall back to the unparsed duration if we can't do better */
+	duration_ms = NULL;
+	dur = NULL;
+	if (entry->duration != SMIL_TIME_UNRESOLVED)
+		duration_ms = g_strdup_printf ("%" G_GINT64_FORMAT, entry->duration);
+	else
+		dur = xml_parser_get_property (node, "dur");
+
+	offset_ms = NULL;
+	if (entry->offset != SMIL_TIME_UNRESOLVED)
+		offset_ms = g_strdup_printf ("%" G_GINT64_FORMAT, entry->offset);
 
-	totem_pl_parser_add_uri (parser,
-				 TOTEM_PL_PARSER_FIELD_FILE, resolved,
+	totem_pl_parser_add_uri (ctx->parser,
+				 TOTEM_PL_PARSER_FIELD_URI, resolved_uri ? resolved_uri : uri,
 				 TOTEM_PL_PARSER_FIELD_TITLE, title,
-				 TOTEM_PL_PARSER_FIELD_ABSTRACT, abstract,
-				 TOTEM_PL_PARSER_FIELD_COPYRIGHT, copyright,
-				 TOTEM_PL_PARSER_FIELD_AUTHOR, author,
-				 TOTEM_PL_PARSER_FIELD_STARTTIME, clip_begin,
+				 TOTEM_PL_PARSER_FIELD_ABSTRACT, xml_parser_get_property (node, "abstract"),
+				 TOTEM_PL_PARSER_FIELD_COPYRIGHT, xml_parser_get_property (node, "copyright"),
+				 TOTEM_PL_PARSER_FIELD_AUTHOR, xml_parser_get_property (node, "author"),
+				 TOTEM_PL_PARSER_FIELD_STARTTIME, smil_node_get_property (node, "clipBegin", "clip-begin"),
 				 TOTEM_PL_PARSER_FIELD_DURATION, dur,
+				 TOTEM_PL_PARSER_FIELD_DURATION_MS, duration_ms,
+				 TOTEM_PL_PARSER_FIELD_OFFSET_MS, offset_ms,
 				 TOTEM_PL_PARSER_FIELD_SUBTITLE_URI, sub ? sub : subtitle_uri,
 				 NULL);
-	g_object_unref (resolved);
+	g_free (resolved_uri);
 	g_free (sub);
+	g_free (duration_ms);
+	g_free (offset_ms);
+
+	ctx->added = TRUE;
 }
 
-static TotemPlParserResult
-parse_smil_entry (TotemPlParser *parser,
-		  GFile *base_file,
-		  xml_node_t *doc,
-		  xml_node_t *parent,
-		  const char *parent_title)
+static gint64 smil_eval_container (SmilContext *ctx, xml_node_t *parent,
+				   SmilElementType type, gint64 start);
+
+/* Evaluates @node, which starts at @start in the presentation, and
+ * returns its duration. Media elements are left in @pending, until
+ * we know whether a <textstream> follows them */
+static gint64
+smil_eval_node (SmilContext     *ctx,
+		xml_node_t      *node,
+		SmilElementType  type,
+		gint64           start,
+		SmilEntry       *pending)
 {
+	gint64 duration;
+
+	if (type == SMIL_ELEMENT_MEDIA) {
+		gint64 clip_begin, clip_end;
+
+		/* Without the media's length, only the clip can tell */
+		duration = SMIL_TIME_UNRESOLVED;
+		clip_end = smil_parse_time (smil_node_get_property (node, "clipEnd", "clip-end"));
+		if (clip_end != SMIL_TIME_UNRESOLVED) {
+			clip_begin = smil_parse_time (smil_node_get_property (node, "clipBegin", "clip-begin"));
+			if (clip_begin == SMIL_TIME_UNRESOLVED)
+				clip_begin = 0;
+			duration = MAX (clip_end - clip_begin, 0);
+		}
+		duration = smil_node_get_duration (node, duration);
+
+		pending->node = node;
+		pending->offset = start;
+		pending->duration = duration;
+		pending->subtitle_uri = NULL;
+
+		return duration;
+	}
+
+	/* Anything else that isn't a time container, such as links,
+	 * just groups its children */
+	if (type == SMIL_ELEMENT_OTHER)
+		type = SMIL_ELEMENT_SEQ;
+
+	duration = smil_eval_container (ctx, node, type, start);
+	return smil_node_get_duration (node, duration);
+}
+
+/* Goes through the children of the time container @parent,
+ * starting at @start, adding the media it selects as it goes,
+ * so that the alternatives a <switch> didn't select never get
+ * looked at. Returns the container's implicit duration. */
+static gint64
+smil_eval_container (SmilContext     *ctx,
+		     xml_node_t      *parent,
+		     SmilElementType  type,
+		     gint64           start)
+{
+	SmilEntry pending = { NULL, };
 	xml_node_t *node;
-	const char *title, *uri, *author, *abstract, *dur, *clip_begin, *copyright, *subtitle_uri;
-	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_ERROR;
-	gboolean added;
+	gint64 duration;
 
-	title = NULL;
-	uri = NULL;
-	subtitle_uri = NULL;
-	author = NULL;
-	abstract = NULL;
-	dur = NULL;
-	clip_begin = NULL;
-	copyright = NULL;
-	added = FALSE;
+	duration = 0;
 
 	for (node = parent->child; node != NULL; node = node->next) {
+		SmilElementType child_type;
+		gint64 begin, child_start, child_duration;
+
 		if (node->name == NULL)
 			continue;
 
-		/* ENTRY should only have one ref and one title nodes */
-		if (g_ascii_strcasecmp (node->name, "video") == 0
-		    || g_ascii_strcasecmp (node->name, "audio") == 0
-		    || g_ascii_strcasecmp (node->name, "media") == 0) {
-			/* Send the previous entry */
-			if (uri != NULL && added == FALSE) {
-				parse_smil_entry_add (parser,
-						      base_file,
-						      uri,
-						      title ? title : parent_title,
-						      abstract,
-						      copyright,
-						      author,
-						      clip_begin,
-						      dur,
-						      subtitle_uri);
-				added = TRUE;
-				retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
-			}
+		child_type = smil_element_type (node->name);
+		if (child_type == SMIL_ELEMENT_TEXTSTREAM) {
+			if (pending.node != NULL)
+				pending.subtitle_uri = xml_parser_get_property (node, "src");
+			continue;
+		}
 
-			uri = xml_parser_get_property (node, "src");
-			title = xml_parser_get_property (node, "title");
-			author = xml_parser_get_property (node, "author");
-			dur = xml_parser_get_property (node, "dur");
-			clip_begin = xml_parser_get_property (node, "clip-begin");
-			abstract = xml_parser_get_property (node, "abstract");
-			copyright = xml_parser_get_property (node, "copyright");
-			subtitle_uri = NULL;
-			added = FALSE;
-		} else if (g_ascii_strcasecmp (node->name, "textstream") == 0) {
-			subtitle_uri = xml_parser_get_property (node, "src");
-		} else {
-			if (parse_smil_entry (parser,
-						base_file, doc, node, parent_title) != FALSE)
-				retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
+		if (smil_node_passes_tests (ctx, node) == FALSE)
+			continue;
+
+		smil_entry_add (ctx, &pending);
+
+		begin = smil_parse_time (xml_parser_get_property (node, "begin"));
+		if (begin == SMIL_TIME_UNRESOLVED)
+			begin = 0;
+
+		/* In a <seq>, each child starts after the previous one */
+		if (start == SMIL_TIME_UNRESOLVED)
+			child_start = SMIL_TIME_UNRESOLVED;
+		else if (type == SMIL_ELEMENT_SEQ)
+			child_start = (duration == SMIL_TIME_UNRESOLVED) ? SMIL_TIME_UNRESOLVED : start + duration + begin;
+		else
+			child_start = start + begin;
+
+		child_duration = smil_eval_node (ctx, node, child_type, child_start, &pending);
+		if (child_duration != SMIL_TIME_UNRESOLVED)
+			child_duration += begin;
+
+		if (type == SMIL_ELEMENT_SWITCH) {
+			/* Only the first acceptable alternative is used */
+			duration = child_duration;
+			break;
 		}
-	}
 
-	if (uri != NULL && added == FALSE) {
-		parse_smil_entry_add (parser,
-				      base_file,
-				      uri,
-				      title ? title : parent_title,
-				      abstract,
-				      copyright,
-				      author,
-				      clip_begin,
-				      dur,
-				      subtitle_uri);
-		added = TRUE;
-		retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
+		if (duration == SMIL_TIME_UNRESOLVED || child_duration == SMIL_TIME_UNRESOLVED)
+			duration = SMIL_TIME_UNRESOLVED;
+		else if (type == SMIL_ELEMENT_SEQ)
+			duration += child_duration;
+		else
+			duration = MAX (duration, child_duration);
 	}
 
-	return retval;
+	smil_entry_add (ctx, &pending);
+
+	return duration;
 }
 
 static const char*
@@ -181,36 +442,50 @@ parse_smil_head (TotemPlParser *parser, xml_node_t *doc, xml_node_t *parent)
 }
 
 static TotemPlParserResult
-parse_smil_entries (TotemPlParser *parser, GFile *base_file, xml_node_t *doc)
+parse_smil_entries (TotemPlParser *parser, const TotemPlParserResolveBase *base, xml_node_t *doc)
 {
-	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_ERROR;
-	const char *title;
+	SmilContext ctx;
 	xml_node_t *node;
-
-	title = NULL;
+	const char * const *languages;
+	guint i;
+
+	ctx.parser = parser;
+	ctx.base = base;
+	ctx.title = NULL;
+	ctx.bitrate = 0;
+	ctx.added = FALSE;
+
+	/* Without a language preference, the language tests all pass */
+	ctx.languages = NULL;
+	languages = g_get_language_names ();
+	for (i = 0; languages[i] != NULL; i++) {
+		if (strcmp (languages[i], "C") != 0) {
+			ctx.languages = languages;
+			break;
+		}
+	}
 
 	for (node = doc->child; node != NULL; node = node->next) {
 		if (node->name == NULL)
 			continue;
 
 		if (g_ascii_strcasecmp (node->name, "body") == 0) {
-			if (parse_smil_entry (parser, base_file,
-					      doc, node, title) != FALSE) {
-				retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
-			}
-		} else if (title == NULL) {
+			/* The body is an implicit <seq> */
+			smil_eval_container (&ctx, node, SMIL_ELEMENT_SEQ, 0);
+		} else if (ctx.title == NULL) {
 			if (g_ascii_strcasecmp (node->name, "head") == 0)
-				title = parse_smil_head (parser, doc, node);
+				ctx.title = parse_smil_head (parser, doc, node);
 		}
 	}
 
-	return retval;
+	return ctx.added ? TOTEM_PL_PARSER_RESULT_SUCCESS : TOTEM_PL_PARSER_RESULT_ERROR;
 }
 
 static TotemPlParserResult
 totem_pl_parser_add_smil_with_doc (TotemPlParser *parser, GFile *file,
 				   GFile *base_file, xml_node_t *doc)
 {
+	TotemPlParserResolveBase *base;
 	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_UNHANDLED;
 
 	/* If the document has no root, or no name */
@@ -219,7 +494,9 @@ totem_pl_parser_add_smil_with_doc (TotemPlParser *parser, GFile *file,
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 	}
 
-	retval = parse_smil_entries (parser, base_file, doc);
+	base = totem_pl_parser_resolve_base_new (base_file);
+	retval = parse_smil_entries (parser, base, doc);
+	totem_pl_parser_resolve_base_free (base);
 
 	return retval;
 }
@@ -235,7 +512,7 @@ totem_pl_parser_add_smil (TotemPlParser *parser,
 	gsize size;
 	TotemPlParserResult retval;
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (file, parse_data, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
 	retval = totem_pl_parser_add_smil_with_data (parser, file,
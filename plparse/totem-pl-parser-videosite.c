@@ -124,6 +124,7 @@ totem_pl_parser_is_videosite (const char *uri, gboolean debug)
 
 	args[0] = script;
 	args[3] = uri;
+	TRACE1 (videosite_check_start, uri);
 	g_spawn_sync (NULL,
 		      (char **) args,
 		      NULL,
@@ -134,8 +135,12 @@ totem_pl_parser_is_videosite (const char *uri, gboolean debug)
 		      NULL,
 		      NULL,
 		      NULL);
+#ifndef TOTEM_PL_PARSER_MINI
+	totem_pl_parser_stats_add_helper_spawn ();
+#endif
 
 	ret = g_strcmp0 (out, "TRUE") == 0;
+	TRACE2 (videosite_check_done, uri, ret);
 	if (debug)
 		g_print ("Checking videosite with script '%s' for URI '%s' returned '%s' (%s)\n",
 			 script, uri, out, ret ? "true" : "false");
@@ -172,13 +177,14 @@ totem_pl_parser_add_videosite (TotemPlParser *parser,
 
 	script = find_helper_script ();
 	if (script == NULL) {
-		DEBUG (file, g_print ("Did not find a script to check whether '%s' is a videosite\n", uri));
+		DEBUG (FORMAT, file, g_print ("Did not find a script to check whether '%s' is a videosite\n", uri));
 		return FALSE;
 	}
 
 	_uri = g_file_get_uri (file);
 	args[0] = script;
 	args[2] = _uri;
+	TRACE1 (videosite_parse_start, _uri);
 	g_spawn_sync (NULL,
 		      (char **) args,
 		      NULL,
@@ -189,8 +195,8 @@ totem_pl_parser_add_videosite (TotemPlParser *parser,
 		      NULL,
 		      NULL,
 		      NULL);
-	if (totem_pl_parser_is_debugging_enabled (parser))
-		g_print ("Parsing videosite for URI '%s' returned '%s'\n", _uri, out);
+	totem_pl_parser_stats_add_helper_spawn ();
+	DEBUG1(FORMAT, g_print ("Parsing videosite for URI '%s' returned '%s'\n", _uri, out));
 
 	if (out != NULL) {
 		if (g_str_equal (out, "TOTEM_PL_PARSER_RESULT_ERROR")) {
@@ -231,6 +237,7 @@ totem_pl_parser_add_videosite (TotemPlParser *parser,
 	ret = TOTEM_PL_PARSER_RESULT_SUCCESS;
 
 out:
+	TRACE2 (videosite_parse_done, _uri, ret);
 	g_free (script);
 	g_free (_uri);
 	return ret;
@@ -77,86 +77,8 @@ totem_pl_parser_is_asf (const char *data, gsize len)
 
 #ifndef TOTEM_PL_PARSER_MINI
 
-static TotemPlParserResult
-totem_pl_parser_add_asf_reference_parser (TotemPlParser *parser,
-					  GFile *file,
-					  GFile *base_file,
-					  TotemPlParseData *parse_data,
-					  gpointer data)
-{
-	char *contents, **lines, *ref;
-	gsize size;
-
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
-		return TOTEM_PL_PARSER_RESULT_ERROR;
-
-	lines = g_strsplit_set (contents, "\n\r", 0);
-	g_free (contents);
-
-	/* Try to get Ref1 first */
-	ref = totem_pl_parser_read_ini_line_string (lines, "Ref1");
-	if (ref == NULL) {
-		g_strfreev (lines);
-		return totem_pl_parser_add_asx (parser, file, base_file, parse_data, data);
-	}
-
-	/* change http to mmsh, thanks Microsoft */
-	if (g_str_has_prefix (ref, "http") != FALSE)
-		memcpy(ref, "mmsh", 4);
-
-	totem_pl_parser_add_one_uri (parser, ref, NULL);
-	g_free (ref);
-
-	/* Don't try to get Ref2, as it's only ever
-	 * supposed to be a fallback */
-
-	g_strfreev (lines);
-
-	return TOTEM_PL_PARSER_RESULT_SUCCESS;
-}
-
-static TotemPlParserResult
-totem_pl_parser_add_asf_parser (TotemPlParser *parser,
-				GFile *file,
-				GFile *base_file,
-				TotemPlParseData *parse_data,
-				gpointer data)
-{
-	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_UNHANDLED;
-	char *contents, *ref;
-	gsize size;
-
-	/* NSC files are handled directly by GStreamer */
-	if (g_str_has_prefix (data, "[Address]") != FALSE)
-		return TOTEM_PL_PARSER_RESULT_UNHANDLED;
-
-	if (g_str_has_prefix (data, "ASF ") == FALSE) {
-		return totem_pl_parser_add_asf_reference_parser (parser, file, base_file, parse_data, data);
-	}
-
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
-		return TOTEM_PL_PARSER_RESULT_ERROR;
-
-	if (size <= 4) {
-		g_free (contents);
-		return TOTEM_PL_PARSER_RESULT_ERROR;
-	}
-
-	/* Skip 'ASF ' */
-	ref = contents + 4;
-	if (g_str_has_prefix (ref, "http") != FALSE) {
-		memcpy(ref, "mmsh", 4);
-		totem_pl_parser_add_one_uri (parser, ref, NULL);
-		retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
-	}
-
-	g_free (contents);
-
-	return retval;
-}
-
 static gboolean
-parse_asx_entry (TotemPlParser *parser, GFile *base_file, xml_node_t *parent, TotemPlParseData *parse_data)
+parse_asx_entry (TotemPlParser *parser, const TotemPlParserResolveBase *base, xml_node_t *parent, TotemPlParseData *parse_data)
 {
 	xml_node_t *node;
 	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
@@ -252,15 +174,14 @@ parse_asx_entry (TotemPlParser *parser, GFile *base_file, xml_node_t *parent, To
 	if (uri == NULL)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
-	resolved_uri = totem_pl_parser_resolve_uri (base_file, uri);
+	resolved_uri = totem_pl_parser_resolve_uri_with_base (base, uri);
 	resolved = g_file_new_for_uri (resolved_uri);
-	g_free (resolved_uri);
 
 	/* .asx files can contain references to other .asx files */
 	retval = totem_pl_parser_parse_internal (parser, resolved, NULL, parse_data);
 	if (retval != TOTEM_PL_PARSER_RESULT_SUCCESS) {
 		totem_pl_parser_add_uri (parser,
-					 TOTEM_PL_PARSER_FIELD_FILE, resolved,
+					 TOTEM_PL_PARSER_FIELD_URI, resolved_uri,
 					 TOTEM_PL_PARSER_FIELD_TITLE, title,
 					 TOTEM_PL_PARSER_FIELD_ABSTRACT, abstract,
 					 TOTEM_PL_PARSER_FIELD_COPYRIGHT, copyright,
@@ -272,13 +193,14 @@ parse_asx_entry (TotemPlParser *parser, GFile *base_file, xml_node_t *parent, To
 		retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
 	}
 	g_object_unref (resolved);
+	g_free (resolved_uri);
 
 bail:
 	return retval;
 }
 
 static gboolean
-parse_asx_entryref (TotemPlParser *parser, GFile *base_file, xml_node_t *node, TotemPlParseData *parse_data)
+parse_asx_entryref (TotemPlParser *parser, const TotemPlParserResolveBase *base, xml_node_t *node, TotemPlParseData *parse_data)
 {
 	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
 	const char *uri;
@@ -290,28 +212,96 @@ parse_asx_entryref (TotemPlParser *parser, GFile *base_file, xml_node_t *node, T
 	if (uri == NULL)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
-	resolved_uri = totem_pl_parser_resolve_uri (base_file, uri);
+	resolved_uri = totem_pl_parser_resolve_uri_with_base (base, uri);
 	resolved = g_file_new_for_uri (resolved_uri);
-	g_free (resolved_uri);
 
 	/* .asx files can contain references to other .asx files */
 	retval = totem_pl_parser_parse_internal (parser, resolved, NULL, parse_data);
 	if (retval != TOTEM_PL_PARSER_RESULT_SUCCESS) {
 		totem_pl_parser_add_uri (parser,
-					 TOTEM_PL_PARSER_FIELD_FILE, resolved,
+					 TOTEM_PL_PARSER_FIELD_URI, resolved_uri,
 					 NULL);
 		retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
 	}
 	g_object_unref (resolved);
+	g_free (resolved_uri);
 
 	return retval;
 }
 
+static GFile *
+asx_entryref_prefetch_file (TotemPlParser *parser, const TotemPlParserResolveBase *base, xml_node_t *node)
+{
+	const char *href;
+	char *resolved_uri;
+	GFile *file;
+
+	href = xml_parser_get_property (node, "href");
+	if (href == NULL)
+		return NULL;
+
+	resolved_uri = totem_pl_parser_resolve_uri_with_base (base, href);
+	file = g_file_new_for_uri (resolved_uri);
+
+	/* Local files are quick enough to read when we get to them,
+	 * streams aren't playlists, and neither is anything which
+	 * looks like media from its name */
+	if (g_file_is_native (file) != FALSE
+	    || (g_file_has_uri_scheme (file, "http") == FALSE
+		&& g_file_has_uri_scheme (file, "https") == FALSE)
+	    || totem_pl_parser_scheme_is_ignored (parser, file) != FALSE
+	    || totem_pl_parser_ignore (parser, resolved_uri) != FALSE) {
+		g_clear_object (&file);
+	}
+	g_free (resolved_uri);
+
+	return file;
+}
+
+static TotemPlParserPrefetch *
+parse_asx_prefetch_entryrefs (TotemPlParser *parser, const TotemPlParserResolveBase *base, xml_node_t *parent, TotemPlParseData *parse_data)
+{
+	TotemPlParserPrefetch *prefetch;
+	GPtrArray *files;
+	xml_node_t *node;
+	gboolean has_remote;
+
+	/* The entryrefs won't be parsed anyway */
+	if (parse_data->recurse == FALSE)
+		return NULL;
+
+	files = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	has_remote = FALSE;
+	for (node = parent->child; node != NULL; node = node->next) {
+		GFile *file;
+
+		if (node->name == NULL
+		    || g_ascii_strcasecmp (node->name, "entryref") != 0)
+			continue;
+
+		/* One slot per entryref, in document order */
+		file = asx_entryref_prefetch_file (parser, base, node);
+		if (file != NULL)
+			has_remote = TRUE;
+		g_ptr_array_add (files, file);
+	}
+
+	prefetch = NULL;
+	if (has_remote != FALSE)
+		prefetch = totem_pl_parser_prefetch_new (parser, files, parse_data);
+	g_ptr_array_free (files, TRUE);
+
+	return prefetch;
+}
+
 static gboolean
 parse_asx_entries (TotemPlParser *parser, const char *uri, GFile *base_file, xml_node_t *parent, TotemPlParseData *parse_data)
 {
 	char *title = NULL;
 	GFile *new_base;
+	TotemPlParserResolveBase *base;
+	TotemPlParserPrefetch *prefetch;
+	guint num_entryrefs;
 	xml_node_t *node;
 	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_ERROR;
 
@@ -341,6 +331,14 @@ parse_asx_entries (TotemPlParser *parser, const char *uri, GFile *base_file, xml
 		}
 	}
 
+	/* Resolve relative entries against the same base for the whole block */
+	base = totem_pl_parser_resolve_base_new (new_base ? new_base : base_file);
+
+	/* Remote entryrefs get fetched in the background, while we
+	 * go through the entries in order */
+	prefetch = parse_asx_prefetch_entryrefs (parser, base, parent, parse_data);
+	num_entryrefs = 0;
+
 	/* Restart for the entries now */
 	for (node = parent->child; node != NULL; node = node->next) {
 		if (node->name == NULL)
@@ -348,13 +346,18 @@ parse_asx_entries (TotemPlParser *parser, const char *uri, GFile *base_file, xml
 
 		if (g_ascii_strcasecmp (node->name, "entry") == 0) {
 			/* Whee! found an entry here, find the REF and TITLE */
-			if (parse_asx_entry (parser, new_base ? new_base : base_file, node, parse_data) != FALSE)
+			if (parse_asx_entry (parser, base, node, parse_data) != FALSE)
 				retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
 		}
 		if (g_ascii_strcasecmp (node->name, "entryref") == 0) {
 			/* Found an entryref, extract the REF attribute */
-			if (parse_asx_entryref (parser, new_base ? new_base : base_file, node, parse_data) != FALSE)
+			if (prefetch != NULL)
+				totem_pl_parser_prefetch_claim (prefetch, num_entryrefs, parse_data);
+			if (parse_asx_entryref (parser, base, node, parse_data) != FALSE)
 				retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
+			if (prefetch != NULL)
+				totem_pl_parser_prefetch_release (prefetch, num_entryrefs, parse_data);
+			num_entryrefs++;
 		}
 		if (g_ascii_strcasecmp (node->name, "repeat") == 0) {
 			/* Repeat at the top-level */
@@ -363,6 +366,9 @@ parse_asx_entries (TotemPlParser *parser, const char *uri, GFile *base_file, xml
 		}
 	}
 
+	if (prefetch != NULL)
+		totem_pl_parser_prefetch_free (prefetch);
+	totem_pl_parser_resolve_base_free (base);
 	if (new_base != NULL)
 		g_object_unref (new_base);
 	if (title != NULL)
@@ -372,6 +378,40 @@ parse_asx_entries (TotemPlParser *parser, const char *uri, GFile *base_file, xml
 	return retval;
 }
 
+static TotemPlParserResult
+totem_pl_parser_add_asx_with_contents (TotemPlParser *parser,
+				       GFile *file,
+				       GFile *base_file,
+				       TotemPlParseData *parse_data,
+				       char *contents,
+				       gsize size)
+{
+	xml_node_t* doc;
+	char *uri;
+	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_UNHANDLED;
+
+	doc = totem_pl_parser_parse_xml_relaxed (contents, size);
+	if (doc == NULL)
+		return TOTEM_PL_PARSER_RESULT_ERROR;
+
+	/* If the document has no name */
+	if (doc->name == NULL
+	    || g_ascii_strcasecmp (doc->name , "asx") != 0) {
+		xml_parser_free_tree (doc);
+		return TOTEM_PL_PARSER_RESULT_ERROR;
+	}
+
+	uri = g_file_get_uri (file);
+
+	if (parse_asx_entries (parser, uri, base_file, doc, parse_data) != FALSE)
+		retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
+
+	g_free (uri);
+	xml_parser_free_tree (doc);
+
+	return retval;
+}
+
 TotemPlParserResult
 totem_pl_parser_add_asx (TotemPlParser *parser,
 			 GFile *file,
@@ -379,40 +419,132 @@ totem_pl_parser_add_asx (TotemPlParser *parser,
 			 TotemPlParseData *parse_data,
 			 gpointer data)
 {
-	xml_node_t* doc;
-	char *contents, *uri;
+	char *contents;
 	gsize size;
-	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_UNHANDLED;
+	TotemPlParserResult retval;
 
 	if (data != NULL && totem_pl_parser_is_uri_list (data, strlen (data)) != FALSE) {
 		return totem_pl_parser_add_ram (parser, file, parse_data, data);
 	}
 
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
+	if (totem_pl_parser_load_contents (file, parse_data, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 
-	doc = totem_pl_parser_parse_xml_relaxed (contents, size);
-	if (doc == NULL) {
-		g_free (contents);
+	retval = totem_pl_parser_add_asx_with_contents (parser, file, base_file, parse_data, contents, size);
+	g_free (contents);
+
+	return retval;
+}
+
+/* Looks for the first line starting with @key, ignoring leading
+ * whitespace, like totem_pl_parser_read_ini_line_string() would, but
+ * without splitting @contents into lines. The line gets nul-terminated
+ * in place, and its value is returned. */
+static char *
+asf_reference_find_value (char *contents, const char *key)
+{
+	gsize key_len;
+	char *line;
+
+	key_len = strlen (key);
+	line = contents;
+
+	while (*line != '\0') {
+		char *end, *value;
+
+		end = line + strcspn (line, "\r\n");
+		while (*line == '\t' || *line == ' ')
+			line++;
+
+		if ((gsize) (end - line) >= key_len &&
+		    g_ascii_strncasecmp (line, key, key_len) == 0) {
+			value = memchr (line, '=', end - line);
+			if (value == NULL)
+				return NULL;
+			*end = '\0';
+			return value + 1;
+		}
+
+		if (*end == '\0')
+			break;
+		line = end + 1;
+	}
+
+	return NULL;
+}
+
+static TotemPlParserResult
+totem_pl_parser_add_asf_reference_parser (TotemPlParser *parser,
+					  GFile *file,
+					  GFile *base_file,
+					  TotemPlParseData *parse_data,
+					  gpointer data,
+					  char *contents,
+					  gsize size)
+{
+	char *ref;
+
+	/* Try to get Ref1 first */
+	ref = asf_reference_find_value (contents, "Ref1");
+	if (ref == NULL) {
+		/* Not a reference file after all, try it as ASX,
+		 * with the contents we already have */
+		if (data != NULL && totem_pl_parser_is_uri_list (data, strlen (data)) != FALSE)
+			return totem_pl_parser_add_ram (parser, file, parse_data, data);
+		return totem_pl_parser_add_asx_with_contents (parser, file, base_file, parse_data, contents, size);
+	}
+
+	/* change http to mmsh, thanks Microsoft */
+	if (g_str_has_prefix (ref, "http") != FALSE)
+		memcpy(ref, "mmsh", 4);
+
+	totem_pl_parser_add_one_uri (parser, ref, NULL);
+
+	/* Don't try to get Ref2, as it's only ever
+	 * supposed to be a fallback */
+
+	return TOTEM_PL_PARSER_RESULT_SUCCESS;
+}
+
+static TotemPlParserResult
+totem_pl_parser_add_asf_parser (TotemPlParser *parser,
+				GFile *file,
+				GFile *base_file,
+				TotemPlParseData *parse_data,
+				gpointer data)
+{
+	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_UNHANDLED;
+	char *contents, *ref;
+	gsize size;
+
+	/* NSC files are handled directly by GStreamer */
+	if (g_str_has_prefix (data, "[Address]") != FALSE)
+		return TOTEM_PL_PARSER_RESULT_UNHANDLED;
+
+	/* Loaded only once, and passed down to all the fallbacks */
+	if (totem_pl_parser_load_contents (file, parse_data, &contents, &size) == FALSE)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
+
+	if (g_str_has_prefix (data, "ASF ") == FALSE) {
+		retval = totem_pl_parser_add_asf_reference_parser (parser, file, base_file, parse_data, data, contents, size);
+		g_free (contents);
+		return retval;
 	}
 
-	/* If the document has no name */
-	if (doc->name == NULL
-	    || g_ascii_strcasecmp (doc->name , "asx") != 0) {
+	if (size <= 4) {
 		g_free (contents);
-		xml_parser_free_tree (doc);
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 	}
 
-	uri = g_file_get_uri (file);
-
-	if (parse_asx_entries (parser, uri, base_file, doc, parse_data) != FALSE)
+	/* Skip 'ASF ' */
+	ref = contents + 4;
+	if (g_str_has_prefix (ref, "http") != FALSE) {
+		memcpy(ref, "mmsh", 4);
+		totem_pl_parser_add_one_uri (parser, ref, NULL);
 		retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
+	}
 
-	g_free (uri);
 	g_free (contents);
-	xml_parser_free_tree (doc);
 
 	return retval;
 }
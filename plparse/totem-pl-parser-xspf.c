@@ -28,6 +28,7 @@
 #include <glib/gi18n-lib.h>
 #include <libxml/tree.h>
 #include <libxml/parser.h>
+#include <libxml/SAX2.h>
 
 #include "totem-pl-parser.h"
 #endif /* !TOTEM_PL_PARSER_MINI */
@@ -46,43 +47,35 @@ debug_noop (void *ctx, const char *msg, ...)
 	return;
 }
 
-static xmlDocPtr
-totem_pl_parser_parse_xml_file (GFile *file)
-{
-	xmlDocPtr doc;
-	char *contents;
-	gsize size;
-
-	if (g_file_load_contents (file, NULL, &contents, &size, NULL, NULL) == FALSE)
-		return NULL;
-
-	/* Try to remove HTML style comments */
-	{
-		char *needle;
-
-		while ((needle = strstr (contents, "<!--")) != NULL) {
-			while (strncmp (needle, "-->", 3) != 0) {
-				*needle = ' ';
-				needle++;
-				if (*needle == '\0')
-					break;
-			}
-		}
-	}
-
-	xmlSetGenericErrorFunc (NULL, (xmlGenericErrorFunc) debug_noop);
-	doc = xmlParseMemory (contents, size);
-	if (doc == NULL)
-		doc = xmlRecoverMemory (contents, size);
-	g_free (contents);
-
-	return doc;
-}
-
-static struct {
+/* Per-track values, indexed by slot. The ones before
+ * XSPF_SLOT_LOCATION are the ones saved, in that order */
+typedef enum {
+	XSPF_SLOT_TITLE,
+	XSPF_SLOT_AUTHOR,
+	XSPF_SLOT_IMAGE_URI,
+	XSPF_SLOT_ALBUM,
+	XSPF_SLOT_DURATION_MS,
+	XSPF_SLOT_GENRE,
+	XSPF_SLOT_STARTTIME,
+	XSPF_SLOT_SUBTITLE_URI,
+	XSPF_SLOT_PLAYING,
+	XSPF_SLOT_CONTENT_TYPE,
+	XSPF_SLOT_LOCATION,
+	XSPF_SLOT_MOREINFO,
+	XSPF_SLOT_DOWNLOAD_URI,
+	XSPF_SLOT_ID,
+	XSPF_SLOT_FILESIZE,
+	NUM_XSPF_SLOTS
+} XspfSlot;
+
+#define NUM_SAVED_XSPF_SLOTS XSPF_SLOT_LOCATION
+
+/* The element is the child of <track> the value is read from,
+ * and written to, if it's not in an extension */
+static const struct {
 	const char *field;
 	const char *element;
-} fields[] = {
+} fields[NUM_XSPF_SLOTS] = {
 	{ TOTEM_PL_PARSER_FIELD_TITLE, "title" },
 	{ TOTEM_PL_PARSER_FIELD_AUTHOR, "creator" },
 	{ TOTEM_PL_PARSER_FIELD_IMAGE_URI, "image" },
@@ -92,9 +85,132 @@ static struct {
 	{ TOTEM_PL_PARSER_FIELD_STARTTIME, NULL },
 	{ TOTEM_PL_PARSER_FIELD_SUBTITLE_URI, NULL },
 	{ TOTEM_PL_PARSER_FIELD_PLAYING, NULL },
-	{ TOTEM_PL_PARSER_FIELD_CONTENT_TYPE, NULL }
+	{ TOTEM_PL_PARSER_FIELD_CONTENT_TYPE, NULL },
+	{ TOTEM_PL_PARSER_FIELD_URI, "location" },
+	{ TOTEM_PL_PARSER_FIELD_MOREINFO, NULL },
+	{ TOTEM_PL_PARSER_FIELD_DOWNLOAD_URI, NULL },
+	/* Last.fm's authorisation for the track */
+	{ TOTEM_PL_PARSER_FIELD_ID, "trackauth" },
+	{ TOTEM_PL_PARSER_FIELD_FILESIZE, NULL }
+};
+
+/* Pre-rendered markup around each saved field */
+typedef enum {
+	XSPF_GROUP_TRACK,
+	XSPF_GROUP_RHYTHMBOX,
+	XSPF_GROUP_GNOME
+} XspfGroup;
+
+#define TRACK_FRAGMENT(element) { XSPF_GROUP_TRACK, "   <" element ">", "</" element ">\n" }
+#define GNOME_FRAGMENT(element) { XSPF_GROUP_GNOME, "     <" element ">", "</" element ">\n" }
+
+static const struct {
+	XspfGroup group;
+	const char *open;
+	const char *close;
+} fragments[NUM_SAVED_XSPF_SLOTS] = {
+	TRACK_FRAGMENT ("title"),
+	TRACK_FRAGMENT ("creator"),
+	TRACK_FRAGMENT ("image"),
+	TRACK_FRAGMENT ("album"),
+	TRACK_FRAGMENT ("duration"),
+	{ XSPF_GROUP_RHYTHMBOX,
+	  "   <extension application=\"http://www.rhythmbox.org\">\n"
+	  "     <genre>",
+	  "</genre>\n"
+	  "   </extension>\n" },
+	GNOME_FRAGMENT (TOTEM_PL_PARSER_FIELD_STARTTIME),
+	GNOME_FRAGMENT (TOTEM_PL_PARSER_FIELD_SUBTITLE_URI),
+	GNOME_FRAGMENT (TOTEM_PL_PARSER_FIELD_PLAYING),
+	GNOME_FRAGMENT (TOTEM_PL_PARSER_FIELD_CONTENT_TYPE)
 };
 
+#define GNOME_EXTENSION_OPEN "   <extension application=\"http://www.gnome.org\">\n"
+#define GNOME_EXTENSION_CLOSE "   </extension>\n"
+
+/* Flush the output once it gets that big */
+#define XSPF_WRITE_BUFFER_SIZE 65536
+
+/* The same escaping as g_markup_escape_text(), for each byte
+ * that needs it. Bytes without an entry are copied as is */
+static const char *xml_escapes[256] = {
+	[0x01] = "&#x1;",
+	[0x02] = "&#x2;",
+	[0x03] = "&#x3;",
+	[0x04] = "&#x4;",
+	[0x05] = "&#x5;",
+	[0x06] = "&#x6;",
+	[0x07] = "&#x7;",
+	[0x08] = "&#x8;",
+	[0x0b] = "&#xb;",
+	[0x0c] = "&#xc;",
+	[0x0e] = "&#xe;",
+	[0x0f] = "&#xf;",
+	[0x10] = "&#x10;",
+	[0x11] = "&#x11;",
+	[0x12] = "&#x12;",
+	[0x13] = "&#x13;",
+	[0x14] = "&#x14;",
+	[0x15] = "&#x15;",
+	[0x16] = "&#x16;",
+	[0x17] = "&#x17;",
+	[0x18] = "&#x18;",
+	[0x19] = "&#x19;",
+	[0x1a] = "&#x1a;",
+	[0x1b] = "&#x1b;",
+	[0x1c] = "&#x1c;",
+	[0x1d] = "&#x1d;",
+	[0x1e] = "&#x1e;",
+	[0x1f] = "&#x1f;",
+	['"'] = "&quot;",
+	['&'] = "&amp;",
+	['\''] = "&apos;",
+	['<'] = "&lt;",
+	['>'] = "&gt;",
+	[0x7f] = "&#x7f;",
+};
+
+static void
+xml_append_escaped (GString    *str,
+		    const char *text)
+{
+	const guchar *p, *run;
+
+	run = p = (const guchar *) text;
+	while (*p != '\0') {
+		if (xml_escapes[*p] != NULL) {
+			g_string_append_len (str, (const char *) run, p - run);
+			g_string_append (str, xml_escapes[*p]);
+			run = ++p;
+		} else if (*p == 0xc2 && p[1] >= 0x80 && p[1] <= 0x9f && p[1] != 0x85) {
+			/* C1 control characters, apart from NEL */
+			g_string_append_len (str, (const char *) run, p - run);
+			g_string_append_printf (str, "&#x%x;", p[1]);
+			p += 2;
+			run = p;
+		} else {
+			p++;
+		}
+	}
+	g_string_append_len (str, (const char *) run, p - run);
+}
+
+/* Unlike totem_pl_parser_write_buffer(), leaves @stream to the caller */
+static gboolean
+xspf_write_buffer (GFileOutputStream  *stream,
+		   GString            *buf,
+		   GError            **error)
+{
+	gboolean success;
+
+	success = g_output_stream_write_all (G_OUTPUT_STREAM (stream),
+					     buf->str, buf->len,
+					     NULL, NULL, error);
+	g_string_truncate (buf, 0);
+
+	return success;
+}
+
 gboolean
 totem_pl_parser_save_xspf (TotemPlParser    *parser,
                            TotemPlPlaylist  *playlist,
@@ -104,123 +220,81 @@ totem_pl_parser_save_xspf (TotemPlParser    *parser,
 {
         TotemPlPlaylistIter iter;
 	GFileOutputStream *stream;
-	char *buf;
+	GString *buf;
 	gboolean valid, success;
 
+	success = TRUE;
 	stream = g_file_replace (output, NULL, FALSE, G_FILE_CREATE_NONE, NULL, error);
 	if (stream == NULL)
 		return FALSE;
 
-	buf = g_strdup_printf ("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
-				"<playlist version=\"1\" xmlns=\"http://xspf.org/ns/0/\">\n"
-				" <trackList>\n");
-	success = totem_pl_parser_write_string (G_OUTPUT_STREAM (stream), buf, error);
-	g_free (buf);
-	if (success == FALSE)
-		return FALSE;
+	/* The whole playlist goes through the same buffer */
+	buf = g_string_sized_new (XSPF_WRITE_BUFFER_SIZE);
+	g_string_append (buf,
+			 "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+			 "<playlist version=\"1\" xmlns=\"http://xspf.org/ns/0/\">\n"
+			 " <trackList>\n");
 
         valid = totem_pl_playlist_iter_first (playlist, &iter);
 
-        while (valid) {
-		char *uri, *uri_escaped, *relative;
+        while (valid && success) {
+		const char *uri;
+		char *relative;
 		guint i;
 		gboolean wrote_ext;
 
-                totem_pl_playlist_get (playlist, &iter,
-                                       TOTEM_PL_PARSER_FIELD_URI, &uri,
-                                       NULL);
-
-
+		uri = totem_pl_playlist_iter_lookup (&iter, TOTEM_PL_PARSER_FIELD_URI);
                 if (!uri) {
-			valid = totem_pl_playlist_iter_next (playlist, &iter);
+			valid = totem_pl_playlist_iter_step (&iter);
                         continue;
 		}
 
-		/* Whether we already wrote the GNOME extensions section header
-		 * for that particular track */
-		wrote_ext = FALSE;
-
 		relative = totem_pl_parser_relative (output, uri);
-		uri_escaped = g_markup_escape_text (relative ? relative : uri, -1);
-		buf = g_strdup_printf ("  <track>\n"
-                                       "   <location>%s</location>\n", uri_escaped);
-		success = totem_pl_parser_write_string (G_OUTPUT_STREAM (stream), buf, error);
-		g_free (uri);
-		g_free (uri_escaped);
+		g_string_append (buf,
+				 "  <track>\n"
+				 "   <location>");
+		xml_append_escaped (buf, relative ? relative : uri);
+		g_string_append (buf, "</location>\n");
 		g_free (relative);
-		g_free (buf);
 
-                if (success == FALSE)
-			return FALSE;
+		/* Whether we already wrote the GNOME extensions section header
+		 * for that particular track */
+		wrote_ext = FALSE;
 
-		for (i = 0; i < G_N_ELEMENTS (fields); i++) {
-			char *str, *escaped;
+		for (i = 0; i < NUM_SAVED_XSPF_SLOTS; i++) {
+			const char *value;
 
-			totem_pl_playlist_get (playlist, &iter,
-					       fields[i].field, &str,
-					       NULL);
-			if (!str || *str == '\0') {
-				g_free (str);
+			value = totem_pl_playlist_iter_lookup (&iter, fields[i].field);
+			if (!value || *value == '\0')
 				continue;
-			}
-			escaped = g_markup_escape_text (str, -1);
-			g_free (str);
-			if (!escaped)
-				continue;
-			if (g_str_equal (fields[i].field, TOTEM_PL_PARSER_FIELD_GENRE)) {
-				buf = g_strdup_printf ("   <extension application=\"http://www.rhythmbox.org\">\n"
-						       "     <genre>%s</genre>\n"
-						       "   </extension>\n",
-						       escaped);
-			} else if (g_str_equal (fields[i].field, TOTEM_PL_PARSER_FIELD_SUBTITLE_URI) ||
-				   g_str_equal (fields[i].field, TOTEM_PL_PARSER_FIELD_PLAYING) ||
-				   g_str_equal (fields[i].field, TOTEM_PL_PARSER_FIELD_CONTENT_TYPE) ||
-				   g_str_equal (fields[i].field, TOTEM_PL_PARSER_FIELD_STARTTIME)) {
-				if (!wrote_ext) {
-					buf = g_strdup_printf ("   <extension application=\"http://www.gnome.org\">\n"
-							       "     <%s>%s</%s>\n",
-							       fields[i].field, escaped, fields[i].field);
-					wrote_ext = TRUE;
-				} else {
-					buf = g_strdup_printf ("     <%s>%s</%s>\n",
-							       fields[i].field, escaped, fields[i].field);
-				}
-			} else if (g_str_equal (fields[i].field, TOTEM_PL_PARSER_FIELD_GENRE) == FALSE) {
-				buf = g_strdup_printf ("   <%s>%s</%s>\n",
-						       fields[i].element,
-						       escaped,
-						       fields[i].element);
-			}
 
-			success = totem_pl_parser_write_string (G_OUTPUT_STREAM (stream), buf, error);
-			g_free (buf);
-			g_free (escaped);
-
-			if (success == FALSE)
-				break;
+			if (fragments[i].group == XSPF_GROUP_GNOME && !wrote_ext) {
+				g_string_append (buf, GNOME_EXTENSION_OPEN);
+				wrote_ext = TRUE;
+			}
+			g_string_append (buf, fragments[i].open);
+			xml_append_escaped (buf, value);
+			g_string_append (buf, fragments[i].close);
 		}
 
-                if (success == FALSE)
-			return FALSE;
-
 		if (wrote_ext)
-			success = totem_pl_parser_write_string (G_OUTPUT_STREAM (stream), "   </extension>\n", error);
-
-		if (success == FALSE)
-			return FALSE;
+			g_string_append (buf, GNOME_EXTENSION_CLOSE);
+		g_string_append (buf, "  </track>\n");
 
-		success = totem_pl_parser_write_string (G_OUTPUT_STREAM (stream), "  </track>\n", error);
-		if (success == FALSE)
-			return FALSE;
+		if (buf->len >= XSPF_WRITE_BUFFER_SIZE)
+			success = xspf_write_buffer (stream, buf, error);
 
-                valid = totem_pl_playlist_iter_next (playlist, &iter);
+                valid = totem_pl_playlist_iter_step (&iter);
 	}
 
-	buf = g_strdup_printf (" </trackList>\n"
-                               "</playlist>");
-	success = totem_pl_parser_write_string (G_OUTPUT_STREAM (stream), buf, error);
-	g_free (buf);
+	if (success != FALSE) {
+		g_string_append (buf,
+				 " </trackList>\n"
+				 "</playlist>");
+		success = xspf_write_buffer (stream, buf, error);
+	}
 
+	g_string_free (buf, TRUE);
 	g_object_unref (stream);
 
 	return success;
@@ -238,281 +312,461 @@ parse_bool_str (const char *str)
 	return atoi (str);
 }
 
+/* Children of <track> that aren't stored straight into a slot,
+ * numbered after the slots */
+enum {
+	XSPF_ELEMENT_LINK = NUM_XSPF_SLOTS,
+	XSPF_ELEMENT_EXTENSION,
+	XSPF_ELEMENT_META,
+	XSPF_ELEMENT_UNKNOWN
+};
+
+static const char *special_elements[] = {
+	"link",
+	"extension",
+	"meta"
+};
+
+/* Perfect hash of the children of <track> we know about: the length
+ * and first letter of the element name tell all of them apart, so
+ * only one string comparison is needed per element */
+#define XSPF_ELEMENT_HASH(len, c) ((len) << 8 | (c))
+
+static int
+xspf_track_element_lookup (const char *name)
+{
+	const char *element;
+	int id;
+
+	switch (XSPF_ELEMENT_HASH (strlen (name), g_ascii_tolower (name[0]))) {
+	case XSPF_ELEMENT_HASH (8, 'l'):
+		id = XSPF_SLOT_LOCATION;
+		break;
+	case XSPF_ELEMENT_HASH (5, 't'):
+		id = XSPF_SLOT_TITLE;
+		break;
+	case XSPF_ELEMENT_HASH (5, 'i'):
+		id = XSPF_SLOT_IMAGE_URI;
+		break;
+	case XSPF_ELEMENT_HASH (7, 'c'):
+		id = XSPF_SLOT_AUTHOR;
+		break;
+	case XSPF_ELEMENT_HASH (8, 'd'):
+		id = XSPF_SLOT_DURATION_MS;
+		break;
+	case XSPF_ELEMENT_HASH (5, 'a'):
+		id = XSPF_SLOT_ALBUM;
+		break;
+	case XSPF_ELEMENT_HASH (9, 't'):
+		id = XSPF_SLOT_ID;
+		break;
+	case XSPF_ELEMENT_HASH (4, 'l'):
+		id = XSPF_ELEMENT_LINK;
+		break;
+	case XSPF_ELEMENT_HASH (9, 'e'):
+		id = XSPF_ELEMENT_EXTENSION;
+		break;
+	case XSPF_ELEMENT_HASH (4, 'm'):
+		id = XSPF_ELEMENT_META;
+		break;
+	default:
+		return XSPF_ELEMENT_UNKNOWN;
+	}
+
+	if (id < NUM_XSPF_SLOTS)
+		element = fields[id].element;
+	else
+		element = special_elements[id - NUM_XSPF_SLOTS];
+	if (g_ascii_strcasecmp (name, element) != 0)
+		return XSPF_ELEMENT_UNKNOWN;
+
+	return id;
+}
+
+typedef struct {
+	const char *slots[NUM_XSPF_SLOTS];
+	/* Set for the values that needed to be copied out of the tree */
+	xmlChar *copies[NUM_XSPF_SLOTS];
+} XspfTrack;
+
+static void
+xspf_track_set (XspfTrack   *track,
+		XspfSlot     slot,
+		const char  *value)
+{
+	SAFE_FREE (track->copies[slot]);
+	track->copies[slot] = NULL;
+	track->slots[slot] = value;
+}
+
+/* The values point into the tree when the element only has
+ * a single text node, which is nearly always the case. Otherwise
+ * entities get substituted all the same, so that the value doesn't
+ * depend on how the text was split up */
+static void
+xspf_track_set_from_node (XspfTrack  *track,
+			  XspfSlot    slot,
+			  xmlNodePtr  node)
+{
+	xmlNodePtr text;
+
+	text = node->children;
+	if (text == NULL) {
+		xspf_track_set (track, slot, NULL);
+	} else if (text->next == NULL &&
+		   (text->type == XML_TEXT_NODE || text->type == XML_CDATA_SECTION_NODE)) {
+		xspf_track_set (track, slot, (const char *) text->content);
+	} else {
+		xmlChar *copy;
+
+		copy = xmlNodeListGetString (node->doc, text, 1);
+		xspf_track_set (track, slot, (const char *) copy);
+		track->copies[slot] = copy;
+	}
+}
+
+static const char *
+xspf_node_get_attribute (xmlNodePtr  node,
+			 const char *name)
+{
+	xmlAttrPtr attr;
+
+	attr = xmlHasProp (node, (const xmlChar *) name);
+	if (attr == NULL ||
+	    attr->type != XML_ATTRIBUTE_NODE ||
+	    attr->children == NULL)
+		return NULL;
+	return (const char *) attr->children->content;
+}
+
+static void
+parse_xspf_extension (XspfTrack  *track,
+		      xmlNodePtr  node)
+{
+	const char *app;
+	xmlNodePtr child;
+
+	app = xspf_node_get_attribute (node, "application");
+	if (app == NULL)
+		return;
+
+	/* Parse the genre extension for Rhythmbox */
+	if (g_ascii_strcasecmp (app, "http://www.rhythmbox.org") == 0) {
+		for (child = node->children; child != NULL; child = child->next) {
+			if (child->type == XML_ELEMENT_NODE &&
+			    g_ascii_strcasecmp ((char *) child->name, "genre") == 0) {
+				xspf_track_set_from_node (track, XSPF_SLOT_GENRE, child);
+				break;
+			}
+		}
+	} else if (g_ascii_strcasecmp (app, "http://www.gnome.org") == 0) {
+		for (child = node->children; child != NULL; child = child->next) {
+			if (child->type != XML_ELEMENT_NODE)
+				continue;
+			if (g_ascii_strcasecmp ((char *) child->name, "playing") == 0) {
+				xspf_track_set_from_node (track, XSPF_SLOT_PLAYING, child);
+				xspf_track_set (track, XSPF_SLOT_PLAYING,
+						parse_bool_str (track->slots[XSPF_SLOT_PLAYING]) ? "true" : NULL);
+			} else if (g_ascii_strcasecmp ((char *) child->name, "subtitle") == 0) {
+				xspf_track_set_from_node (track, XSPF_SLOT_SUBTITLE_URI, child);
+			} else if (g_ascii_strcasecmp ((char *) child->name, "mime-type") == 0) {
+				xspf_track_set_from_node (track, XSPF_SLOT_CONTENT_TYPE, child);
+			} else if (g_ascii_strcasecmp ((char *) child->name, "starttime") == 0) {
+				xspf_track_set_from_node (track, XSPF_SLOT_STARTTIME, child);
+			}
+		}
+	} else if (g_ascii_strcasecmp (app, "http://www.last.fm") == 0) {
+		for (child = node->children; child != NULL; child = child->next) {
+			if (child->type != XML_ELEMENT_NODE)
+				continue;
+			if (g_ascii_strcasecmp ((char *) child->name, "trackauth") == 0)
+				xspf_track_set_from_node (track, XSPF_SLOT_ID, child);
+			else if (g_ascii_strcasecmp ((char *) child->name, "freeTrackURL") == 0)
+				xspf_track_set_from_node (track, XSPF_SLOT_DOWNLOAD_URI, child);
+		}
+	}
+}
+
 static gboolean
-parse_xspf_track (TotemPlParser *parser, GFile *base_file, xmlDocPtr doc,
+parse_xspf_track (TotemPlParser *parser, const TotemPlParserResolveBase *base,
 		xmlNodePtr parent)
 {
+	XspfTrack track;
 	xmlNodePtr node;
-	xmlChar *title, *uri, *image_uri, *artist, *album, *duration, *moreinfo;
-	xmlChar *download_uri, *id, *genre, *filesize, *subtitle, *mime_type;
-	xmlChar *playing, *starttime;
-	GFile *resolved;
+	const char *rel;
 	char *resolved_uri;
-	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_ERROR;
+	guint i;
 
-	title = NULL;
-	uri = NULL;
-	image_uri = NULL;
-	artist = NULL;
-	album = NULL;
-	duration = NULL;
-	moreinfo = NULL;
-	download_uri = NULL;
-	id = NULL;
-	genre = NULL;
-	filesize = NULL;
-	subtitle = NULL;
-	mime_type = NULL;
-	playing = NULL;
-	starttime = NULL;
+	memset (&track, 0, sizeof (track));
 
 	for (node = parent->children; node != NULL; node = node->next)
 	{
-		if (node->name == NULL)
+		int id;
+
+		if (node->type != XML_ELEMENT_NODE)
 			continue;
 
-		if (g_ascii_strcasecmp ((char *)node->name, "location") == 0)
-			uri = xmlNodeListGetString (doc, node->xmlChildrenNode, 1);
-		else if (g_ascii_strcasecmp ((char *)node->name, "title") == 0)
-			title = xmlNodeListGetString (doc, node->xmlChildrenNode, 1);
-		else if (g_ascii_strcasecmp ((char *)node->name, "image") == 0)
-			image_uri = xmlNodeListGetString (doc, node->xmlChildrenNode, 1);
-		/* Last.fm uses creator for the artist */
-		else if (g_ascii_strcasecmp ((char *)node->name, "creator") == 0)
-			artist = xmlNodeListGetString (doc, node->xmlChildrenNode, 1);
-		else if (g_ascii_strcasecmp ((char *)node->name, "duration") == 0)
-			duration = xmlNodeListGetString (doc, node->xmlChildrenNode, 1);
-		else if (g_ascii_strcasecmp ((char *)node->name, "link") == 0) {
-			xmlChar *rel;
-
-			rel = xmlGetProp (node, (const xmlChar *) "rel");
+		id = xspf_track_element_lookup ((const char *) node->name);
+		switch (id) {
+		case XSPF_ELEMENT_UNKNOWN:
+			break;
+		case XSPF_ELEMENT_LINK:
+			rel = xspf_node_get_attribute (node, "rel");
 			if (rel != NULL) {
-				if (g_ascii_strcasecmp ((char *) rel, "http://www.last.fm/trackpage") == 0)
-					moreinfo = xmlNodeListGetString (doc, node->xmlChildrenNode, 1);
-				else if (g_ascii_strcasecmp ((char *) rel, "http://www.last.fm/freeTrackURL") == 0)
-					download_uri = xmlNodeListGetString (doc, node->xmlChildrenNode, 1);
-				xmlFree (rel);
+				if (g_ascii_strcasecmp (rel, "http://www.last.fm/trackpage") == 0)
+					xspf_track_set_from_node (&track, XSPF_SLOT_MOREINFO, node);
+				else if (g_ascii_strcasecmp (rel, "http://www.last.fm/freeTrackURL") == 0)
+					xspf_track_set_from_node (&track, XSPF_SLOT_DOWNLOAD_URI, node);
 			} else {
 				/* If we don't have a rel="", then it's not a last.fm playlist */
-				moreinfo = xmlNodeListGetString (doc, node->xmlChildrenNode, 1);
-			}
-		/* Parse the genre extension for Rhythmbox */
-		} else if (g_ascii_strcasecmp ((char *)node->name, "extension") == 0) {
-			xmlChar *app;
-			app = xmlGetProp (node, (const xmlChar *) "application");
-			if (app != NULL && g_ascii_strcasecmp ((char *) app, "http://www.rhythmbox.org") == 0) {
-				xmlNodePtr child;
-				for (child = node->xmlChildrenNode ; child; child = child->next) {
-					if (child->name != NULL &&
-					    g_ascii_strcasecmp ((char *)child->name, "genre") == 0) {
-						genre = xmlNodeListGetString (doc, child->xmlChildrenNode, 0);
-						break;
-					}
-				}
-			} else if (app != NULL && g_ascii_strcasecmp ((char *) app, "http://www.gnome.org") == 0) {
-				xmlNodePtr child;
-				for (child = node->xmlChildrenNode ; child; child = child->next) {
-					if (child->name == NULL)
-						continue;
-					if (g_ascii_strcasecmp ((char *)child->name, "playing") == 0) {
-						xmlChar *str;
-						str = xmlNodeListGetString (doc, child->xmlChildrenNode, 0);
-						playing = parse_bool_str ((char *) str) ? (xmlChar *) "true" : NULL;
-					} else if (g_ascii_strcasecmp ((char *)child->name, "subtitle") == 0) {
-						subtitle = xmlNodeListGetString (doc, child->xmlChildrenNode, 0);
-					} else if (g_ascii_strcasecmp ((char *)child->name, "mime-type") == 0) {
-						mime_type = xmlNodeListGetString (doc, child->xmlChildrenNode, 0);
-					} else if (g_ascii_strcasecmp ((char *)child->name, "starttime") == 0) {
-						starttime = xmlNodeListGetString (doc, child->xmlChildrenNode, 0);
-					}
-				}
-			} else if (app != NULL && g_ascii_strcasecmp ((char *) app, "http://www.last.fm") == 0) {
-				xmlNodePtr child;
-				for (child = node->xmlChildrenNode ; child; child = child->next) {
-					if (child->name != NULL) {
-						if (g_ascii_strcasecmp ((char *)child->name, "trackauth") == 0) {
-							id = xmlNodeListGetString (doc, child->xmlChildrenNode, 0);
-							continue;
-						}
-						if (g_ascii_strcasecmp ((char *)child->name, "freeTrackURL") == 0) {
-							download_uri = xmlNodeListGetString (doc, child->xmlChildrenNode, 0);
-							continue;
-						}
-					}
-				}
+				xspf_track_set_from_node (&track, XSPF_SLOT_MOREINFO, node);
 			}
-			g_clear_pointer (&app, xmlFree);
+			break;
+		case XSPF_ELEMENT_EXTENSION:
+			parse_xspf_extension (&track, node);
+			break;
 		/* Parse Amazon AMZ extensions */
-		} else if (g_ascii_strcasecmp ((char *)node->name, "meta") == 0) {
-			xmlChar *rel;
-
-			rel = xmlGetProp (node, (const xmlChar *) "rel");
-			if (rel != NULL) {
-				if (g_ascii_strcasecmp ((char *) rel, "http://www.amazon.com/dmusic/primaryGenre") == 0)
-					genre = xmlNodeListGetString (doc, node->xmlChildrenNode, 1);
-				else if (g_ascii_strcasecmp ((char *) rel, "http://www.amazon.com/dmusic/ASIN") == 0)
-					id = xmlNodeListGetString (doc, node->xmlChildrenNode, 1);
-				else if (g_ascii_strcasecmp ((char *) rel, "http://www.amazon.com/dmusic/fileSize") == 0)
-					filesize = xmlNodeListGetString (doc, node->xmlChildrenNode, 1);
-				xmlFree (rel);
-			}
-		} else if (g_ascii_strcasecmp ((char *)node->name, "album") == 0)
-			album = xmlNodeListGetString (doc, node->xmlChildrenNode, 1);
-		else if (g_ascii_strcasecmp ((char *)node->name, "trackauth") == 0)
-			id = xmlNodeListGetString (doc, node->xmlChildrenNode, 1);
+		case XSPF_ELEMENT_META:
+			rel = xspf_node_get_attribute (node, "rel");
+			if (rel == NULL)
+				break;
+			if (g_ascii_strcasecmp (rel, "http://www.amazon.com/dmusic/primaryGenre") == 0)
+				xspf_track_set_from_node (&track, XSPF_SLOT_GENRE, node);
+			else if (g_ascii_strcasecmp (rel, "http://www.amazon.com/dmusic/ASIN") == 0)
+				xspf_track_set_from_node (&track, XSPF_SLOT_ID, node);
+			else if (g_ascii_strcasecmp (rel, "http://www.amazon.com/dmusic/fileSize") == 0)
+				xspf_track_set_from_node (&track, XSPF_SLOT_FILESIZE, node);
+			break;
+		/* Last.fm uses creator for the artist */
+		default:
+			xspf_track_set_from_node (&track, id, node);
+			break;
+		}
 	}
 
-	if (uri == NULL) {
-		retval = TOTEM_PL_PARSER_RESULT_ERROR;
-		goto bail;
+	if (track.slots[XSPF_SLOT_LOCATION] == NULL) {
+		for (i = 0; i < NUM_XSPF_SLOTS; i++)
+			SAFE_FREE (track.copies[i]);
+		return FALSE;
 	}
 
-	resolved_uri = totem_pl_parser_resolve_uri (base_file, (char *) uri);
-
-	if (g_strcmp0 (resolved_uri, (char *) uri) == 0) {
-		g_free (resolved_uri);
-		totem_pl_parser_add_uri (parser,
-					 TOTEM_PL_PARSER_FIELD_URI, uri,
-					 TOTEM_PL_PARSER_FIELD_TITLE, title,
-					 TOTEM_PL_PARSER_FIELD_DURATION_MS, duration,
-					 TOTEM_PL_PARSER_FIELD_IMAGE_URI, image_uri,
-					 TOTEM_PL_PARSER_FIELD_AUTHOR, artist,
-					 TOTEM_PL_PARSER_FIELD_ALBUM, album,
-					 TOTEM_PL_PARSER_FIELD_MOREINFO, moreinfo,
-					 TOTEM_PL_PARSER_FIELD_DOWNLOAD_URI, download_uri,
-					 TOTEM_PL_PARSER_FIELD_ID, id,
-					 TOTEM_PL_PARSER_FIELD_GENRE, genre,
-					 TOTEM_PL_PARSER_FIELD_FILESIZE, filesize,
-					 TOTEM_PL_PARSER_FIELD_SUBTITLE_URI, subtitle,
-					 TOTEM_PL_PARSER_FIELD_PLAYING, playing,
-					 TOTEM_PL_PARSER_FIELD_CONTENT_TYPE, mime_type,
-					 TOTEM_PL_PARSER_FIELD_STARTTIME, starttime,
-					 NULL);
-	} else {
-		resolved = g_file_new_for_uri (resolved_uri);
-		g_free (resolved_uri);
-
-		totem_pl_parser_add_uri (parser,
-					 TOTEM_PL_PARSER_FIELD_FILE, resolved,
-					 TOTEM_PL_PARSER_FIELD_TITLE, title,
-					 TOTEM_PL_PARSER_FIELD_DURATION_MS, duration,
-					 TOTEM_PL_PARSER_FIELD_IMAGE_URI, image_uri,
-					 TOTEM_PL_PARSER_FIELD_AUTHOR, artist,
-					 TOTEM_PL_PARSER_FIELD_ALBUM, album,
-					 TOTEM_PL_PARSER_FIELD_MOREINFO, moreinfo,
-					 TOTEM_PL_PARSER_FIELD_DOWNLOAD_URI, download_uri,
-					 TOTEM_PL_PARSER_FIELD_ID, id,
-					 TOTEM_PL_PARSER_FIELD_GENRE, genre,
-					 TOTEM_PL_PARSER_FIELD_FILESIZE, filesize,
-					 TOTEM_PL_PARSER_FIELD_SUBTITLE_URI, subtitle,
-					 TOTEM_PL_PARSER_FIELD_PLAYING, playing,
-					 TOTEM_PL_PARSER_FIELD_CONTENT_TYPE, mime_type,
-					 TOTEM_PL_PARSER_FIELD_STARTTIME, starttime,
-					 NULL);
-		g_object_unref (resolved);
-	}
+	resolved_uri = totem_pl_parser_resolve_uri_with_base (base, track.slots[XSPF_SLOT_LOCATION]);
 
-	retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
+	totem_pl_parser_add_uri (parser,
+				 TOTEM_PL_PARSER_FIELD_URI, resolved_uri,
+				 TOTEM_PL_PARSER_FIELD_TITLE, track.slots[XSPF_SLOT_TITLE],
+				 TOTEM_PL_PARSER_FIELD_DURATION_MS, track.slots[XSPF_SLOT_DURATION_MS],
+				 TOTEM_PL_PARSER_FIELD_IMAGE_URI, track.slots[XSPF_SLOT_IMAGE_URI],
+				 TOTEM_PL_PARSER_FIELD_AUTHOR, track.slots[XSPF_SLOT_AUTHOR],
+				 TOTEM_PL_PARSER_FIELD_ALBUM, track.slots[XSPF_SLOT_ALBUM],
+				 TOTEM_PL_PARSER_FIELD_MOREINFO, track.slots[XSPF_SLOT_MOREINFO],
+				 TOTEM_PL_PARSER_FIELD_DOWNLOAD_URI, track.slots[XSPF_SLOT_DOWNLOAD_URI],
+				 TOTEM_PL_PARSER_FIELD_ID, track.slots[XSPF_SLOT_ID],
+				 TOTEM_PL_PARSER_FIELD_GENRE, track.slots[XSPF_SLOT_GENRE],
+				 TOTEM_PL_PARSER_FIELD_FILESIZE, track.slots[XSPF_SLOT_FILESIZE],
+				 TOTEM_PL_PARSER_FIELD_SUBTITLE_URI, track.slots[XSPF_SLOT_SUBTITLE_URI],
+				 TOTEM_PL_PARSER_FIELD_PLAYING, track.slots[XSPF_SLOT_PLAYING],
+				 TOTEM_PL_PARSER_FIELD_CONTENT_TYPE, track.slots[XSPF_SLOT_CONTENT_TYPE],
+				 TOTEM_PL_PARSER_FIELD_STARTTIME, track.slots[XSPF_SLOT_STARTTIME],
+				 NULL);
+	g_free (resolved_uri);
 
-bail:
-	SAFE_FREE (title);
-	SAFE_FREE (uri);
-	SAFE_FREE (image_uri);
-	SAFE_FREE (artist);
-	SAFE_FREE (album);
-	SAFE_FREE (duration);
-	SAFE_FREE (moreinfo);
-	SAFE_FREE (download_uri);
-	SAFE_FREE (id);
-	SAFE_FREE (genre);
+	for (i = 0; i < NUM_XSPF_SLOTS; i++)
+		SAFE_FREE (track.copies[i]);
 
-	return retval;
+	return TRUE;
 }
 
-static gboolean
-parse_xspf_trackList (TotemPlParser *parser, GFile *base_file, xmlDocPtr doc,
-		xmlNodePtr parent)
-{
-	xmlNodePtr node;
-	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_ERROR;
-
-	for (node = parent->children; node != NULL; node = node->next)
-	{
-		if (node->name == NULL)
-			continue;
+/* The document is parsed as a stream: each <track> is handed to
+ * parse_xspf_track() as soon as its end tag is read, and is then freed,
+ * so only the playlist header, and the track being read, are in memory
+ * at any one time. */
+typedef struct {
+	TotemPlParser *parser;
+	TotemPlParserResolveBase *base;
+	char *uri;
+	gboolean is_xspf;
+	gboolean started;
+	TotemPlParserResult retval;
+} XspfParseData;
 
-		if (g_ascii_strcasecmp ((char *)node->name, "track") == 0)
-			if (parse_xspf_track (parser, base_file, doc, node) != FALSE)
-				retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
-	}
+#define XSPF_READ_CHUNK_SIZE 8192
 
-	return retval;
+static gboolean
+xspf_node_is (xmlNodePtr node,
+	      const char *name)
+{
+	return (node->name != NULL &&
+		g_ascii_strcasecmp ((char *) node->name, name) == 0);
 }
 
 static gboolean
-parse_xspf_entries (TotemPlParser *parser,
-		    GFile         *file,
-		    GFile         *base_file,
-		    xmlDocPtr      doc,
-		    xmlNodePtr     parent)
+xspf_node_is_toplevel (xmlNodePtr node)
+{
+	return (node->parent != NULL &&
+		node->parent->parent == (xmlNodePtr) node->doc);
+}
+
+static void
+xspf_playlist_started (XspfParseData *data,
+		       xmlNodePtr     root)
 {
 	xmlNodePtr node;
-	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_ERROR;
-	const xmlChar *title;
-	char *uri;
+	xmlChar *title;
 
-	uri = g_file_get_uri (file);
+	/* The playlist's own metadata comes before the trackList,
+	 * and is still in the tree at this point */
 	title = NULL;
-
-	/* We go through the list twice to avoid the playlist-started
-	 * signal being out of order */
-
-	for (node = parent->children; node != NULL; node = node->next) {
-		if (node->name == NULL)
-			continue;
-
-		if (g_ascii_strcasecmp ((char *)node->name, "title") == 0) {
-			title = node->name;
+	for (node = root->children; node != NULL; node = node->next) {
+		if (node->type == XML_ELEMENT_NODE && xspf_node_is (node, "title")) {
+			title = xmlNodeListGetString (node->doc, node->xmlChildrenNode, 1);
 			break;
 		}
 	}
 
-	totem_pl_parser_add_uri (parser,
+	totem_pl_parser_add_uri (data->parser,
 				 TOTEM_PL_PARSER_FIELD_IS_PLAYLIST, TRUE,
-				 TOTEM_PL_PARSER_FIELD_URI, uri,
+				 TOTEM_PL_PARSER_FIELD_URI, data->uri,
 				 TOTEM_PL_PARSER_FIELD_TITLE, title,
 				 TOTEM_PL_PARSER_FIELD_CONTENT_TYPE, "application/xspf+xml",
 				 NULL);
+	SAFE_FREE (title);
 
-	for (node = parent->children; node != NULL; node = node->next) {
-		if (node->name == NULL)
-			continue;
+	data->started = TRUE;
+}
 
-		if (g_ascii_strcasecmp ((char *)node->name, "trackList") == 0) {
-			if (parse_xspf_trackList (parser, base_file, doc, node) != FALSE)
-				retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
-		}
+static void
+xspf_start_element (void           *ctx,
+		    const xmlChar  *localname,
+		    const xmlChar  *prefix,
+		    const xmlChar  *URI,
+		    int             nb_namespaces,
+		    const xmlChar **namespaces,
+		    int             nb_attributes,
+		    int             nb_defaulted,
+		    const xmlChar **attributes)
+{
+	xmlParserCtxtPtr ctxt = ctx;
+	XspfParseData *data = ctxt->_private;
+	xmlNodePtr node;
+
+	xmlSAX2StartElementNs (ctx, localname, prefix, URI,
+			       nb_namespaces, namespaces,
+			       nb_attributes, nb_defaulted, attributes);
+
+	node = ctxt->node;
+	if (node == NULL || node->parent == NULL)
+		return;
+
+	/* The root element */
+	if (node->parent == (xmlNodePtr) node->doc) {
+		if (xspf_node_is (node, "playlist"))
+			data->is_xspf = TRUE;
+		else
+			xmlStopParser (ctxt);
+		return;
 	}
 
-	if (uri != NULL) {
-		totem_pl_parser_playlist_end (parser, uri);
-		g_free (uri);
+	if (data->started == FALSE &&
+	    xspf_node_is_toplevel (node) &&
+	    xspf_node_is (node, "trackList"))
+		xspf_playlist_started (data, node->parent);
+}
+
+static void
+xspf_end_element (void          *ctx,
+		  const xmlChar *localname,
+		  const xmlChar *prefix,
+		  const xmlChar *URI)
+{
+	xmlParserCtxtPtr ctxt = ctx;
+	XspfParseData *data = ctxt->_private;
+	xmlNodePtr node, track_list, child;
+
+	/* The node being closed */
+	node = ctxt->node;
+
+	xmlSAX2EndElementNs (ctx, localname, prefix, URI);
+
+	if (node == NULL || node->parent == NULL)
+		return;
+	track_list = node->parent;
+	if (xspf_node_is_toplevel (track_list) == FALSE ||
+	    xspf_node_is (track_list, "trackList") == FALSE ||
+	    xspf_node_is (node, "track") == FALSE)
+		return;
+
+	if (parse_xspf_track (data->parser, data->base, node) != FALSE)
+		data->retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
+
+	/* The track is the last child of the trackList, so this
+	 * frees it along with the whitespace that preceded it */
+	while ((child = track_list->children) != NULL) {
+		xmlUnlinkNode (child);
+		xmlFreeNode (child);
 	}
+}
 
-	return retval;
+static xmlParserCtxtPtr
+xspf_parser_ctxt_new (XspfParseData *data,
+		      TotemPlParser *parser,
+		      GFile         *file,
+		      GFile         *base_file)
+{
+	xmlSAXHandler sax;
+	xmlParserCtxtPtr ctxt;
+
+	memset (&sax, 0, sizeof (sax));
+	xmlSAXVersion (&sax, 2);
+	sax.startElementNs = xspf_start_element;
+	sax.endElementNs = xspf_end_element;
+
+	xmlSetGenericErrorFunc (NULL, (xmlGenericErrorFunc) debug_noop);
+	ctxt = xmlCreatePushParserCtxt (&sax, NULL, NULL, 0, NULL);
+	if (ctxt == NULL)
+		return NULL;
+	/* Broken playlists are recovered from in the same pass,
+	 * rather than parsing them a second time */
+	xmlCtxtUseOptions (ctxt, XML_PARSE_RECOVER | XML_PARSE_NOERROR | XML_PARSE_NOWARNING | XML_PARSE_NONET);
+
+	memset (data, 0, sizeof (XspfParseData));
+	data->parser = parser;
+	data->base = totem_pl_parser_resolve_base_new (base_file);
+	data->uri = g_file_get_uri (file);
+	data->retval = TOTEM_PL_PARSER_RESULT_ERROR;
+	ctxt->_private = data;
+
+	return ctxt;
 }
 
-static gboolean
-is_xspf_doc (xmlDocPtr doc)
+static TotemPlParserResult
+xspf_parser_ctxt_finish (XspfParseData    *data,
+			 xmlParserCtxtPtr  ctxt)
 {
-	/* If the document has no root, or no name */
-	if(!doc ||
-	   !doc->children ||
-	   !doc->children->name ||
-	   g_ascii_strcasecmp ((char *)doc->children->name, "playlist") != 0) {
-		return FALSE;
+	TotemPlParserResult retval;
+
+	xmlParseChunk (ctxt, NULL, 0, 1);
+
+	if (data->is_xspf != FALSE) {
+		xmlNodePtr root;
+
+		root = xmlDocGetRootElement (ctxt->myDoc);
+		if (data->started == FALSE && root != NULL)
+			xspf_playlist_started (data, root);
+		if (data->uri != NULL)
+			totem_pl_parser_playlist_end (data->parser, data->uri);
+		retval = data->retval;
+	} else {
+		retval = TOTEM_PL_PARSER_RESULT_ERROR;
 	}
-	return TRUE;
+
+	if (ctxt->myDoc != NULL)
+		xmlFreeDoc (ctxt->myDoc);
+	xmlFreeParserCtxt (ctxt);
+	totem_pl_parser_resolve_base_free (data->base);
+	g_free (data->uri);
+
+	return retval;
 }
 
 TotemPlParserResult
@@ -522,28 +776,16 @@ totem_pl_parser_add_xspf_with_contents (TotemPlParser *parser,
 					const char *contents,
 					TotemPlParseData *parse_data)
 {
-	xmlDocPtr doc;
-	xmlNodePtr node;
-	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_UNHANDLED;
+	XspfParseData data;
+	xmlParserCtxtPtr ctxt;
 
-	xmlSetGenericErrorFunc (NULL, (xmlGenericErrorFunc) debug_noop);
-	doc = xmlParseMemory (contents, strlen (contents));
-	if (doc == NULL)
-		doc = xmlRecoverMemory (contents, strlen (contents));
-
-	if (is_xspf_doc (doc) == FALSE) {
-		if (doc != NULL)
-			xmlFreeDoc(doc);
+	ctxt = xspf_parser_ctxt_new (&data, parser, file, base_file);
+	if (ctxt == NULL)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
-	}
 
-	for (node = doc->children; node != NULL; node = node->next) {
-		if (parse_xspf_entries (parser, file, base_file, doc, node) != FALSE)
-			retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
-	}
+	xmlParseChunk (ctxt, contents, strlen (contents), 0);
 
-	xmlFreeDoc(doc);
-	return retval;
+	return xspf_parser_ctxt_finish (&data, ctxt);
 }
 
 TotemPlParserResult
@@ -553,24 +795,34 @@ totem_pl_parser_add_xspf (TotemPlParser *parser,
 			  TotemPlParseData *parse_data,
 			  gpointer data)
 {
-	xmlDocPtr doc;
-	xmlNodePtr node;
-	TotemPlParserResult retval = TOTEM_PL_PARSER_RESULT_UNHANDLED;
+	XspfParseData xspf_data;
+	xmlParserCtxtPtr ctxt;
+	GFileInputStream *stream;
+	char buffer[XSPF_READ_CHUNK_SIZE];
+	gssize len;
+	gsize total = 0;
+
+	stream = g_file_read (file, NULL, NULL);
+	if (stream == NULL)
+		return TOTEM_PL_PARSER_RESULT_ERROR;
 
-	doc = totem_pl_parser_parse_xml_file (file);
-	if (is_xspf_doc (doc) == FALSE) {
-		if (doc != NULL)
-			xmlFreeDoc(doc);
+	ctxt = xspf_parser_ctxt_new (&xspf_data, parser, file, base_file);
+	if (ctxt == NULL) {
+		g_object_unref (stream);
 		return TOTEM_PL_PARSER_RESULT_ERROR;
 	}
 
-	for (node = doc->children; node != NULL; node = node->next) {
-		if (parse_xspf_entries (parser, file, base_file, doc, node) != FALSE)
-			retval = TOTEM_PL_PARSER_RESULT_SUCCESS;
+	while ((len = g_input_stream_read (G_INPUT_STREAM (stream), buffer, sizeof (buffer), NULL, NULL)) > 0) {
+		total += len;
+		xmlParseChunk (ctxt, buffer, len, 0);
+		/* Not an XSPF playlist, or xmlStopParser() was called */
+		if (ctxt->disableSAX)
+			break;
 	}
+	g_object_unref (stream);
+	totem_pl_parser_stats_add_read (total);
 
-	xmlFreeDoc(doc);
-	return retval;
+	return xspf_parser_ctxt_finish (&xspf_data, ctxt);
 }
 #endif /* !TOTEM_PL_PARSER_MINI */
 
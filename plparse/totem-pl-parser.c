@@ -129,6 +129,13 @@
 #include <glib/gi18n-lib.h>
 #include <gio/gio.h>
 
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
 #ifndef TOTEM_PL_PARSER_MINI
 #include <gobject/gvaluecollector.h>
 
@@ -157,7 +164,6 @@
 #include "totem-pl-parser-amz.h"
 
 #define READ_CHUNK_SIZE 8192
-#define RECURSE_LEVEL_MAX 4
 
 #define D(x) if (debug) x
 
@@ -245,6 +251,11 @@ static PlaylistTypes dual_types[] = {
 };
 
 static char *totem_pl_parser_mime_type_from_data (gconstpointer data, int len);
+static TotemPlParserResult totem_pl_parser_parse_with_base_cancellable (TotemPlParser *parser,
+									 const char *uri,
+									 const char *base,
+									 gboolean fallback,
+									 GCancellable *cancellable);
 
 #ifndef TOTEM_PL_PARSER_MINI
 
@@ -262,11 +273,13 @@ struct TotemPlParserPrivate {
 	GHashTable *ignore_mimetypes; /*key = char *, value = boolean */
 	GMutex ignore_mutex;
 	GThread *main_thread; /* see CALL_ASYNC() in *-private.h */
+	TotemPlParserDebugCategory debug_categories; /* see DEBUG() in *-private.h */
 
 	guint recurse : 1;
 	guint debug : 1;
 	guint force : 1;
 	guint disable_unsafe : 1;
+	guint collect_stats : 1;
 };
 
 enum {
@@ -274,7 +287,8 @@ enum {
 	PROP_RECURSE,
 	PROP_DEBUG,
 	PROP_FORCE,
-	PROP_DISABLE_UNSAFE
+	PROP_DISABLE_UNSAFE,
+	PROP_COLLECT_STATS
 };
 
 /* Signals */
@@ -282,10 +296,17 @@ enum {
 	ENTRY_PARSED,
 	PLAYLIST_STARTED,
 	PLAYLIST_ENDED,
+	STATS_COLLECTED,
 	LAST_SIGNAL
 };
 
 static int totem_pl_parser_table_signals[LAST_SIGNAL];
+gint totem_pl_parser_debugging = 0;
+#ifdef HAVE_SYS_SDT_H
+#define TRACE_DEFINE_SEMAPHORE(name) \
+	unsigned short TRACE_SEMAPHORE (name) __attribute__ ((section (".probes"))) = 0;
+TRACE_PROBES (TRACE_DEFINE_SEMAPHORE)
+#endif
 static GParamSpecPool *totem_pl_parser_pspec_pool = NULL;
 
 static void totem_pl_parser_class_init (TotemPlParserClass *klass);
@@ -392,6 +413,23 @@ totem_pl_parser_class_init (TotemPlParserClass *klass)
 							       FALSE,
 							       G_PARAM_READWRITE));
 
+	/**
+	 * TotemPlParser:collect-stats:
+	 *
+	 * If %TRUE, the parser will time each parse, and count the I/O it
+	 * does and the entries it emits, then pass all that to the
+	 * #TotemPlParser::stats-collected signal.
+	 *
+	 * Since: 3.28
+	 **/
+	g_object_class_install_property (object_class,
+					 PROP_COLLECT_STATS,
+					 g_param_spec_boolean ("collect-stats",
+							       "collect-stats",
+							       "Whether or not to collect statistics about each parse",
+							       FALSE,
+							       G_PARAM_READWRITE));
+
 	/**
 	 * TotemPlParser::entry-parsed:
 	 * @parser: the object which received the signal
@@ -445,6 +483,27 @@ totem_pl_parser_class_init (TotemPlParserClass *klass)
 			      NULL, NULL,
 			      g_cclosure_marshal_VOID__STRING,
 			      G_TYPE_NONE, 1, G_TYPE_STRING);
+	/**
+	 * TotemPlParser::stats-collected:
+	 * @parser: the object which received the signal
+	 * @stats: the #TotemPlParserStats of the parse
+	 *
+	 * The ::stats-collected signal is emitted at the end of each call to
+	 * totem_pl_parser_parse() and its variants, after all the entries
+	 * have been emitted, when #TotemPlParser:collect-stats is %TRUE.
+	 * For asynchronous parses, it is emitted before the
+	 * #GAsyncReadyCallback is called.
+	 *
+	 * Since: 3.28
+	 */
+	totem_pl_parser_table_signals[STATS_COLLECTED] =
+		g_signal_new ("stats-collected",
+			      G_TYPE_FROM_CLASS (klass),
+			      G_SIGNAL_RUN_LAST,
+			      0,
+			      NULL, NULL,
+			      g_cclosure_marshal_VOID__BOXED,
+			      G_TYPE_NONE, 1, TOTEM_TYPE_PL_PARSER_STATS);
 
 	/* param specs */
 	totem_pl_parser_pspec_pool = g_param_spec_pool_new (FALSE);
@@ -516,6 +575,10 @@ totem_pl_parser_class_init (TotemPlParserClass *klass)
 				     "String representing the end time of the stream", NULL,
 				     G_PARAM_READABLE & G_PARAM_WRITABLE);
 	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
+	pspec = g_param_spec_string ("offset-ms", "offset-ms",
+				     "String representing the start offset of the entry in the playlist's timeline, in milliseconds", NULL,
+				     G_PARAM_READABLE & G_PARAM_WRITABLE);
+	g_param_spec_pool_insert (totem_pl_parser_pspec_pool, pspec, TOTEM_TYPE_PL_PARSER);
 	pspec = g_param_spec_boolean ("is-playlist", "is-playlist",
 				      "Boolean saying whether the entry pushed is the top-level of a playlist", FALSE,
 				      G_PARAM_READABLE & G_PARAM_WRITABLE);
@@ -593,6 +656,52 @@ totem_pl_parser_base_class_finalize (TotemPlParserClass *klass)
 	g_list_free (list);
 }
 
+static gpointer
+totem_pl_parser_real_get_debug_categories (gpointer data)
+{
+	static const GDebugKey keys[] = {
+		{ "parse", TOTEM_PL_PARSER_DEBUG_PARSE },
+		{ "sniff", TOTEM_PL_PARSER_DEBUG_SNIFF },
+		{ "fetch", TOTEM_PL_PARSER_DEBUG_FETCH },
+		{ "format", TOTEM_PL_PARSER_DEBUG_FORMAT },
+	};
+	const char *env;
+	guint categories;
+
+	env = g_getenv ("TOTEM_PL_PARSER_DEBUG");
+	if (env == NULL)
+		categories = TOTEM_PL_PARSER_DEBUG_PARSE | TOTEM_PL_PARSER_DEBUG_SNIFF |
+			TOTEM_PL_PARSER_DEBUG_FETCH | TOTEM_PL_PARSER_DEBUG_FORMAT;
+	else
+		categories = g_parse_debug_string (env, keys, G_N_ELEMENTS (keys));
+
+	return GUINT_TO_POINTER (categories);
+}
+
+static TotemPlParserDebugCategory
+totem_pl_parser_get_debug_categories (void)
+{
+	static GOnce my_once = G_ONCE_INIT;
+	g_once (&my_once, totem_pl_parser_real_get_debug_categories, NULL);
+	return GPOINTER_TO_UINT (my_once.retval);
+}
+
+static void
+totem_pl_parser_set_debug (TotemPlParser *parser, gboolean debug)
+{
+	if (debug == parser->priv->debug)
+		return;
+
+	parser->priv->debug = debug;
+	if (debug) {
+		parser->priv->debug_categories = totem_pl_parser_get_debug_categories ();
+		g_atomic_int_inc (&totem_pl_parser_debugging);
+	} else {
+		parser->priv->debug_categories = 0;
+		g_atomic_int_dec_and_test (&totem_pl_parser_debugging);
+	}
+}
+
 static void
 totem_pl_parser_set_property (GObject *object,
 			      guint prop_id,
@@ -607,7 +716,7 @@ totem_pl_parser_set_property (GObject *object,
 		parser->priv->recurse = g_value_get_boolean (value) != FALSE;
 		break;
 	case PROP_DEBUG:
-		parser->priv->debug = g_value_get_boolean (value) != FALSE;
+		totem_pl_parser_set_debug (parser, g_value_get_boolean (value) != FALSE);
 		break;
 	case PROP_FORCE:
 		parser->priv->force = g_value_get_boolean (value) != FALSE;
@@ -615,6 +724,9 @@ totem_pl_parser_set_property (GObject *object,
 	case PROP_DISABLE_UNSAFE:
 		parser->priv->disable_unsafe = g_value_get_boolean (value) != FALSE;
 		break;
+	case PROP_COLLECT_STATS:
+		parser->priv->collect_stats = g_value_get_boolean (value) != FALSE;
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -643,6 +755,9 @@ totem_pl_parser_get_property (GObject *object,
 	case PROP_DISABLE_UNSAFE:
 		g_value_set_boolean (value, parser->priv->disable_unsafe);
 		break;
+	case PROP_COLLECT_STATS:
+		g_value_set_boolean (value, parser->priv->collect_stats);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -728,29 +843,1133 @@ totem_pl_parser_playlist_end (TotemPlParser *parser, const char *playlist_uri)
 	CALL_ASYNC (parser, emit_playlist_ended_signal, data);
 }
 
+/* Statistics of the parse running in the current thread, when
+ * TotemPlParser:collect-stats is set. Entries get emitted, and helpers
+ * spawned, far away from the TotemPlParseData of the parse, so they're
+ * kept per-thread rather than in there. */
+typedef struct {
+	TotemPlParserStats *stats;
+	gint64 start;
+	TotemPlParserPhase phase;
+	gint64 phase_start;
+	const char *format; /* interned mime-type of the playlist being parsed */
+} StatsCollector;
+
+static GPrivate current_stats;
+
+static void
+stats_collector_account (StatsCollector *collector)
+{
+	gint64 now, elapsed;
+
+	now = g_get_monotonic_time ();
+	elapsed = now - collector->phase_start;
+	collector->phase_start = now;
+
+	switch (collector->phase) {
+	case TOTEM_PL_PARSER_PHASE_SNIFF:
+		collector->stats->sniff_time += elapsed;
+		break;
+	case TOTEM_PL_PARSER_PHASE_LOAD:
+		collector->stats->load_time += elapsed;
+		break;
+	case TOTEM_PL_PARSER_PHASE_EMIT:
+		collector->stats->emit_time += elapsed;
+		break;
+	case TOTEM_PL_PARSER_PHASE_PARSE:
+	default:
+		collector->stats->parse_time += elapsed;
+		break;
+	}
+}
+
+static void
+stats_collector_count (GHashTable *counts, const char *format)
+{
+	guint count;
+
+	if (format == NULL)
+		format = g_intern_static_string (UNKNOWN_TYPE);
+	count = GPOINTER_TO_UINT (g_hash_table_lookup (counts, format));
+	g_hash_table_insert (counts, (gpointer) format, GUINT_TO_POINTER (count + 1));
+}
+
+/* Starts collecting statistics for the parse about to run in this thread,
+ * or makes sure that none are, if @parser doesn't collect them. Returns
+ * the collector of the parse that was running, if any */
+static StatsCollector *
+stats_collector_begin (TotemPlParser *parser)
+{
+	StatsCollector *previous, *collector = NULL;
+
+	previous = g_private_get (&current_stats);
+	if (parser->priv->collect_stats) {
+		collector = g_new0 (StatsCollector, 1);
+		collector->stats = g_new0 (TotemPlParserStats, 1);
+		/* Keys are interned mime-types */
+		collector->stats->entries_emitted = g_hash_table_new (g_str_hash, g_str_equal);
+		collector->stats->entries_ignored = g_hash_table_new (g_str_hash, g_str_equal);
+		collector->start = collector->phase_start = g_get_monotonic_time ();
+		collector->phase = TOTEM_PL_PARSER_PHASE_PARSE;
+	}
+	g_private_set (&current_stats, collector);
+
+	return previous;
+}
+
+typedef struct {
+	TotemPlParser *parser;
+	TotemPlParserStats *stats;
+} StatsCollectedSignalData;
+
+static gboolean
+emit_stats_collected_signal (StatsCollectedSignalData *data)
+{
+	g_signal_emit (data->parser,
+		       totem_pl_parser_table_signals[STATS_COLLECTED],
+		       0, data->stats);
+
+	/* Free the data */
+	g_object_unref (data->parser);
+	totem_pl_parser_stats_free (data->stats);
+	g_free (data);
+
+	return FALSE;
+}
+
+static void
+stats_collector_end (TotemPlParser *parser, StatsCollector *previous)
+{
+	StatsCollector *collector;
+	StatsCollectedSignalData *data;
+
+	collector = g_private_get (&current_stats);
+	g_private_set (&current_stats, previous);
+	if (collector == NULL)
+		return;
+
+	stats_collector_account (collector);
+	collector->stats->total_time = collector->phase_start - collector->start;
+
+	data = g_new (StatsCollectedSignalData, 1);
+	data->parser = g_object_ref (parser);
+	data->stats = collector->stats;
+	g_free (collector);
+
+	CALL_ASYNC (parser, emit_stats_collected_signal, data);
+}
+
+/* Sets the playlist that entries and ignored files get counted against,
+ * returning the previous one */
+static const char *
+stats_collector_set_format (const char *mimetype)
+{
+	StatsCollector *collector;
+	const char *previous;
+
+	collector = g_private_get (&current_stats);
+	if (collector == NULL)
+		return NULL;
+	previous = collector->format;
+	collector->format = mimetype ? g_intern_string (mimetype) : NULL;
+
+	return previous;
+}
+
+/**
+ * totem_pl_parser_stats_enter:
+ * @phase: the #TotemPlParserPhase starting
+ *
+ * Accounts the time spent from now on, in the current thread, to @phase,
+ * until the matching totem_pl_parser_stats_leave() call.
+ *
+ * Return value: the phase to pass to totem_pl_parser_stats_leave()
+ **/
+TotemPlParserPhase
+totem_pl_parser_stats_enter (TotemPlParserPhase phase)
+{
+	StatsCollector *collector;
+	TotemPlParserPhase previous;
+
+	collector = g_private_get (&current_stats);
+	if (collector == NULL)
+		return phase;
+
+	stats_collector_account (collector);
+	previous = collector->phase;
+	collector->phase = phase;
+
+	return previous;
+}
+
+/**
+ * totem_pl_parser_stats_leave:
+ * @previous: the phase returned by totem_pl_parser_stats_enter()
+ *
+ * Goes back to accounting time to the @previous phase.
+ **/
+void
+totem_pl_parser_stats_leave (TotemPlParserPhase previous)
+{
+	totem_pl_parser_stats_enter (previous);
+}
+
+/**
+ * totem_pl_parser_stats_add_read:
+ * @bytes: the number of bytes read
+ *
+ * Counts a file being read, or loaded, by the parse running in the
+ * current thread.
+ **/
+void
+totem_pl_parser_stats_add_read (gsize bytes)
+{
+	StatsCollector *collector;
+
+	collector = g_private_get (&current_stats);
+	if (collector == NULL)
+		return;
+	collector->stats->num_reads++;
+	collector->stats->bytes_read += bytes;
+}
+
+/**
+ * totem_pl_parser_stats_add_helper_spawn:
+ *
+ * Counts a helper being spawned by the parse running in the current thread.
+ **/
+void
+totem_pl_parser_stats_add_helper_spawn (void)
+{
+	StatsCollector *collector;
+
+	collector = g_private_get (&current_stats);
+	if (collector == NULL)
+		return;
+	collector->stats->num_helper_spawns++;
+}
+
+/* The start of remote entries of a playlist can be fetched ahead of
+ * time, a few at a time, so that their network latency overlaps. They're
+ * still parsed one after the other, in document order, as they get
+ * claimed. Only as much as sniffing needs is read, as the entries could
+ * be live streams which would never end. */
+#define PREFETCH_MAX_JOBS 4
+
+typedef struct {
+	GFile *file;
+	GBytes *head; /* up to MIME_READ_CHUNK_SIZE bytes, or NULL if it couldn't be fetched */
+	gboolean complete; /* whether @head is the whole of the file */
+	gint64 fetch_time; /* in microseconds */
+	gboolean done;
+} PrefetchItem;
+
+struct TotemPlParserPrefetch {
+	TotemPlParser *parser;
+	GThreadPool *pool;
+	GCancellable *cancellable;
+	/* the cancellable of the parse, and our handler on it */
+	GCancellable *parse_cancellable;
+	gulong parse_cancelled_id;
+	GMutex lock;
+	GCond cond;
+	PrefetchItem *items;
+	guint num_items;
+};
+
+static void
+prefetch_item_load (PrefetchItem          *item,
+		    TotemPlParserPrefetch *prefetch)
+{
+	GFileInputStream *stream;
+	GBytes *head;
+	gboolean complete;
+	gint64 start;
+
+	head = NULL;
+	complete = FALSE;
+	start = g_get_monotonic_time ();
+
+	stream = g_file_read (item->file, prefetch->cancellable, NULL);
+	if (stream != NULL) {
+		char *buffer;
+		gsize bytes_read;
+
+		buffer = g_malloc (MIME_READ_CHUNK_SIZE);
+		if (g_input_stream_read_all (G_INPUT_STREAM (stream), buffer, MIME_READ_CHUNK_SIZE,
+					     &bytes_read, prefetch->cancellable, NULL) != FALSE) {
+			head = g_bytes_new_take (buffer, bytes_read);
+			/* A short read means we got to the end */
+			complete = (bytes_read < MIME_READ_CHUNK_SIZE);
+		} else {
+			g_free (buffer);
+		}
+		g_object_unref (stream);
+	}
+
+	g_mutex_lock (&prefetch->lock);
+	item->head = head;
+	item->complete = complete;
+	item->fetch_time = g_get_monotonic_time () - start;
+	item->done = TRUE;
+	g_cond_broadcast (&prefetch->cond);
+	g_mutex_unlock (&prefetch->lock);
+}
+
+static void
+prefetch_parse_cancelled_cb (GCancellable          *parse_cancellable,
+			     TotemPlParserPrefetch *prefetch)
+{
+	g_cancellable_cancel (prefetch->cancellable);
+
+	/* Wake up totem_pl_parser_prefetch_claim() */
+	g_mutex_lock (&prefetch->lock);
+	g_cond_broadcast (&prefetch->cond);
+	g_mutex_unlock (&prefetch->lock);
+}
+
+/**
+ * totem_pl_parser_prefetch_new:
+ * @parser: a #TotemPlParser
+ * @files: (element-type GFile): the files to fetch, %NULL entries are skipped
+ * @parse_data: the #TotemPlParseData of the current parse
+ *
+ * Starts fetching the start of @files in the background, at most
+ * %PREFETCH_MAX_JOBS at a time, and in order. Use
+ * totem_pl_parser_prefetch_claim() to make what was read of one of
+ * them available to the parsers. The fetches stop when the parse
+ * gets cancelled.
+ *
+ * Return value: a new prefetch, to be freed with totem_pl_parser_prefetch_free()
+ **/
+TotemPlParserPrefetch *
+totem_pl_parser_prefetch_new (TotemPlParser    *parser,
+			      GPtrArray        *files,
+			      TotemPlParseData *parse_data)
+{
+	TotemPlParserPrefetch *prefetch;
+	guint i;
+
+	prefetch = g_new0 (TotemPlParserPrefetch, 1);
+	prefetch->parser = parser;
+	prefetch->cancellable = g_cancellable_new ();
+	g_mutex_init (&prefetch->lock);
+	g_cond_init (&prefetch->cond);
+	if (parse_data->cancellable != NULL) {
+		prefetch->parse_cancellable = g_object_ref (parse_data->cancellable);
+		/* Runs the handler straight away if it's already cancelled */
+		prefetch->parse_cancelled_id = g_cancellable_connect (parse_data->cancellable,
+								      G_CALLBACK (prefetch_parse_cancelled_cb),
+								      prefetch, NULL);
+	}
+	prefetch->num_items = files->len;
+	prefetch->items = g_new0 (PrefetchItem, files->len);
+	prefetch->pool = g_thread_pool_new ((GFunc) prefetch_item_load, prefetch,
+					    PREFETCH_MAX_JOBS, FALSE, NULL);
+
+	for (i = 0; i < files->len; i++) {
+		PrefetchItem *item = &prefetch->items[i];
+
+		if (g_ptr_array_index (files, i) == NULL || prefetch->pool == NULL) {
+			item->done = TRUE;
+			continue;
+		}
+		item->file = g_object_ref (g_ptr_array_index (files, i));
+		g_thread_pool_push (prefetch->pool, item, NULL);
+	}
+
+	return prefetch;
+}
+
+/**
+ * totem_pl_parser_prefetch_claim:
+ * @prefetch: a #TotemPlParserPrefetch
+ * @index: the index of the file in the array passed at creation
+ * @parse_data: the #TotemPlParseData of the current parse
+ *
+ * Waits for the start of the file at @index to be fetched, unless the
+ * parse gets cancelled, and makes it available through @parse_data, so
+ * that sniffing it, or loading it if it's that small, doesn't hit the
+ * network again. Call totem_pl_parser_prefetch_release() once it's parsed.
+ **/
+void
+totem_pl_parser_prefetch_claim (TotemPlParserPrefetch *prefetch,
+				guint                  index,
+				TotemPlParseData      *parse_data)
+{
+	TotemPlParser *parser = prefetch->parser;
+	TotemPlParserPhase phase;
+	PrefetchItem *item;
+
+	g_return_if_fail (index < prefetch->num_items);
+
+	item = &prefetch->items[index];
+	if (item->file == NULL)
+		return;
+
+	phase = totem_pl_parser_stats_enter (TOTEM_PL_PARSER_PHASE_LOAD);
+	g_mutex_lock (&prefetch->lock);
+	while (item->done == FALSE &&
+	       g_cancellable_is_cancelled (prefetch->cancellable) == FALSE)
+		g_cond_wait (&prefetch->cond, &prefetch->lock);
+	g_mutex_unlock (&prefetch->lock);
+	totem_pl_parser_stats_leave (phase);
+
+	if (item->done == FALSE) {
+		DEBUG(FETCH, item->file, g_print ("Stopped waiting for '%s', the parse was cancelled\n", uri));
+		return;
+	}
+
+	DEBUG(FETCH, item->file, g_print ("Prefetched '%s' in %" G_GINT64_FORMAT " ms, %s\n",
+				   uri, item->fetch_time / 1000,
+				   item->head == NULL ? "not using it" :
+				   item->complete ? "using all of it" : "using it to sniff"));
+
+	if (item->head == NULL)
+		return;
+	totem_pl_parser_stats_add_read (g_bytes_get_size (item->head));
+
+	if (parse_data->sniffed == NULL)
+		parse_data->sniffed = g_hash_table_new_full (g_str_hash, g_str_equal,
+							     g_free, (GDestroyNotify) g_bytes_unref);
+	g_hash_table_insert (parse_data->sniffed,
+			     g_file_get_uri (item->file),
+			     g_bytes_ref (item->head));
+
+	if (item->complete == FALSE)
+		return;
+	if (parse_data->prefetched == NULL)
+		parse_data->prefetched = g_hash_table_new_full (g_str_hash, g_str_equal,
+								g_free, (GDestroyNotify) g_bytes_unref);
+	g_hash_table_insert (parse_data->prefetched,
+			     g_file_get_uri (item->file),
+			     g_bytes_ref (item->head));
+}
+
+/**
+ * totem_pl_parser_prefetch_release:
+ * @prefetch: a #TotemPlParserPrefetch
+ * @index: the index of the file in the array passed at creation
+ * @parse_data: the #TotemPlParseData of the current parse
+ *
+ * Drops what was read of the file at @index, once it's been parsed.
+ **/
+void
+totem_pl_parser_prefetch_release (TotemPlParserPrefetch *prefetch,
+				  guint                  index,
+				  TotemPlParseData      *parse_data)
+{
+	PrefetchItem *item;
+	char *uri;
+
+	g_return_if_fail (index < prefetch->num_items);
+
+	item = &prefetch->items[index];
+
+	/* Still being fetched if the claim got cancelled */
+	g_mutex_lock (&prefetch->lock);
+	if (item->done == FALSE || item->head == NULL) {
+		g_mutex_unlock (&prefetch->lock);
+		return;
+	}
+	g_mutex_unlock (&prefetch->lock);
+
+	uri = g_file_get_uri (item->file);
+	if (parse_data->sniffed != NULL)
+		g_hash_table_remove (parse_data->sniffed, uri);
+	if (parse_data->prefetched != NULL)
+		g_hash_table_remove (parse_data->prefetched, uri);
+	g_free (uri);
+	g_clear_pointer (&item->head, g_bytes_unref);
+}
+
+/**
+ * totem_pl_parser_prefetch_free:
+ * @prefetch: a #TotemPlParserPrefetch
+ *
+ * Cancels the fetches still in progress, and frees @prefetch.
+ **/
+void
+totem_pl_parser_prefetch_free (TotemPlParserPrefetch *prefetch)
+{
+	guint i;
+
+	if (prefetch->parse_cancellable != NULL) {
+		g_cancellable_disconnect (prefetch->parse_cancellable, prefetch->parse_cancelled_id);
+		g_object_unref (prefetch->parse_cancellable);
+	}
+	g_cancellable_cancel (prefetch->cancellable);
+	if (prefetch->pool != NULL)
+		g_thread_pool_free (prefetch->pool, TRUE, TRUE);
+
+	for (i = 0; i < prefetch->num_items; i++) {
+		g_clear_object (&prefetch->items[i].file);
+		g_clear_pointer (&prefetch->items[i].head, g_bytes_unref);
+	}
+	g_free (prefetch->items);
+	g_object_unref (prefetch->cancellable);
+	g_mutex_clear (&prefetch->lock);
+	g_cond_clear (&prefetch->cond);
+	g_free (prefetch);
+}
+
+static GBytes *
+totem_pl_parser_get_prefetched (GFile            *file,
+				TotemPlParseData *parse_data)
+{
+	GBytes *contents;
+	char *uri;
+
+	if (parse_data == NULL || parse_data->prefetched == NULL)
+		return NULL;
+
+	uri = g_file_get_uri (file);
+	contents = g_hash_table_lookup (parse_data->prefetched, uri);
+	g_free (uri);
+
+	return contents;
+}
+
+/**
+ * totem_pl_parser_load_contents:
+ * @file: the file to load
+ * @parse_data: the #TotemPlParseData of the current parse
+ * @contents: (out): return location for the nul-terminated contents
+ * @length: (out) (allow-none): return location for the length of @contents
+ *
+ * Like g_file_load_contents(), but uses the contents fetched ahead of
+ * time through totem_pl_parser_prefetch_claim() when there are some.
+ *
+ * Return value: %TRUE on success
+ **/
+gboolean
+totem_pl_parser_load_contents (GFile             *file,
+			       TotemPlParseData  *parse_data,
+			       char             **contents,
+			       gsize             *length)
+{
+	TotemPlParserPhase phase;
+	GBytes *prefetched;
+	gboolean ret;
+	gsize size;
+
+	prefetched = totem_pl_parser_get_prefetched (file, parse_data);
+	if (prefetched != NULL) {
+		gconstpointer data;
+
+		data = g_bytes_get_data (prefetched, &size);
+		*contents = g_malloc (size + 1);
+		memcpy (*contents, data, size);
+		(*contents)[size] = '\0';
+		if (length != NULL)
+			*length = size;
+		return TRUE;
+	}
+
+	phase = totem_pl_parser_stats_enter (TOTEM_PL_PARSER_PHASE_LOAD);
+	ret = g_file_load_contents (file, NULL, contents, &size, NULL, NULL);
+	totem_pl_parser_stats_leave (phase);
+	if (ret == FALSE)
+		return FALSE;
+
+	totem_pl_parser_stats_add_read (size);
+	if (length != NULL)
+		*length = size;
+	return TRUE;
+}
+
+/* File extensions of the playlists and media we see the most, and for
+ * which a single type in shared-mime-info has the heaviest glob, so that
+ * they can be looked up without going through the whole of its glob list.
+ * ".m3u" isn't one, as HLS playlists share it with audio/x-mpegurl. */
+static const struct {
+	const char *extension;
+	const char *mimetype;
+} extension_types[] = {
+	{ "pls", "audio/x-scpls" },
+	{ "xspf", "application/xspf+xml" },
+	{ "asx", "audio/x-ms-asx" },
+	{ "wax", "audio/x-ms-asx" },
+	{ "wvx", "audio/x-ms-asx" },
+	{ "wpl", "application/vnd.ms-wpl" },
+	{ "smil", "application/smil+xml" },
+	{ "sml", "application/smil+xml" },
+	{ "m4u", "video/vnd.mpegurl" },
+	{ "mxu", "video/vnd.mpegurl" },
+	{ "ram", "application/ram" },
+	{ "rm", "application/vnd.rn-realmedia" },
+	{ "pla", "audio/x-iriver-pla" },
+	{ "gvp", "text/x-google-video-pointer" },
+	{ "rss", RSS_MIME_TYPE },
+	{ "atom", ATOM_MIME_TYPE },
+	{ "opml", OPML_MIME_TYPE },
+	{ "cue", "application/x-cue" },
+	{ "iso", "application/x-cd-image" },
+	{ "desktop", "application/x-desktop" },
+	{ "asf", "application/vnd.ms-asf" },
+	{ "wmv", "video/x-ms-wmv" },
+	{ "wma", "audio/x-ms-wma" },
+	{ "mov", "video/quicktime" },
+	{ "qt", "video/quicktime" },
+	{ "mp4", "video/mp4" },
+	{ "m4v", "video/mp4" },
+	{ "m4a", "audio/mp4" },
+	{ "mp3", AUDIO_MPEG_TYPE },
+	{ "mkv", "video/x-matroska" },
+	{ "webm", "video/webm" },
+	{ "mpg", "video/mpeg" },
+	{ "mpeg", "video/mpeg" },
+	{ "jpg", "image/jpeg" },
+	{ "jpeg", "image/jpeg" },
+	{ "png", "image/png" },
+	{ "gif", "image/gif" },
+};
+
+/* Longer than any of the extensions above */
+#define EXTENSION_MAX_LEN 8
+
+static gpointer
+extension_types_table_new (gpointer data)
+{
+	GHashTable *table;
+	guint i;
+
+	table = g_hash_table_new (g_str_hash, g_str_equal);
+	for (i = 0; i < G_N_ELEMENTS (extension_types); i++)
+		g_hash_table_insert (table, (gpointer) extension_types[i].extension, (gpointer) extension_types[i].mimetype);
+
+	return table;
+}
+
+/* The type of @name as per the extension_types table, or %NULL if
+ * its extension isn't in there */
+static const char *
+totem_pl_parser_mime_type_from_extension (const char *name)
+{
+	static GOnce extension_types_once = G_ONCE_INIT;
+	const char *dot;
+	char extension[EXTENSION_MAX_LEN + 1];
+	guint i;
+
+	dot = strrchr (name, '.');
+	if (dot == NULL)
+		return NULL;
+	for (i = 0; dot[i + 1] != '\0'; i++) {
+		/* Not an extension, or one GIO should look at */
+		if (i >= EXTENSION_MAX_LEN || g_ascii_isalnum (dot[i + 1]) == FALSE)
+			return NULL;
+		extension[i] = g_ascii_tolower (dot[i + 1]);
+	}
+	extension[i] = '\0';
+
+	g_once (&extension_types_once, extension_types_table_new, NULL);
+	return g_hash_table_lookup (extension_types_once.retval, extension);
+}
+
+/* Like g_content_type_guess() on @name only, but
+ * always giving a mime-type */
+static char *
+totem_pl_parser_mime_type_from_name (const char *name)
+{
+	const char *mimetype;
+#ifdef G_OS_WIN32
+	char *content_type, *ret;
+#endif
+
+	mimetype = totem_pl_parser_mime_type_from_extension (name);
+	if (mimetype != NULL)
+		return g_strdup (mimetype);
+
+#ifdef G_OS_WIN32
+	content_type = g_content_type_guess (name, NULL, 0, NULL);
+	ret = g_content_type_get_mime_type (content_type);
+	g_free (content_type);
+	return ret;
+#else
+	return g_content_type_guess (name, NULL, 0, NULL);
+#endif
+}
+
+/* Gives a nul-terminated copy of the data read for sniffing,
+ * and the type it sniffs as */
+static char *
+my_mime_type_from_sniffed_data (const char *sniffed, gsize len, gpointer *data)
+{
+	char *buffer;
+
+	buffer = g_malloc (len + 1);
+	memcpy (buffer, sniffed, len);
+	buffer[len] = '\0';
+	*data = buffer;
+
+	return totem_pl_parser_mime_type_from_data (buffer, len);
+}
+
+#ifndef _WIN32
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+typedef enum {
+	NATIVE_HEAD_READ,	/* the start of the file was read */
+	NATIVE_HEAD_TYPED,	/* the type doesn't come from the data, maybe NULL */
+	NATIVE_HEAD_UNHANDLED	/* it should be read through GIO */
+} NativeHeadResult;
+
+/* Reused by all the local files sniffed on a thread */
+static GPrivate sniff_buffer = G_PRIVATE_INIT (g_free);
+
+static char *
+my_native_get_sniff_buffer (void)
+{
+	char *buffer;
+
+	buffer = g_private_get (&sniff_buffer);
+	if (buffer == NULL) {
+		buffer = g_malloc (MIME_READ_CHUNK_SIZE);
+		g_private_set (&sniff_buffer, buffer);
+	}
+	return buffer;
+}
+
+/* Local files are sniffed with a single open, fstat and read,
+ * rather than through a GFileInputStream. On success, @buffer
+ * holds the first @len bytes of the file at @path. */
+static NativeHeadResult
+my_native_read_head (const char *path, char *buffer, gsize *len, char **mimetype)
+{
+	struct stat buf;
+	gsize bytes_read;
+	int fd;
+
+	*mimetype = NULL;
+
+	/* Non-blocking, so that FIFOs and drives without media don't hang */
+	fd = g_open (path, O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC, 0);
+	if (fd < 0) {
+		/* Drives are often only readable by a group, but
+		 * they still need to be recognised as such, for the
+		 * type of their disc to be detected */
+		if (g_stat (path, &buf) == 0 && S_ISBLK (buf.st_mode))
+			*mimetype = g_strdup (BLOCK_DEVICE_TYPE);
+		return NATIVE_HEAD_TYPED;
+	}
+
+	if (fstat (fd, &buf) < 0) {
+		close (fd);
+		return NATIVE_HEAD_TYPED;
+	}
+	/* For a block device, we're screwed as far as speed
+	 * is concerned now */
+	if (S_ISBLK (buf.st_mode)) {
+		close (fd);
+		*mimetype = g_strdup (BLOCK_DEVICE_TYPE);
+		return NATIVE_HEAD_TYPED;
+	}
+	if (S_ISDIR (buf.st_mode)) {
+		close (fd);
+		*mimetype = g_strdup (DIR_MIME_TYPE);
+		return NATIVE_HEAD_TYPED;
+	}
+	/* Nothing to sniff in those */
+	if (S_ISFIFO (buf.st_mode) || S_ISSOCK (buf.st_mode)) {
+		close (fd);
+		return NATIVE_HEAD_TYPED;
+	}
+	if (!S_ISREG (buf.st_mode)) {
+		close (fd);
+		return NATIVE_HEAD_UNHANDLED;
+	}
+
+#ifdef HAVE_POSIX_FADVISE
+	/* Only the start of the file is needed, don't read ahead */
+	posix_fadvise (fd, 0, 0, POSIX_FADV_RANDOM);
+#endif
+
+	/* Read the whole thing, up to MIME_READ_CHUNK_SIZE */
+	bytes_read = 0;
+	while (bytes_read < MIME_READ_CHUNK_SIZE) {
+		gssize ret;
+
+		ret = pread (fd, buffer + bytes_read, MIME_READ_CHUNK_SIZE - bytes_read, bytes_read);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0) {
+			close (fd);
+			return NATIVE_HEAD_TYPED;
+		}
+		if (ret == 0)
+			break;
+		bytes_read += ret;
+	}
+	close (fd);
+	totem_pl_parser_stats_add_read (bytes_read);
+
+	*len = bytes_read;
+	return NATIVE_HEAD_READ;
+}
+
+/* Returns %FALSE if @file should be read through GIO instead */
+static gboolean
+my_native_get_mime_type_with_data (GFile *file, gpointer *data, gsize *data_len, char **mimetype, TotemPlParser *parser)
+{
+	NativeHeadResult res;
+	char *path, *buffer;
+	gsize bytes_read;
+
+	*mimetype = NULL;
+	path = g_file_get_path (file);
+	if (path == NULL)
+		return FALSE;
+	buffer = my_native_get_sniff_buffer ();
+	res = my_native_read_head (path, buffer, &bytes_read, mimetype);
+	g_free (path);
+
+	if (res == NATIVE_HEAD_UNHANDLED)
+		return FALSE;
+	if (res == NATIVE_HEAD_TYPED) {
+		if (*mimetype == NULL)
+			DEBUG(SNIFF, file, g_print ("URI '%s' couldn't be sniffed in _get_mime_type_with_data\n", uri));
+		return TRUE;
+	}
+
+	/* Empty file */
+	if (bytes_read == 0) {
+		DEBUG(SNIFF, file, g_print ("URI '%s' is empty in _get_mime_type_with_data\n", uri));
+		*mimetype = g_strdup (EMPTY_FILE_TYPE);
+		return TRUE;
+	}
+
+	*mimetype = my_mime_type_from_sniffed_data (buffer, bytes_read, data);
+	*data_len = bytes_read;
+	return TRUE;
+}
+#endif /* !_WIN32 */
+
+/* Local files that will need sniffing get the start of their data
+ * read ahead of time, a few at a time, so that the latency of cold
+ * caches and network filesystems overlaps. Reads complete in any order,
+ * but the results are claimed one after the other, in the order the
+ * files were added, and only up to SNIFF_MAX_AHEAD get read ahead of
+ * the last claimed one. */
+#define SNIFF_MAX_JOBS 8
+
+typedef struct {
+	GFile *file;
+	GBytes *head; /* NULL if it couldn't be read */
+	gboolean done;
+} SniffItem;
+
+struct TotemPlParserSniffBatch {
+	TotemPlParser *parser;
+	GThreadPool *pool;
+	GMutex lock;
+	GCond cond;
+	/* SniffItem, or NULL for files that won't get sniffed */
+	GPtrArray *items;
+	/* The first item not yet pushed to the pool */
+	guint next;
+	/* The last item claimed */
+	guint claimed;
+};
+
+static void
+sniff_item_load (SniffItem               *item,
+		 TotemPlParserSniffBatch *batch)
+{
+	GBytes *head = NULL;
+#ifndef _WIN32
+	char *path;
+
+	path = g_file_get_path (item->file);
+	if (path != NULL) {
+		char *buffer, *mimetype;
+		gsize len;
+
+		buffer = my_native_get_sniff_buffer ();
+		if (my_native_read_head (path, buffer, &len, &mimetype) == NATIVE_HEAD_READ)
+			head = g_bytes_new (buffer, len);
+		g_free (mimetype);
+		g_free (path);
+	}
+#endif /* !_WIN32 */
+
+	g_mutex_lock (&batch->lock);
+	item->head = head;
+	item->done = TRUE;
+	g_cond_broadcast (&batch->cond);
+	g_mutex_unlock (&batch->lock);
+}
+
+/* Whether totem_pl_parser_parse_internal() is going to sniff the
+ * data of @file, rather than go by its name only */
+static gboolean
+totem_pl_parser_will_sniff (GFile            *file,
+			    TotemPlParseData *parse_data)
+{
+#ifndef _WIN32
+	char *uri, *mimetype;
+	gboolean ret;
+	guint i;
+
+	if (g_file_is_native (file) == FALSE)
+		return FALSE;
+	if (!parse_data->recurse && parse_data->recurse_level > 0)
+		return FALSE;
+	if (parse_data->force != FALSE)
+		return TRUE;
+
+	uri = g_file_get_uri (file);
+	mimetype = totem_pl_parser_mime_type_from_name (uri);
+	g_free (uri);
+
+	if (mimetype == NULL)
+		return TRUE;
+	ret = (strcmp (mimetype, UNKNOWN_TYPE) == 0 ||
+	       g_content_type_is_a (mimetype, "text/plain") != FALSE);
+	for (i = 0; i < G_N_ELEMENTS (dual_types) && ret == FALSE; i++) {
+		if (strcmp (dual_types[i].mimetype, mimetype) == 0)
+			ret = TRUE;
+	}
+	g_free (mimetype);
+
+	return ret;
+#else
+	/* Nothing gets read natively there */
+	return FALSE;
+#endif /* !_WIN32 */
+}
+
+static void
+totem_pl_parser_sniff_batch_push (TotemPlParserSniffBatch *batch)
+{
+	for (; batch->next < batch->items->len &&
+	     batch->next <= batch->claimed + SNIFF_MAX_AHEAD; batch->next++) {
+		SniffItem *item = g_ptr_array_index (batch->items, batch->next);
+
+		if (item == NULL)
+			continue;
+		if (batch->pool == NULL)
+			batch->pool = g_thread_pool_new ((GFunc) sniff_item_load, batch,
+							 SNIFF_MAX_JOBS, FALSE, NULL);
+		if (batch->pool == NULL)
+			item->done = TRUE;
+		else
+			g_thread_pool_push (batch->pool, item, NULL);
+	}
+}
+
+/**
+ * totem_pl_parser_sniff_batch_new:
+ * @parser: a #TotemPlParser
+ *
+ * Creates a batch to read the start of local files ahead of their
+ * parsing, see totem_pl_parser_sniff_batch_add().
+ *
+ * Return value: a new batch, to be freed with totem_pl_parser_sniff_batch_free()
+ **/
+TotemPlParserSniffBatch *
+totem_pl_parser_sniff_batch_new (TotemPlParser *parser)
+{
+	TotemPlParserSniffBatch *batch;
+
+	batch = g_new0 (TotemPlParserSniffBatch, 1);
+	batch->parser = parser;
+	g_mutex_init (&batch->lock);
+	g_cond_init (&batch->cond);
+	batch->items = g_ptr_array_new ();
+
+	return batch;
+}
+
+/**
+ * totem_pl_parser_sniff_batch_add:
+ * @batch: a #TotemPlParserSniffBatch
+ * @file: (allow-none): the next file that will be parsed, or %NULL
+ * @parse_data: the #TotemPlParseData @file will be parsed with
+ *
+ * Adds @file at the next index of @batch, %NULL entries only taking
+ * an index. If parsing @file is going to need its data sniffed, the start
+ * of it gets read in the background, once it's close enough to the last
+ * claimed index.
+ **/
+void
+totem_pl_parser_sniff_batch_add (TotemPlParserSniffBatch *batch,
+				 GFile                   *file,
+				 TotemPlParseData        *parse_data)
+{
+	SniffItem *item = NULL;
+
+	if (file != NULL && totem_pl_parser_will_sniff (file, parse_data) != FALSE) {
+		item = g_new0 (SniffItem, 1);
+		item->file = g_object_ref (file);
+	}
+	g_ptr_array_add (batch->items, item);
+
+	totem_pl_parser_sniff_batch_push (batch);
+}
+
+/**
+ * totem_pl_parser_sniff_batch_claim:
+ * @batch: a #TotemPlParserSniffBatch
+ * @index: the index of the file in @batch
+ * @parse_data: the #TotemPlParseData of the current parse
+ *
+ * Waits for the start of the file at @index to be read, and makes it
+ * available through @parse_data, so that sniffing it doesn't hit the disk
+ * again. Call totem_pl_parser_sniff_batch_release() once it's parsed.
+ **/
+void
+totem_pl_parser_sniff_batch_claim (TotemPlParserSniffBatch *batch,
+				   guint                    index,
+				   TotemPlParseData        *parse_data)
+{
+	TotemPlParser *parser = batch->parser;
+	TotemPlParserPhase phase;
+	SniffItem *item;
+
+	g_return_if_fail (index < batch->items->len);
+
+	batch->claimed = index;
+	totem_pl_parser_sniff_batch_push (batch);
+
+	item = g_ptr_array_index (batch->items, index);
+	if (item == NULL)
+		return;
+
+	phase = totem_pl_parser_stats_enter (TOTEM_PL_PARSER_PHASE_SNIFF);
+	g_mutex_lock (&batch->lock);
+	while (item->done == FALSE)
+		g_cond_wait (&batch->cond, &batch->lock);
+	g_mutex_unlock (&batch->lock);
+	totem_pl_parser_stats_leave (phase);
+
+	DEBUG(FETCH, item->file, g_print ("Read the start of '%s' ahead, %s\n",
+				   uri, item->head ? "using it" : "not using it"));
+
+	if (item->head == NULL)
+		return;
+	totem_pl_parser_stats_add_read (g_bytes_get_size (item->head));
+
+	if (parse_data->sniffed == NULL)
+		parse_data->sniffed = g_hash_table_new_full (g_str_hash, g_str_equal,
+							     g_free, (GDestroyNotify) g_bytes_unref);
+	g_hash_table_insert (parse_data->sniffed,
+			     g_file_get_uri (item->file),
+			     g_bytes_ref (item->head));
+}
+
+/**
+ * totem_pl_parser_sniff_batch_release:
+ * @batch: a #TotemPlParserSniffBatch
+ * @index: the index of the file in @batch
+ * @parse_data: the #TotemPlParseData of the current parse
+ *
+ * Drops the data read from the file at @index, once it's been parsed.
+ **/
+void
+totem_pl_parser_sniff_batch_release (TotemPlParserSniffBatch *batch,
+				     guint                    index,
+				     TotemPlParseData        *parse_data)
+{
+	SniffItem *item;
+
+	g_return_if_fail (index < batch->items->len);
+
+	item = g_ptr_array_index (batch->items, index);
+	if (item == NULL || item->done == FALSE)
+		return;
+
+	if (item->head != NULL && parse_data->sniffed != NULL) {
+		char *uri;
+
+		uri = g_file_get_uri (item->file);
+		g_hash_table_remove (parse_data->sniffed, uri);
+		g_free (uri);
+	}
+	g_clear_pointer (&item->head, g_bytes_unref);
+	g_clear_object (&item->file);
+	g_free (item);
+	g_ptr_array_index (batch->items, index) = NULL;
+}
+
+/**
+ * totem_pl_parser_sniff_batch_free:
+ * @batch: a #TotemPlParserSniffBatch
+ *
+ * Drops the reads not started yet, waits for the others, and frees @batch.
+ **/
+void
+totem_pl_parser_sniff_batch_free (TotemPlParserSniffBatch *batch)
+{
+	guint i;
+
+	if (batch->pool != NULL)
+		g_thread_pool_free (batch->pool, TRUE, TRUE);
+
+	for (i = 0; i < batch->items->len; i++) {
+		SniffItem *item = g_ptr_array_index (batch->items, i);
+
+		if (item == NULL)
+			continue;
+		g_clear_object (&item->file);
+		g_clear_pointer (&item->head, g_bytes_unref);
+		g_free (item);
+	}
+	g_ptr_array_free (batch->items, TRUE);
+	g_mutex_clear (&batch->lock);
+	g_cond_clear (&batch->cond);
+	g_free (batch);
+}
+
+static GBytes *
+totem_pl_parser_get_sniffed (GFile            *file,
+			     TotemPlParseData *parse_data)
+{
+	GBytes *head;
+	char *uri;
+
+	if (parse_data == NULL || parse_data->sniffed == NULL)
+		return NULL;
+
+	uri = g_file_get_uri (file);
+	head = g_hash_table_lookup (parse_data->sniffed, uri);
+	g_free (uri);
+
+	return head;
+}
+
 static char *
-my_g_file_info_get_mime_type_with_data (GFile *file, gpointer *data, TotemPlParser *parser)
+my_g_file_info_sniff_mime_type (GFile *file, gpointer *data, gsize *data_len, TotemPlParser *parser, TotemPlParseData *parse_data)
 {
 	char *buffer;
 	gsize bytes_read;
 	GFileInputStream *stream;
+	GBytes *prefetched;
 	GError *error = NULL;
 
 	*data = NULL;
 
+	/* Already fetched, or read ahead by a sniff batch */
+	prefetched = totem_pl_parser_get_prefetched (file, parse_data);
+	if (prefetched == NULL)
+		prefetched = totem_pl_parser_get_sniffed (file, parse_data);
+	if (prefetched != NULL) {
+		bytes_read = MIN (g_bytes_get_size (prefetched), MIME_READ_CHUNK_SIZE);
+		if (bytes_read == 0) {
+			DEBUG(SNIFF, file, g_print ("URI '%s' is empty in _get_mime_type_with_data\n", uri));
+			return g_strdup (EMPTY_FILE_TYPE);
+		}
+		*data_len = bytes_read;
+		return my_mime_type_from_sniffed_data (g_bytes_get_data (prefetched, NULL), bytes_read, data);
+	}
+
 #ifndef _WIN32
-	/* Stat for a block device, we're screwed as far as speed
-	 * is concerned now */
 	if (g_file_is_native (file) != FALSE) {
-		struct stat buf;
-		char *path;
+		char *mimetype;
 
-		path = g_file_get_path (file);
-		if (g_stat (path, &buf) == 0 && S_ISBLK (buf.st_mode)) {
-			g_free (path);
-			return g_strdup (BLOCK_DEVICE_TYPE);
-		}
-		g_free (path);
+		if (my_native_get_mime_type_with_data (file, data, data_len, &mimetype, parser) != FALSE)
+			return mimetype;
 	}
 #endif
 
@@ -761,26 +1980,27 @@ my_g_file_info_get_mime_type_with_data (GFile *file, gpointer *data, TotemPlPars
 			g_error_free (error);
 			return g_strdup (DIR_MIME_TYPE);
 		}
-		DEBUG(file, g_print ("URI '%s' couldn't be opened in _get_mime_type_with_data: '%s'\n", uri, error->message));
+		DEBUG(SNIFF, file, g_print ("URI '%s' couldn't be opened in _get_mime_type_with_data: '%s'\n", uri, error->message));
 		g_error_free (error);
 		return NULL;
 	}
-	DEBUG(file, g_print ("URI '%s' was opened successfully in _get_mime_type_with_data\n", uri));
+	DEBUG(SNIFF, file, g_print ("URI '%s' was opened successfully in _get_mime_type_with_data\n", uri));
 
 	/* Read the whole thing, up to MIME_READ_CHUNK_SIZE */
 	buffer = g_malloc (MIME_READ_CHUNK_SIZE);
 	if (g_input_stream_read_all (G_INPUT_STREAM (stream), buffer, MIME_READ_CHUNK_SIZE, &bytes_read, NULL, &error) == FALSE) {
 		g_object_unref (stream);
-		DEBUG(file, g_print ("Couldn't read data from '%s'\n", uri));
+		DEBUG(SNIFF, file, g_print ("Couldn't read data from '%s'\n", uri));
 		g_free (buffer);
 		return NULL;
 	}
 	g_object_unref (G_INPUT_STREAM (stream));
+	totem_pl_parser_stats_add_read (bytes_read);
 
 	/* Empty file */
 	if (bytes_read == 0) {
 		g_free (buffer);
-		DEBUG(file, g_print ("URI '%s' is empty in _get_mime_type_with_data\n", uri));
+		DEBUG(SNIFF, file, g_print ("URI '%s' is empty in _get_mime_type_with_data\n", uri));
 		return g_strdup (EMPTY_FILE_TYPE);
 	}
 
@@ -788,10 +2008,26 @@ my_g_file_info_get_mime_type_with_data (GFile *file, gpointer *data, TotemPlPars
 	buffer = g_realloc (buffer, bytes_read + 1);
 	buffer[bytes_read] = '\0';
 	*data = buffer;
+	*data_len = bytes_read;
 
 	return totem_pl_parser_mime_type_from_data (*data, bytes_read);
 }
 
+static char *
+my_g_file_info_get_mime_type_with_data (GFile *file, gpointer *data, TotemPlParser *parser, TotemPlParseData *parse_data)
+{
+	TotemPlParserPhase phase;
+	char *mimetype;
+
+	TRACE_URI (sniff_start, file, TRACE1 (sniff_start, uri));
+	phase = totem_pl_parser_stats_enter (TOTEM_PL_PARSER_PHASE_SNIFF);
+	mimetype = my_g_file_info_sniff_mime_type (file, data, &parse_data->data_len, parser, parse_data);
+	totem_pl_parser_stats_leave (phase);
+	TRACE_URI (sniff_done, file, TRACE2 (sniff_done, uri, mimetype));
+
+	return mimetype;
+}
+
 /**
  * totem_pl_parser_is_debugging_enabled:
  * @parser: a #TotemPlParser
@@ -801,9 +2037,26 @@ my_g_file_info_get_mime_type_with_data (GFile *file, gpointer *data, TotemPlPars
  * Return value: %TRUE if debugging is enabled, %FALSE otherwise
  **/
 gboolean
-totem_pl_parser_is_debugging_enabled (TotemPlParser *parser)
+totem_pl_parser_is_debugging_enabled (TotemPlParser *parser)
+{
+	return parser->priv->debug;
+}
+
+/**
+ * totem_pl_parser_debug_enabled:
+ * @parser: a #TotemPlParser
+ * @category: a #TotemPlParserDebugCategory
+ *
+ * Returns whether debug output in @category is enabled for @parser.
+ * Use DEBUG() instead, which avoids the call when no parsers have
+ * debugging enabled.
+ *
+ * Return value: %TRUE if debug output in @category is enabled
+ **/
+gboolean
+totem_pl_parser_debug_enabled (TotemPlParser *parser, TotemPlParserDebugCategory category)
 {
-	return parser->priv->debug;
+	return (parser->priv->debug_categories & category) != 0;
 }
 
 /**
@@ -996,6 +2249,10 @@ is_probably_dir (const char *filename)
 	short_name = relative_uri_remove_query (filename, NULL);
 	if (short_name == NULL)
 		short_name = g_strdup (filename);
+	if (totem_pl_parser_mime_type_from_extension (short_name) != NULL) {
+		g_free (short_name);
+		return FALSE;
+	}
 	content_type = g_content_type_guess (short_name, NULL, 0, NULL);
 	if (g_content_type_is_unknown (content_type) != FALSE) {
 		guint i;
@@ -1016,89 +2273,369 @@ is_probably_dir (const char *filename)
 	return ret;
 }
 
+/* A base URI, split up once so that relative references can be
+ * resolved against it with string operations only, as per RFC 3986.
+ * See totem_pl_parser_resolve_base_new(). */
+struct TotemPlParserResolveBase {
+	char *uri;
+	char *scheme;
+	char *authority; /* NULL if the URI doesn't have one */
+	char *path;
+	char *query; /* including the '?', or NULL */
+	char *dir; /* directory relative paths are merged with, '/'-terminated */
+};
+
+/* Returns the length of the scheme of @uri, excluding the ':', or 0
+ * if @uri doesn't start with a scheme. Same rules as g_uri_parse_scheme() */
+static gsize
+uri_scheme_len (const char *uri)
+{
+	const char *p;
+
+	if (g_ascii_isalpha (uri[0]) == FALSE)
+		return 0;
+
+	for (p = uri + 1; *p != '\0'; p++) {
+		if (*p == ':')
+			return p - uri;
+		if (g_ascii_isalnum (*p) == FALSE &&
+		    *p != '+' && *p != '-' && *p != '.')
+			return 0;
+	}
+
+	return 0;
+}
+
+/* Characters left alone in URI paths, as per RFC 3986 */
+#define URI_PATH_ALLOWED_CHARS "-._~!$&'()*+,;=:@/"
+/* Characters left alone in file names, as per g_filename_to_uri() */
+#define URI_FILENAME_ALLOWED_CHARS "-._~!$&'()*+,=:@/"
+
+/* Appends the first @len bytes of @path to @str, escaping anything
+ * that isn't alphanumeric or in @allowed. If @keep_escapes is %TRUE,
+ * already-escaped sequences are left alone */
+static void
+uri_append_escaped (GString    *str,
+		    const char *path,
+		    gsize       len,
+		    const char *allowed,
+		    gboolean    keep_escapes)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	gsize i;
+
+	for (i = 0; i < len; i++) {
+		guchar c = path[i];
+
+		if (g_ascii_isalnum (c) ||
+		    (c != '\0' && strchr (allowed, c) != NULL) ||
+		    (keep_escapes && c == '%' && i + 2 < len &&
+		     g_ascii_isxdigit (path[i + 1]) && g_ascii_isxdigit (path[i + 2]))) {
+			g_string_append_c (str, c);
+		} else {
+			g_string_append_c (str, '%');
+			g_string_append_c (str, hex[c >> 4]);
+			g_string_append_c (str, hex[c & 0xf]);
+		}
+	}
+}
+
+/* Implements the remove_dot_segments algorithm from RFC 3986
+ * section 5.2.4, in place */
+static void
+uri_remove_dot_segments (char *path)
+{
+	char *in, *out;
+
+	in = out = path;
+
+	while (*in != '\0') {
+		if (g_str_has_prefix (in, "../")) {
+			in += 3;
+		} else if (g_str_has_prefix (in, "./")) {
+			in += 2;
+		} else if (g_str_has_prefix (in, "/./")) {
+			in += 2;
+		} else if (strcmp (in, "/.") == 0) {
+			*out++ = '/';
+			break;
+		} else if (g_str_has_prefix (in, "/../") || strcmp (in, "/..") == 0) {
+			while (out > path && *(out - 1) != '/')
+				out--;
+			if (out > path)
+				out--;
+			if (in[3] == '\0') {
+				*out++ = '/';
+				break;
+			}
+			in += 3;
+		} else if (strcmp (in, ".") == 0 || strcmp (in, "..") == 0) {
+			break;
+		} else {
+			if (*in == '/')
+				*out++ = *in++;
+			while (*in != '\0' && *in != '/')
+				*out++ = *in++;
+		}
+	}
+
+	*out = '\0';
+}
+
+static TotemPlParserResolveBase *
+resolve_base_parse (GFile *base_file)
+{
+	TotemPlParserResolveBase *base;
+	const char *p, *end;
+	gsize len;
+
+	base = g_slice_new0 (TotemPlParserResolveBase);
+	base->uri = g_file_get_uri (base_file);
+
+	/* scheme ":" ["//" authority] path ["?" query] ["#" fragment] */
+	p = base->uri;
+	len = uri_scheme_len (p);
+	base->scheme = g_strndup (p, len);
+	p += len + (len > 0 ? 1 : 0);
+
+	if (p[0] == '/' && p[1] == '/') {
+		p += 2;
+		end = p + strcspn (p, "/?#");
+		base->authority = g_strndup (p, end - p);
+		p = end;
+	}
+
+	end = p + strcspn (p, "?#");
+	base->path = g_strndup (p, end - p);
+	p = end;
+
+	if (*p == '?') {
+		end = p + strcspn (p, "#");
+		base->query = g_strndup (p, end - p);
+	}
+
+	return base;
+}
+
+/**
+ * totem_pl_parser_resolve_base_new:
+ * @base_file: (allow-none): the base #GFile of a playlist
+ *
+ * Parses the URI of @base_file once, and decides which directory
+ * relative references found in the playlist should be resolved
+ * against, so that totem_pl_parser_resolve_uri_with_base() doesn't
+ * need to do any I/O, or create any #GFile.
+ *
+ * Return value: a new base, to be freed with totem_pl_parser_resolve_base_free(),
+ * or %NULL if @base_file is %NULL
+ **/
+TotemPlParserResolveBase *
+totem_pl_parser_resolve_base_new (GFile *base_file)
+{
+	TotemPlParserResolveBase *base;
+	char *slash;
+
+	if (base_file == NULL)
+		return NULL;
+
+	base = resolve_base_parse (base_file);
+
+	/* Check whether we need to get the parent for the base or not */
+	if (is_probably_dir (base->path) != FALSE) {
+		if (g_str_has_suffix (base->path, "/"))
+			base->dir = g_strdup (base->path);
+		else
+			base->dir = g_strconcat (base->path, "/", NULL);
+	} else {
+		slash = strrchr (base->path, '/');
+		if (slash != NULL)
+			base->dir = g_strndup (base->path, slash + 1 - base->path);
+		else if (base->authority != NULL)
+			base->dir = g_strdup ("/");
+		else
+			base->dir = g_strdup ("");
+	}
+
+	return base;
+}
+
+/**
+ * totem_pl_parser_resolve_base_new_for_dir:
+ * @dir: the directory relative references should be resolved against
+ *
+ * Like totem_pl_parser_resolve_base_new(), but for when the caller already
+ * knows that @dir is a directory, such as the parent of a playlist file.
+ *
+ * Return value: a new base, to be freed with totem_pl_parser_resolve_base_free()
+ **/
+TotemPlParserResolveBase *
+totem_pl_parser_resolve_base_new_for_dir (GFile *dir)
+{
+	TotemPlParserResolveBase *base;
+
+	g_return_val_if_fail (dir != NULL, NULL);
+
+	base = resolve_base_parse (dir);
+	if (g_str_has_suffix (base->path, "/"))
+		base->dir = g_strdup (base->path);
+	else
+		base->dir = g_strconcat (base->path, "/", NULL);
+
+	return base;
+}
+
+/**
+ * totem_pl_parser_resolve_base_free:
+ * @base: (allow-none): a #TotemPlParserResolveBase
+ *
+ * Frees @base.
+ **/
+void
+totem_pl_parser_resolve_base_free (TotemPlParserResolveBase *base)
+{
+	if (base == NULL)
+		return;
+
+	g_free (base->uri);
+	g_free (base->scheme);
+	g_free (base->authority);
+	g_free (base->path);
+	g_free (base->query);
+	g_free (base->dir);
+	g_slice_free (TotemPlParserResolveBase, base);
+}
+
+/**
+ * totem_pl_parser_resolve_uri_with_base:
+ * @base: (allow-none): a #TotemPlParserResolveBase
+ * @relative_uri: (allow-none): a URI reference, relative or absolute
+ *
+ * Resolves @relative_uri against @base, following RFC 3986, except that
+ * the base is treated as a directory if it looks like one (see
+ * totem_pl_parser_resolve_base_new()).
+ *
+ * Return value: a newly-allocated resolved URI, or %NULL
+ **/
 char *
-totem_pl_parser_resolve_uri (GFile *base_gfile,
-			     const char *relative_uri)
+totem_pl_parser_resolve_uri_with_base (const TotemPlParserResolveBase *base,
+				       const char *relative_uri)
 {
-	char *uri, *scheme, *query, *new_relative_uri, *base_uri;
-	GFile *base_parent_gfile, *resolved_gfile;
+	GString *str;
+	const char *query, *fragment;
+	gsize path_len;
 
 	if (relative_uri == NULL) {
-		if (base_gfile == NULL)
+		if (base == NULL)
 			return NULL;
-		return g_file_get_uri (base_gfile);
+		return g_strdup (base->uri);
 	}
 
-	if (base_gfile == NULL)
+	if (base == NULL)
 		return g_strdup (relative_uri);
 
 	/* If |relative_uri| has a scheme, it's a full URI, just return it */
-	scheme = g_uri_parse_scheme (relative_uri);
-	if (scheme != NULL) {
-		g_free (scheme);
+	if (uri_scheme_len (relative_uri) > 0)
 		return g_strdup (relative_uri);
-	}
 
-	/* Check whether we need to get the parent for the base or not */
-	base_uri = g_file_get_path (base_gfile);
-	if (base_uri == NULL)
-		base_uri = g_file_get_uri (base_gfile);
-	if (is_probably_dir (base_uri) == FALSE)
-		base_parent_gfile = g_file_get_parent (base_gfile);
-	else
-		base_parent_gfile = g_object_ref (base_gfile);
-	g_free (base_uri);
-
-	if (base_parent_gfile == NULL) {
-		resolved_gfile = g_file_resolve_relative_path (base_gfile, relative_uri);
-		uri = g_file_get_uri (resolved_gfile);
-		g_object_unref (resolved_gfile);
-		return uri;
-	}
-
-	/* Remove the query portion of the URI, to transplant it again
-	 * if there is any */
-	query = NULL;
-	new_relative_uri = relative_uri_remove_query (relative_uri, &query);
-
-	if (new_relative_uri) {
-		char *tmpuri;
-
-		resolved_gfile = g_file_resolve_relative_path (base_parent_gfile, new_relative_uri);
-		g_object_unref (base_parent_gfile);
-		if (!resolved_gfile) {
-			base_uri = g_file_get_uri (base_gfile);
-			g_warning ("Failed to resolve relative URI '%s' against base '%s'\n", relative_uri, base_uri);
-			g_free (base_uri);
-			g_free (new_relative_uri);
-			g_free (query);
-			return NULL;
-		}
+	str = g_string_sized_new (strlen (base->uri) + strlen (relative_uri));
+	g_string_append (str, base->scheme);
+	g_string_append_c (str, ':');
 
-		tmpuri = g_file_get_uri (resolved_gfile);
-		g_object_unref (resolved_gfile);
-		uri = g_strdup_printf ("%s%s", tmpuri, query);
+	/* Network-path reference, only the scheme is inherited */
+	if (relative_uri[0] == '/' && relative_uri[1] == '/') {
+		g_string_append (str, relative_uri);
+		return g_string_free (str, FALSE);
+	}
+
+	if (base->authority != NULL) {
+		g_string_append (str, "//");
+		g_string_append (str, base->authority);
+	}
 
-		g_free (tmpuri);
-		g_free (new_relative_uri);
-		g_free (query);
+	path_len = strcspn (relative_uri, "?#");
+	query = relative_uri + path_len;
+	fragment = query + strcspn (query, "#");
 
-		return uri;
+	if (path_len == 0) {
+		g_string_append (str, base->path);
+		if (query == fragment && base->query != NULL)
+			g_string_append (str, base->query);
 	} else {
-		resolved_gfile = g_file_resolve_relative_path (base_parent_gfile, relative_uri);
-		g_object_unref (base_parent_gfile);
-		if (!resolved_gfile) {
-			base_uri = g_file_get_uri (base_gfile);
-			g_warning ("Failed to resolve relative URI '%s' against base '%s'\n", relative_uri, base_uri);
-			g_free (base_uri);
-			return NULL;
-		}
+		gsize path_start = str->len;
+
+		if (relative_uri[0] != '/')
+			g_string_append (str, base->dir);
+		uri_append_escaped (str, relative_uri, path_len, URI_PATH_ALLOWED_CHARS, TRUE);
+		uri_remove_dot_segments (str->str + path_start);
+		g_string_set_size (str, strlen (str->str));
+	}
+
+	/* The query and the fragment are transplanted as-is */
+	g_string_append (str, query);
+
+	return g_string_free (str, FALSE);
+}
+
+/**
+ * totem_pl_parser_resolve_base_child_uri:
+ * @base: a #TotemPlParserResolveBase
+ * @path: a file name, or a path relative to @base
+ *
+ * Joins @path to the directory of @base, escaping it as a file name,
+ * in the same way g_file_get_child() and g_file_get_uri() would, but
+ * without creating any #GFile.
+ *
+ * Return value: a newly-allocated URI
+ **/
+char *
+totem_pl_parser_resolve_base_child_uri (const TotemPlParserResolveBase *base,
+					const char *path)
+{
+	GString *str;
+	gsize path_start;
+
+	g_return_val_if_fail (base != NULL, NULL);
+	g_return_val_if_fail (path != NULL, NULL);
+
+	str = g_string_sized_new (strlen (base->uri) + strlen (path) * 3);
+	g_string_append (str, base->scheme);
+	g_string_append_c (str, ':');
+	if (base->authority != NULL) {
+		g_string_append (str, "//");
+		g_string_append (str, base->authority);
+	}
+
+	path_start = str->len;
+	if (path[0] != '/')
+		g_string_append (str, base->dir);
+	uri_append_escaped (str, path, strlen (path), URI_FILENAME_ALLOWED_CHARS, FALSE);
+	uri_remove_dot_segments (str->str + path_start);
+	g_string_set_size (str, strlen (str->str));
+
+	return g_string_free (str, FALSE);
+}
 
-		uri = g_file_get_uri (resolved_gfile);
-		g_object_unref (resolved_gfile);
+char *
+totem_pl_parser_resolve_uri (GFile *base_gfile,
+			     const char *relative_uri)
+{
+	TotemPlParserResolveBase *base;
+	char *uri;
 
-		return uri;
+	if (relative_uri == NULL) {
+		if (base_gfile == NULL)
+			return NULL;
+		return g_file_get_uri (base_gfile);
 	}
+
+	if (base_gfile == NULL)
+		return g_strdup (relative_uri);
+
+	base = totem_pl_parser_resolve_base_new (base_gfile);
+	uri = totem_pl_parser_resolve_uri_with_base (base, relative_uri);
+	totem_pl_parser_resolve_base_free (base);
+
+	return uri;
 }
 
 #ifndef TOTEM_PL_PARSER_MINI
@@ -1294,6 +2831,8 @@ totem_pl_parser_finalize (GObject *object)
 	g_return_if_fail (object != NULL);
 	g_return_if_fail (priv != NULL);
 
+	totem_pl_parser_set_debug (TOTEM_PL_PARSER (object), FALSE);
+
 	g_clear_pointer (&priv->ignore_schemes, g_hash_table_destroy);
 	g_clear_pointer (&priv->ignore_mimetypes, g_hash_table_destroy);
 
@@ -1312,7 +2851,9 @@ typedef struct {
 static gboolean
 emit_entry_parsed_signal (EntryParsedSignalData *data)
 {
+	TRACE2 (emit_start, data->uri, data->signal_id);
 	g_signal_emit (data->parser, data->signal_id, 0, data->uri, data->metadata);
+	TRACE1 (emit_done, data->uri);
 
 	/* Free the data */
 	g_object_unref (data->parser);
@@ -1360,6 +2901,8 @@ totem_pl_parser_add_hash_table (TotemPlParser *parser,
 {
 	if (g_hash_table_size (metadata) > 0 || uri != NULL) {
 		EntryParsedSignalData *data;
+		StatsCollector *collector;
+		TotemPlParserPhase phase;
 
 		/* Make sure to emit the signals asynchronously, as we could be in the main loop
 		 * *or* a worker thread at this point. */
@@ -1373,7 +2916,13 @@ totem_pl_parser_add_hash_table (TotemPlParser *parser,
 		else
 			data->signal_id = totem_pl_parser_table_signals[PLAYLIST_STARTED];
 
+		collector = g_private_get (&current_stats);
+		if (collector != NULL && is_playlist == FALSE)
+			stats_collector_count (collector->stats->entries_emitted, collector->format);
+
+		phase = totem_pl_parser_stats_enter (TOTEM_PL_PARSER_PHASE_EMIT);
 		CALL_ASYNC (parser, emit_entry_parsed_signal, data);
+		totem_pl_parser_stats_leave (phase);
 	}
 }
 
@@ -1618,8 +3167,7 @@ totem_pl_parser_ignore (TotemPlParser *parser, const char *uri)
 	}
 	g_object_unref (file);
 
-	//FIXME wrong for win32
-	mimetype = g_content_type_guess (uri, NULL, 0, NULL);
+	mimetype = totem_pl_parser_mime_type_from_name (uri);
 	if (mimetype == NULL || strcmp (mimetype, UNKNOWN_TYPE) == 0) {
 		g_free (mimetype);
 		return FALSE;
@@ -1686,10 +3234,13 @@ totem_pl_parser_parse_xml_relaxed (char *contents,
 
 	totem_pl_parser_cleanup_xml (contents);
 	xml_parser = xml_parser_init_r (contents, size, XML_PARSER_CASE_INSENSITIVE);
+	TRACE1 (xml_build_start, size);
 	if (xml_parser_build_tree_with_options_r (xml_parser, &doc, XML_PARSER_RELAXED | XML_PARSER_MULTI_TEXT) < 0) {
+		TRACE1 (xml_build_done, NULL);
 		xml_parser_finalize_r (xml_parser);
 		return NULL;
 	}
+	TRACE1 (xml_build_done, doc);
 
 	xml_parser_finalize_r (xml_parser);
 
@@ -1717,11 +3268,14 @@ totem_pl_parser_parse_xml_relaxed (char *contents,
 	g_free (encoding);
 
 	xml_parser = xml_parser_init_r (new_contents, new_size, XML_PARSER_CASE_INSENSITIVE);
+	TRACE1 (xml_build_start, new_size);
 	if (xml_parser_build_tree_with_options_r (xml_parser, &doc, XML_PARSER_RELAXED | XML_PARSER_MULTI_TEXT) < 0) {
+		TRACE1 (xml_build_done, NULL);
 		xml_parser_finalize_r (xml_parser);
 		g_free (new_contents);
 		return NULL;
 	}
+	TRACE1 (xml_build_done, doc);
 
 	xml_parser_finalize_r (xml_parser);
 	g_free (new_contents);
@@ -1744,13 +3298,11 @@ totem_pl_parser_ignore_from_mimetype (TotemPlParser *parser, const char *mimetyp
 		    strcmp (mimetype, "audio/x-mpegurl") != 0 &&
 		    strcmp (mimetype, "video/x-mjpeg") != 0 &&
 		    g_content_type_is_a (mimetype, ignore_types[i].mimetype) != FALSE) {
-			if (parser->priv->debug)
-				g_print ("Ignoring %s because it's a %s\n", mimetype, ignore_types[i].mimetype);
+			DEBUG1(PARSE, g_print ("Ignoring %s because it's a %s\n", mimetype, ignore_types[i].mimetype));
 			return TRUE;
 		}
 		if (g_content_type_equals (mimetype, ignore_types[i].mimetype) != FALSE) {
-			if (parser->priv->debug)
-				g_print ("Ignoring %s because it's equal to %s\n", mimetype, ignore_types[i].mimetype);
+			DEBUG1(PARSE, g_print ("Ignoring %s because it's equal to %s\n", mimetype, ignore_types[i].mimetype));
 			return TRUE;
 		}
 	}
@@ -1777,17 +3329,18 @@ totem_pl_parser_get_function_for_mimetype (const char *mimetype)
 	return NULL;
 }
 
-TotemPlParserResult
-totem_pl_parser_parse_internal (TotemPlParser *parser,
-				GFile *file,
-				GFile *base_file,
-				TotemPlParseData *parse_data)
+static TotemPlParserResult
+totem_pl_parser_parse_internal_real (TotemPlParser *parser,
+				     GFile *file,
+				     GFile *base_file,
+				     TotemPlParseData *parse_data)
 {
 	char *mimetype;
 	guint i;
 	gpointer data = NULL;
 	TotemPlParserResult ret = TOTEM_PL_PARSER_RESULT_UNHANDLED;
 	gboolean found = FALSE;
+	const char *format;
 
 	if (parse_data->recurse_level > RECURSE_LEVEL_MAX)
 		return TOTEM_PL_PARSER_RESULT_ERROR;
@@ -1797,7 +3350,7 @@ totem_pl_parser_parse_internal (TotemPlParser *parser,
 			|| g_file_has_uri_scheme (file, "rtmp") != FALSE
 			|| g_file_has_uri_scheme (file, "icy") != FALSE
 			|| g_file_has_uri_scheme (file, "pnm") != FALSE) {
-		DEBUG(file, g_print ("URI '%s' is MMS, RTSP, RTMP, PNM or ICY, not a playlist\n", uri));
+		DEBUG(PARSE, file, g_print ("URI '%s' is MMS, RTSP, RTMP, PNM or ICY, not a playlist\n", uri));
 		return TOTEM_PL_PARSER_RESULT_UNHANDLED;
 	}
 
@@ -1807,16 +3360,16 @@ totem_pl_parser_parse_internal (TotemPlParser *parser,
 	if (g_file_has_uri_scheme (file, "itpc") != FALSE
 	    || g_file_has_uri_scheme (file, "feed") != FALSE
 	    || g_file_has_uri_scheme (file, "zcast") != FALSE) {
-		DEBUG(file, g_print ("URI '%s' is getting special cased for ITPC/FEED/ZCAST parsing\n", uri));
+		DEBUG(PARSE, file, g_print ("URI '%s' is getting special cased for ITPC/FEED/ZCAST parsing\n", uri));
 		return totem_pl_parser_add_itpc (parser, file, base_file, parse_data, NULL);
 	}
 	if (g_file_has_uri_scheme (file, "zune") != FALSE) {
-		DEBUG(file, g_print ("URI '%s' is getting special cased for ZUNE parsing\n", uri));
+		DEBUG(PARSE, file, g_print ("URI '%s' is getting special cased for ZUNE parsing\n", uri));
 		return totem_pl_parser_add_zune (parser, file, base_file, parse_data, NULL);
 	}
 	/* Try itms Podcast references, see itunes.py in PenguinTV */
 	if (totem_pl_parser_is_itms_feed (file) != FALSE) {
-		DEBUG(file, g_print ("URI '%s' is getting special cased for ITMS parsing\n", uri));
+		DEBUG(PARSE, file, g_print ("URI '%s' is getting special cased for ITMS parsing\n", uri));
 		return totem_pl_parser_add_itms (parser, file, NULL, parse_data, NULL);
 	}
 
@@ -1839,23 +3392,16 @@ totem_pl_parser_parse_internal (TotemPlParser *parser,
 
 	/* In force mode we want to get the data */
 	if (parse_data->force != FALSE) {
-		mimetype = my_g_file_info_get_mime_type_with_data (file, &data, parser);
+		mimetype = my_g_file_info_get_mime_type_with_data (file, &data, parser, parse_data);
 	} else {
+		TotemPlParserPhase phase;
 		char *uri;
 
+		phase = totem_pl_parser_stats_enter (TOTEM_PL_PARSER_PHASE_SNIFF);
 		uri = g_file_get_uri (file);
-#ifdef G_OS_WIN32
-		{
-			char *content_type;
-			content_type = g_content_type_guess (uri, NULL, 0, NULL);
-			mimetype = g_content_type_get_mime_type (content_type);
-			g_free (content_type);
-		}
-#else
-		mimetype = g_content_type_guess (uri, NULL, 0, NULL);
-#endif
-
+		mimetype = totem_pl_parser_mime_type_from_name (uri);
 		g_free (uri);
+		totem_pl_parser_stats_leave (phase);
 	}
 
 	/* We're much more likely to have an MP2T file instead */
@@ -1872,17 +3418,17 @@ totem_pl_parser_parse_internal (TotemPlParser *parser,
 		mimetype = NULL;
 	}
 
-	DEBUG(file, g_print ("_get_mime_type_for_name for '%s' returned '%s'\n", uri, mimetype));
+	DEBUG(SNIFF, file, g_print ("_get_mime_type_for_name for '%s' returned '%s'\n", uri, mimetype));
 	if (mimetype == NULL || strcmp (UNKNOWN_TYPE, mimetype) == 0
 	    || (g_file_is_native (file) && g_content_type_is_a (mimetype, "text/plain") != FALSE)) {
 		char *new_mimetype;
-		new_mimetype = my_g_file_info_get_mime_type_with_data (file, &data, parser);
+		new_mimetype = my_g_file_info_get_mime_type_with_data (file, &data, parser, parse_data);
 		if (new_mimetype) {
 			g_free (mimetype);
 			mimetype = new_mimetype;
-			DEBUG(file, g_print ("_get_mime_type_with_data for '%s' returned '%s'\n", uri, mimetype ? mimetype : "NULL"));
+			DEBUG(SNIFF, file, g_print ("_get_mime_type_with_data for '%s' returned '%s'\n", uri, mimetype ? mimetype : "NULL"));
 		} else {
-			DEBUG(file, g_print ("_get_mime_type_with_data for '%s' returned NULL, ignoring\n", uri));
+			DEBUG(SNIFF, file, g_print ("_get_mime_type_with_data for '%s' returned NULL, ignoring\n", uri));
 		}
 	}
 
@@ -1905,12 +3451,12 @@ totem_pl_parser_parse_internal (TotemPlParser *parser,
 	 * data from the playlist parser */
 	if (strcmp (mimetype, AUDIO_MPEG_TYPE) == 0 && parse_data->recurse_level == 0 && data == NULL) {
 		char *tmp;
-		tmp = my_g_file_info_get_mime_type_with_data (file, &data, parser);
+		tmp = my_g_file_info_get_mime_type_with_data (file, &data, parser, parse_data);
 		if (tmp != NULL) {
 			g_free (mimetype);
 			mimetype = tmp;
 		}
-		DEBUG(file, g_print ("_get_mime_type_with_data for '%s' returned '%s' (was %s)\n", uri, mimetype, AUDIO_MPEG_TYPE));
+		DEBUG(SNIFF, file, g_print ("_get_mime_type_with_data for '%s' returned '%s' (was %s)\n", uri, mimetype, AUDIO_MPEG_TYPE));
 	}
 
 	if (totem_pl_parser_mimetype_is_ignored (parser, mimetype) != FALSE) {
@@ -1920,13 +3466,19 @@ totem_pl_parser_parse_internal (TotemPlParser *parser,
 	}
 
 	if (parse_data->recurse || parse_data->recurse_level == 0) {
+		StatsCollector *collector;
+
 		parse_data->recurse_level++;
+		collector = g_private_get (&current_stats);
+		if (collector != NULL)
+			collector->stats->max_recurse_level = MAX (collector->stats->max_recurse_level,
+								   parse_data->recurse_level);
 
 		for (i = 0; i < G_N_ELEMENTS(special_types); i++) {
 			if (strcmp (special_types[i].mimetype, mimetype) == 0) {
-				DEBUG(file, g_print ("URI '%s' is special type '%s'\n", uri, mimetype));
+				DEBUG(PARSE, file, g_print ("URI '%s' is special type '%s'\n", uri, mimetype));
 				if (parse_data->disable_unsafe != FALSE && special_types[i].unsafe != FALSE) {
-					DEBUG(file, g_print ("URI '%s' is unsafe so was ignored\n", uri));
+					DEBUG(PARSE, file, g_print ("URI '%s' is unsafe so was ignored\n", uri));
 					g_free (mimetype);
 					g_free (data);
 					return TOTEM_PL_PARSER_RESULT_IGNORED;
@@ -1936,8 +3488,12 @@ totem_pl_parser_parse_internal (TotemPlParser *parser,
 				else
 					base_file = g_object_ref (base_file);
 
-				DEBUG (file, g_print ("Using %s function for '%s'\n", special_types[i].mimetype, uri));
+				DEBUG (PARSE, file, g_print ("Using %s function for '%s'\n", special_types[i].mimetype, uri));
+				format = stats_collector_set_format (mimetype);
+				TRACE_URI (handler_start, file, TRACE2 (handler_start, mimetype, uri));
 				ret = (* special_types[i].func) (parser, file, base_file, parse_data, data);
+				TRACE2 (handler_done, mimetype, ret);
+				stats_collector_set_format (format);
 
 				if (base_file != NULL)
 					g_object_unref (base_file);
@@ -1951,17 +3507,17 @@ totem_pl_parser_parse_internal (TotemPlParser *parser,
 			if (strcmp (dual_types[i].mimetype, mimetype) == 0) {
 				PlaylistCallback func;
 
-				DEBUG(file, g_print ("URI '%s' is dual type '%s'\n", uri, mimetype));
+				DEBUG(PARSE, file, g_print ("URI '%s' is dual type '%s'\n", uri, mimetype));
 				if (data == NULL) {
 					g_free (mimetype);
-					mimetype = my_g_file_info_get_mime_type_with_data (file, &data, parser);
-					DEBUG(file, g_print ("URI '%s' dual type has type '%s' from data\n", uri, mimetype));
+					mimetype = my_g_file_info_get_mime_type_with_data (file, &data, parser, parse_data);
+					DEBUG(SNIFF, file, g_print ("URI '%s' dual type has type '%s' from data\n", uri, mimetype));
 				}
 				/* If it's _still_ a text/plain, we don't want it */
 				if (mimetype != NULL &&
 				    g_content_type_is_a (mimetype, "text/plain") &&
 				    g_content_type_is_a (mimetype, "application/xml") == FALSE) {
-					DEBUG(file, g_print ("Ignoring URI '%s' dual type because '%s' is a text/plain\n", uri, mimetype));
+					DEBUG(PARSE, file, g_print ("Ignoring URI '%s' dual type because '%s' is a text/plain\n", uri, mimetype));
 					ret = TOTEM_PL_PARSER_RESULT_IGNORED;
 					g_free (mimetype);
 					mimetype = NULL;
@@ -1970,7 +3526,7 @@ totem_pl_parser_parse_internal (TotemPlParser *parser,
 				/* Now look for the proper function to use */
 				func = totem_pl_parser_get_function_for_mimetype (mimetype);
 				if ((func == NULL && mimetype != NULL) || (mimetype == NULL && dual_types[i].func == NULL)) {
-					DEBUG(file, g_print ("Ignoring URI '%s' because we couldn't find a playlist parser for '%s'\n", uri, mimetype));
+					DEBUG(PARSE, file, g_print ("Ignoring URI '%s' because we couldn't find a playlist parser for '%s'\n", uri, mimetype));
 					ret = TOTEM_PL_PARSER_RESULT_UNHANDLED;
 					g_free (mimetype);
 					mimetype = NULL;
@@ -1984,7 +3540,11 @@ totem_pl_parser_parse_internal (TotemPlParser *parser,
 				else
 					base_file = g_object_ref (base_file);
 
+				format = stats_collector_set_format (mimetype ? mimetype : dual_types[i].mimetype);
+				TRACE_URI (handler_start, file, TRACE2 (handler_start, mimetype ? mimetype : dual_types[i].mimetype, uri));
 				ret = (* func) (parser, file, base_file ? base_file : file, parse_data, data);
+				TRACE2 (handler_done, mimetype ? mimetype : dual_types[i].mimetype, ret);
+				stats_collector_set_format (format);
 
 				if (base_file != NULL)
 					g_object_unref (base_file);
@@ -2018,6 +3578,27 @@ totem_pl_parser_parse_internal (TotemPlParser *parser,
 	return ret;
 }
 
+TotemPlParserResult
+totem_pl_parser_parse_internal (TotemPlParser *parser,
+				GFile *file,
+				GFile *base_file,
+				TotemPlParseData *parse_data)
+{
+	StatsCollector *collector;
+	TotemPlParserResult ret;
+
+	collector = g_private_get (&current_stats);
+	TRACE_URI (parse_start, file, TRACE2 (parse_start, uri, parse_data->recurse_level));
+	ret = totem_pl_parser_parse_internal_real (parser, file, base_file, parse_data);
+	TRACE_URI (parse_done, file, TRACE2 (parse_done, uri, ret));
+
+	/* Files linked to by a playlist, and ignored, are counted against it */
+	if (collector != NULL && ret == TOTEM_PL_PARSER_RESULT_IGNORED && parse_data->recurse_level > 0)
+		stats_collector_count (collector->stats->entries_ignored, collector->format);
+
+	return ret;
+}
+
 typedef struct {
 	char *uri;
 	char *base;
@@ -2047,7 +3628,8 @@ parse_thread (GTask *task, gpointer source_object, gpointer task_data, GCancella
 	}
 
 	/* Parse and return */
-	parse_result = totem_pl_parser_parse_with_base (parser, data->uri, data->base, data->fallback);
+	parse_result = totem_pl_parser_parse_with_base_cancellable (parser, data->uri, data->base,
+								     data->fallback, cancellable);
 	g_task_return_int (task, parse_result);
 }
 
@@ -2092,6 +3674,39 @@ totem_pl_parser_parse_with_base_async (TotemPlParser *parser, const char *uri, c
 	g_object_unref (task);
 }
 
+void
+totem_pl_parser_parse_data_init (TotemPlParser *parser,
+				 TotemPlParseData *parse_data,
+				 gboolean fallback)
+{
+	/* Use a struct to store copies of the options as set for this parse operation */
+	parse_data->recurse_level = 0;
+	parse_data->fallback = fallback;
+	parse_data->recurse = parser->priv->recurse;
+	parse_data->force = parser->priv->force;
+	parse_data->disable_unsafe = parser->priv->disable_unsafe;
+	parse_data->cancellable = NULL;
+	parse_data->prefetched = NULL;
+	parse_data->sniffed = NULL;
+	parse_data->disc_dirs = NULL;
+	parse_data->dir_listings = NULL;
+	parse_data->dir_pool = NULL;
+	parse_data->data_len = 0;
+}
+
+void
+totem_pl_parser_parse_data_clear (TotemPlParseData *parse_data)
+{
+	g_clear_pointer (&parse_data->prefetched, g_hash_table_destroy);
+	g_clear_pointer (&parse_data->sniffed, g_hash_table_destroy);
+	g_clear_pointer (&parse_data->disc_dirs, g_hash_table_destroy);
+	g_clear_pointer (&parse_data->dir_listings, g_hash_table_destroy);
+	if (parse_data->dir_pool != NULL) {
+		g_thread_pool_free (parse_data->dir_pool, FALSE, TRUE);
+		parse_data->dir_pool = NULL;
+	}
+}
+
 /**
  * totem_pl_parser_parse_with_base:
  * @parser: a #TotemPlParser
@@ -2109,15 +3724,24 @@ TotemPlParserResult
 totem_pl_parser_parse_with_base (TotemPlParser *parser, const char *uri,
 				 const char *base, gboolean fallback)
 {
-	GFile *file, *base_file;
-	TotemPlParserResult retval;
-	TotemPlParseData data;
-
 	g_return_val_if_fail (TOTEM_IS_PL_PARSER (parser), TOTEM_PL_PARSER_RESULT_UNHANDLED);
 	g_return_val_if_fail (uri != NULL, TOTEM_PL_PARSER_RESULT_UNHANDLED);
 	g_return_val_if_fail (strstr (uri, "://") != NULL,
 			TOTEM_PL_PARSER_RESULT_ERROR);
 
+	return totem_pl_parser_parse_with_base_cancellable (parser, uri, base, fallback, NULL);
+}
+
+static TotemPlParserResult
+totem_pl_parser_parse_with_base_cancellable (TotemPlParser *parser, const char *uri,
+					     const char *base, gboolean fallback,
+					     GCancellable *cancellable)
+{
+	GFile *file, *base_file;
+	TotemPlParserResult retval;
+	TotemPlParseData data;
+	StatsCollector *previous_stats;
+
 	file = g_file_new_for_uri (uri);
 	base_file = NULL;
 
@@ -2126,17 +3750,16 @@ totem_pl_parser_parse_with_base (TotemPlParser *parser, const char *uri,
 		return TOTEM_PL_PARSER_RESULT_UNHANDLED;
 	}
 
-	/* Use a struct to store copies of the options as set for this parse operation */
-	data.recurse_level = 0;
-	data.fallback = fallback;
-	data.recurse = parser->priv->recurse;
-	data.force = parser->priv->force;
-	data.disable_unsafe = parser->priv->disable_unsafe;
+	previous_stats = stats_collector_begin (parser);
+	totem_pl_parser_parse_data_init (parser, &data, fallback);
+	data.cancellable = cancellable;
 
 	if (base != NULL)
 		base_file = g_file_new_for_uri (base);
 	retval = totem_pl_parser_parse_internal (parser, file, base_file, &data);
 
+	totem_pl_parser_parse_data_clear (&data);
+	stats_collector_end (parser, previous_stats);
 	g_object_unref (file);
 	if (base_file != NULL)
 		g_object_unref (base_file);
@@ -2377,15 +4000,137 @@ totem_pl_parser_parse_date (const char *date_str, gboolean debug)
 }
 #endif /* !TOTEM_PL_PARSER_MINI */
 
+/* Signatures of the formats in special_types and dual_types, checked
+ * before going through the whole of the shared-mime-info database */
+static const struct {
+	const char *magic;
+	gsize len;
+	const char *mimetype;
+} prefix_magics[] = {
+	{ "\x30\x26\xb2\x75\x8e\x66\xcf\x11", 8, "application/vnd.ms-asf" },
+	{ ".RMF", 4, "application/vnd.rn-realmedia" },
+	{ ".ra\xfd", 4, "audio/vnd.rn-realaudio" },
+	{ "[playlist]", 10, "audio/x-scpls" },
+	{ "[Playlist]", 10, "audio/x-scpls" },
+	{ "[PLAYLIST]", 10, "audio/x-scpls" },
+	{ "[Desktop Entry]", 15, "application/x-desktop" },
+};
+
+static const struct {
+	const char *root;
+	const char *xmlns; /* NULL if any will do */
+	const char *mimetype;
+} xml_magics[] = {
+	{ "asx", NULL, "audio/x-ms-asx" },
+	{ "smil", NULL, "application/smil+xml" },
+	{ "rss", NULL, RSS_MIME_TYPE },
+	{ "feed", "http://www.w3.org/2005/Atom", ATOM_MIME_TYPE },
+	{ "opml", NULL, OPML_MIME_TYPE },
+	{ "playlist", "http://xspf.org/ns/0/", "application/xspf+xml" },
+};
+
+/* Finds the start tag of the root element in @data, skipping
+ * the XML declaration, comments and doctype */
+static const char *
+magic_find_xml_root (const char *data, gsize len, gsize *name_len, gsize *tag_len)
+{
+	const char *p, *end, *name, *close;
+
+	p = data;
+	end = data + len;
+	/* UTF-8 byte order mark */
+	if (len >= 3 && memcmp (p, "\xef\xbb\xbf", 3) == 0)
+		p += 3;
+
+	while (TRUE) {
+		for (; p < end && g_ascii_isspace (*p); p++)
+			;
+		if (end - p < 2 || *p != '<')
+			return NULL;
+		if (p[1] != '?' && p[1] != '!')
+			break;
+		if (end - p >= 4 && memcmp (p, "<!--", 4) == 0) {
+			close = g_strstr_len (p, end - p, "-->");
+			if (close == NULL)
+				return NULL;
+			p = close + 3;
+		} else {
+			close = memchr (p, '>', end - p);
+			if (close == NULL)
+				return NULL;
+			p = close + 1;
+		}
+	}
+
+	name = p + 1;
+	for (p = name; p < end && (g_ascii_isalnum (*p) || *p == '-' || *p == '_' || *p == '.'); p++)
+		;
+	if (p == name || p == end)
+		return NULL;
+	close = memchr (p, '>', end - p);
+	if (close == NULL)
+		return NULL;
+
+	*name_len = p - name;
+	*tag_len = close - name;
+	return name;
+}
+
+static const char *
+totem_pl_parser_mime_type_from_magic (const char *data, gsize len)
+{
+	const char *root;
+	gsize name_len, tag_len;
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (prefix_magics); i++) {
+		if (len >= prefix_magics[i].len &&
+		    memcmp (data, prefix_magics[i].magic, prefix_magics[i].len) == 0)
+			return prefix_magics[i].mimetype;
+	}
+
+	if (len >= 7 && memcmp (data, "#EXTM3U", 7) == 0) {
+		if (g_strstr_len (data, len, "#EXT-X-STREAM-INF") != NULL ||
+		    g_strstr_len (data, len, "#EXT-X-TARGETDURATION") != NULL)
+			return HLS_MIME_TYPE;
+		return "audio/x-mpegurl";
+	}
+
+	if (g_strstr_len (data, MIN (len, 256), "<?wpl") != NULL)
+		return "application/vnd.ms-wpl";
+
+	root = magic_find_xml_root (data, len, &name_len, &tag_len);
+	if (root == NULL)
+		return NULL;
+	for (i = 0; i < G_N_ELEMENTS (xml_magics); i++) {
+		if (name_len != strlen (xml_magics[i].root) ||
+		    g_ascii_strncasecmp (root, xml_magics[i].root, name_len) != 0)
+			continue;
+		if (xml_magics[i].xmlns != NULL &&
+		    g_strstr_len (root, tag_len, xml_magics[i].xmlns) == NULL)
+			continue;
+		return xml_magics[i].mimetype;
+	}
+
+	return NULL;
+}
+
 static char *
 totem_pl_parser_mime_type_from_data (gconstpointer data, int len)
 {
 	char *mime_type;
 	gboolean uncertain;
-
+	const char *magic;
 #ifdef G_OS_WIN32
 	char *content_type;
+#endif
 
+	/* Playlists are recognised without asking GIO */
+	magic = totem_pl_parser_mime_type_from_magic (data, len);
+	if (magic != NULL)
+		return g_strdup (magic);
+
+#ifdef G_OS_WIN32
 	content_type = g_content_type_guess (NULL, data, len, &uncertain);
 	if (uncertain == FALSE) {
 		mime_type = g_content_type_get_mime_type (content_type);
@@ -2563,5 +4308,86 @@ totem_pl_parser_metadata_get_type (void)
 	}
 	return g_define_type_id__volatile;
 }
+
+static GHashTable *
+stats_counts_copy (GHashTable *counts)
+{
+	GHashTable *copy;
+	GHashTableIter iter;
+	gpointer key, value;
+
+	copy = g_hash_table_new (g_str_hash, g_str_equal);
+	if (counts == NULL)
+		return copy;
+
+	/* Keys are interned, so they can be shared */
+	g_hash_table_iter_init (&iter, counts);
+	while (g_hash_table_iter_next (&iter, &key, &value))
+		g_hash_table_insert (copy, (gpointer) g_intern_string (key), value);
+
+	return copy;
+}
+
+/**
+ * totem_pl_parser_stats_copy:
+ * @stats: a #TotemPlParserStats
+ *
+ * Copies @stats.
+ *
+ * Return value: (transfer full): a newly-allocated copy of @stats,
+ * to free with totem_pl_parser_stats_free()
+ *
+ * Since: 3.28
+ **/
+TotemPlParserStats *
+totem_pl_parser_stats_copy (const TotemPlParserStats *stats)
+{
+	TotemPlParserStats *copy;
+
+	g_return_val_if_fail (stats != NULL, NULL);
+
+	copy = g_new (TotemPlParserStats, 1);
+	*copy = *stats;
+	copy->entries_emitted = stats_counts_copy (stats->entries_emitted);
+	copy->entries_ignored = stats_counts_copy (stats->entries_ignored);
+
+	return copy;
+}
+
+/**
+ * totem_pl_parser_stats_free:
+ * @stats: a #TotemPlParserStats
+ *
+ * Frees @stats.
+ *
+ * Since: 3.28
+ **/
+void
+totem_pl_parser_stats_free (TotemPlParserStats *stats)
+{
+	if (stats == NULL)
+		return;
+
+	if (stats->entries_emitted != NULL)
+		g_hash_table_unref (stats->entries_emitted);
+	if (stats->entries_ignored != NULL)
+		g_hash_table_unref (stats->entries_ignored);
+	g_free (stats);
+}
+
+GType
+totem_pl_parser_stats_get_type (void)
+{
+	static volatile gsize g_define_type_id__volatile = 0;
+	if (g_once_init_enter (&g_define_type_id__volatile))
+	{
+		GType g_define_type_id = g_boxed_type_register_static (
+		    g_intern_static_string ("TotemPlParserStats"),
+		    (GBoxedCopyFunc) totem_pl_parser_stats_copy,
+		    (GBoxedFreeFunc) totem_pl_parser_stats_free);
+		g_once_init_leave (&g_define_type_id__volatile, g_define_type_id);
+	}
+	return g_define_type_id__volatile;
+}
 #endif /* !TOTEM_PL_PARSER_MINI */
 
@@ -153,6 +153,15 @@ typedef struct {
  * Metadata field for an entry's playback end time.
  **/
 #define TOTEM_PL_PARSER_FIELD_ENDTIME		"endtime"
+/**
+ * TOTEM_PL_PARSER_FIELD_OFFSET_MS:
+ *
+ * Metadata field for an entry's start offset in the playlist's timeline, in milliseconds.
+ * It's only used for playlists with a timing model, such as SMIL ones, when the offset is known.
+ *
+ * Since: 3.28
+ **/
+#define TOTEM_PL_PARSER_FIELD_OFFSET_MS		"offset-ms"
 /**
  * TOTEM_PL_PARSER_FIELD_COPYRIGHT:
  *
@@ -393,6 +402,47 @@ typedef GHashTable TotemPlParserMetadata;
 GType totem_pl_parser_metadata_get_type (void) G_GNUC_CONST;
 #define TOTEM_TYPE_PL_PARSER_METADATA (totem_pl_parser_metadata_get_type())
 
+/**
+ * TotemPlParserStats:
+ * @total_time: wall-clock time spent in the parse, in microseconds
+ * @sniff_time: time spent reading the start of files to find out their type, in microseconds
+ * @load_time: time spent loading the contents of playlists, in microseconds
+ * @parse_time: time spent tokenising playlists and building their XML trees, in microseconds
+ * @emit_time: time spent emitting entries, in microseconds
+ * @bytes_read: the number of bytes read from playlists and the files they link to
+ * @num_reads: the number of files opened or loaded
+ * @num_helper_spawns: the number of times a helper was spawned to handle video sites
+ * @max_recurse_level: the deepest level of nested playlists or directories parsed, 1 being the top-level one
+ * @entries_emitted: (element-type utf8 guint): the number of entries emitted, per playlist mime-type
+ * @entries_ignored: (element-type utf8 guint): the number of files linked to that were ignored,
+ * because of their type or location, per playlist mime-type
+ *
+ * Statistics about a single parse, passed to the
+ * #TotemPlParser::stats-collected signal when #TotemPlParser:collect-stats
+ * is %TRUE. Time spent in none of the other phases is counted in @parse_time.
+ *
+ * Since: 3.28
+ **/
+typedef struct {
+	gint64 total_time;
+	gint64 sniff_time;
+	gint64 load_time;
+	gint64 parse_time;
+	gint64 emit_time;
+	guint64 bytes_read;
+	guint num_reads;
+	guint num_helper_spawns;
+	guint max_recurse_level;
+	GHashTable *entries_emitted;
+	GHashTable *entries_ignored;
+} TotemPlParserStats;
+
+GType totem_pl_parser_stats_get_type (void) G_GNUC_CONST;
+#define TOTEM_TYPE_PL_PARSER_STATS (totem_pl_parser_stats_get_type())
+
+TotemPlParserStats *totem_pl_parser_stats_copy (const TotemPlParserStats *stats);
+void totem_pl_parser_stats_free (TotemPlParserStats *stats);
+
 G_END_DECLS
 
 #endif /* TOTEM_PL_PARSER_H */
@@ -44,11 +44,15 @@
  **/
 
 #include "totem-pl-playlist.h"
+#include "totem-pl-parser-private.h"
 
 typedef struct TotemPlPlaylistPrivate TotemPlPlaylistPrivate;
 
 struct TotemPlPlaylistPrivate {
         GList *items;
+        /* So that appending, and getting the size, don't walk the list */
+        GList *last;
+        guint n_items;
 };
 
 #define TOTEM_PL_PLAYLIST_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), TOTEM_TYPE_PL_PLAYLIST, TotemPlPlaylistPrivate))
@@ -117,7 +121,7 @@ totem_pl_playlist_size (TotemPlPlaylist *playlist)
 
         priv = TOTEM_PL_PLAYLIST_GET_PRIVATE (playlist);
 
-        return g_list_length (priv->items);
+        return priv->n_items;
 }
 
 static GHashTable *
@@ -152,6 +156,9 @@ totem_pl_playlist_prepend (TotemPlPlaylist     *playlist,
 
         item = create_playlist_item ();
         priv->items = g_list_prepend (priv->items, item);
+        if (priv->last == NULL)
+                priv->last = priv->items;
+        priv->n_items++;
 
         iter->data1 = playlist;
         iter->data2 = priv->items;
@@ -184,7 +191,14 @@ totem_pl_playlist_append (TotemPlPlaylist     *playlist,
         list_item = g_list_alloc ();
         list_item->data = item;
 
-        priv->items = g_list_concat (priv->items, list_item);
+        if (priv->last == NULL) {
+                priv->items = list_item;
+        } else {
+                priv->last->next = list_item;
+                list_item->prev = priv->last;
+        }
+        priv->last = list_item;
+        priv->n_items++;
 
         iter->data1 = playlist;
         iter->data2 = list_item;
@@ -210,36 +224,38 @@ totem_pl_playlist_insert (TotemPlPlaylist     *playlist,
 {
         TotemPlPlaylistPrivate *priv;
         GHashTable *item;
+        GList *list_item;
 
         g_return_if_fail (TOTEM_IS_PL_PLAYLIST (playlist));
         g_return_if_fail (iter != NULL);
 
         priv = TOTEM_PL_PLAYLIST_GET_PRIVATE (playlist);
 
+        if (position < 0 || (guint) position >= priv->n_items) {
+                totem_pl_playlist_append (playlist, iter);
+                return;
+        }
+
         item = create_playlist_item ();
-        priv->items = g_list_insert (priv->items, item, position);
+        list_item = g_list_nth (priv->items, position);
+        priv->items = g_list_insert_before (priv->items, list_item, item);
+        priv->n_items++;
 
         iter->data1 = playlist;
-        iter->data2 = g_list_find (priv->items, item);
+        iter->data2 = list_item->prev;
 }
 
+/* Items never get removed from a playlist, so an iter that it handed
+ * out stays valid, and there's no need to look for it in the list */
 static gboolean
 check_iter (TotemPlPlaylist     *playlist,
             TotemPlPlaylistIter *iter)
 {
-        TotemPlPlaylistPrivate *priv;
-
         if (!iter) {
                 return FALSE;
         }
 
-        if (iter->data1 != playlist) {
-                return FALSE;
-        }
-
-        priv = TOTEM_PL_PLAYLIST_GET_PRIVATE (playlist);
-
-        if (g_list_position (priv->items, iter->data2) == -1) {
+        if (iter->data1 != playlist || iter->data2 == NULL) {
                 return FALSE;
         }
 
@@ -536,3 +552,26 @@ totem_pl_playlist_set (TotemPlPlaylist     *playlist,
         totem_pl_playlist_set_valist (playlist, iter, args);
         va_end (args);
 }
+
+#ifndef TOTEM_PL_PARSER_MINI
+/* For the savers, which walk the whole playlist: unlike the public
+ * functions, these don't check @iter, and the values aren't copied */
+const char *
+totem_pl_playlist_iter_lookup (TotemPlPlaylistIter *iter,
+                               const char          *key)
+{
+        GHashTable *item_data;
+
+        item_data = ((GList *) iter->data2)->data;
+
+        return g_hash_table_lookup (item_data, key);
+}
+
+gboolean
+totem_pl_playlist_iter_step (TotemPlPlaylistIter *iter)
+{
+        iter->data2 = ((GList *) iter->data2)->next;
+
+        return (iter->data2 != NULL);
+}
+#endif /* !TOTEM_PL_PARSER_MINI */